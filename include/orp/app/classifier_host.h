@@ -0,0 +1,73 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLASSIFIER_HOST_H_
+#define _CLASSIFIER_HOST_H_
+
+#include <pluginlib/class_loader.h>
+
+#include "orp/core/classifier3d.h"
+#include "orp/core/classifier_plugin.h"
+
+/**
+ * @brief   Runs several classifier plugins on one stream of segmented frames.
+ *
+ * The plugins to load are listed in the ~plugins parameter (see
+ * cfg/classifiers.yaml), each with a name and a pluginlib type:
+ *
+ *     plugins:
+ *       - {name: hue, type: orp/hue}
+ *       - {name: sixdof, type: orp/sixdof}
+ *
+ * Each plugin reads its own parameters from ~/<name>. Compared to running
+ * one node per classifier, the camera cloud is received and segmented once,
+ * and each cluster is decoded once for all of the plugins. Their objects
+ * are published together, tagged with their methods.
+ */
+class ClassifierHost : public Classifier3D {
+public:
+  ClassifierHost();
+
+  /// Stops classification before the plugins are unloaded.
+  virtual ~ClassifierHost();
+
+  /**
+   * Load and initialize the plugins listed in ~plugins. Entries that can't
+   * be loaded are skipped with an error.
+   * @return false if no plugins were loaded
+   */
+  bool loadPlugins();
+
+private:
+  /// Finds and loads the plugin libraries
+  pluginlib::ClassLoader<ClassifierPlugin> loader_;
+};
+
+#endif
@@ -0,0 +1,143 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SEGMENTATION_TUNER_H_
+#define _SEGMENTATION_TUNER_H_
+
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <orp/SegmentationConfig.h>
+
+/**
+ * @brief   Offline search for segmentation parameters that trade latency
+ *          against finding every object.
+ *
+ * A directory of recorded PCD frames is replayed through Segmentation (run
+ * offline, without ROS) once for every combination of the candidate values
+ * of voxel_leaf_size, cluster_tolerance, max_plane_segmentation_iterations
+ * and percentage_to_analyze. Combinations are evaluated in parallel.
+ *
+ * Each combination is scored by its mean segmentation time per frame and
+ * its cluster count score: the mean over frames of min(found, expected) /
+ * max(found, expected) clusters, which penalizes extra clusters as much as
+ * missing ones. The expected counts come from cluster_counts.txt in
+ * the frame directory ("<file name> <count>" per line) where a frame is
+ * listed there, and otherwise from the clusters found with the most
+ * thorough candidate values (smallest leaf size, most iterations, largest
+ * percentage to analyze).
+ *
+ * Frames must already be in the clipping frame, since there is no tf to
+ * transform them. Timings are taken while other combinations run on the
+ * other threads, so compare them with each other rather than with the live
+ * node.
+ */
+class SegmentationTuner {
+public:
+  /// One combination of parameters and how it did.
+  struct Trial {
+    orp::SegmentationConfig config;
+    /// mean segmentation time per frame
+    double seconds;
+    /// mean cluster count score, 0-1
+    double score;
+  };
+
+  SegmentationTuner();
+
+  /**
+   * Set an option from the command line. The tuned parameters take a
+   * comma-separated list of candidate values; spatial bounds, the other
+   * segmentation parameters, threads and min_score take one value.
+   * @return false if the key is unknown or the value doesn't parse
+   */
+  bool setOption(const std::string &key, const std::string &value);
+
+  /**
+   * Load every .pcd file in a directory, and cluster_counts.txt if it's
+   * there.
+   * @return false if there are no frames
+   */
+  bool loadFrames(const std::string &directory);
+
+  /// Evaluate every combination of candidate values.
+  void run();
+
+  /// The trials no other trial beats on both latency and score, fastest
+  /// first. Only valid after run().
+  std::vector<Trial> paretoFront() const;
+
+  /**
+   * Write the fastest trial on the Pareto front with at least min_score
+   * (or the one with the best score, if none reach it) as segmentation
+   * node parameters, with the whole front alongside for reference. The
+   * file can be passed to orp.launch as config_file.
+   * @return false if the file couldn't be written
+   */
+  bool writeYaml(const std::string &path) const;
+
+private:
+  /// Frame file names, for the YAML comments
+  std::vector<std::string> frameNames;
+  /// The recorded frames
+  std::vector<sensor_msgs::PointCloud2> frames;
+  /// Labelled cluster count per frame, or -1 if the frame isn't labelled
+  std::vector<int> labelledCounts;
+  /// The directory the frames came from
+  std::string frameDirectory;
+
+  /// Parameters that aren't searched
+  orp::SegmentationConfig base;
+  std::vector<double> voxelLeafSizes;
+  std::vector<double> clusterTolerances;
+  std::vector<int> planeIterations;
+  std::vector<double> percentagesToAnalyze;
+
+  /// Threads used to evaluate trials. 0 is one per core.
+  int threads;
+  /// Score the chosen configuration must reach
+  double minScore;
+
+  /// Every combination, once run() has finished
+  std::vector<Trial> trials;
+
+  /**
+   * Segment every frame with one configuration.
+   * @param config   the parameters
+   * @param counts   filled with the number of clusters in each frame
+   * @return         mean seconds per frame
+   */
+  double evaluate(const orp::SegmentationConfig &config,
+    std::vector<int> &counts) const;
+};
+
+#endif
@@ -35,21 +35,23 @@
 #include <pcl_ros/transforms.h>
 
 //NRG internal files
-#include "orp/core/classifier3d.h"
+#include "orp/core/classifier_plugin.h"
 
 /**
  * @brief   RGB-only classification - posterizing colors into main color groups
  */
-class BasicClassifier : public Classifier3D {
+class BasicClassifier : public ClassifierPlugin {
 public:
-  BasicClassifier();
+  void initialize(ros::NodeHandle& node, ros::NodeHandle& node_private);
+
+  std::string method() const { return "basic"; }
 
   /**
-   * Takes the incoming point cloud and runs classification on it, passing
-   * the result into the output topic.
-   * @param cloud the incoming cloud supplied from the topic publisher
+   * Reports the cluster as a generic "object" at its centroid if it has
+   * between 3 and 500 points.
    */
-  void cb_classify(const sensor_msgs::PointCloud2& cloud);
+  void classifyCluster(const ClusterView& cluster,
+    std::vector<orp::WorldObject>& objects);
 };
 
 #endif
\ No newline at end of file
@@ -31,6 +31,8 @@
 #ifndef CYLINDER_CLASSIFIER_H
 #define CYLINDER_CLASSIFIER_H
 
+#include <mutex>
+
 #include <eigen_conversions/eigen_msg.h>
 #include <dynamic_reconfigure/server.h>
 #include <pcl/segmentation/sac_segmentation.h>
@@ -42,23 +44,27 @@
 
 //NRG internal files
 #include <orp/CylinderClassifierConfig.h>
-#include "orp/core/classifier3d.h"
+#include "orp/core/classifier_plugin.h"
 #include "orp/core/orp_utils.h"
 
 /**
  * @brief   Cylinder-only classification - fits a cylinder to the dataset and
  *          returns the cylinder's position and orientation
  *
+ * The cylinder is fit to positions and to normals estimated from them, so
+ * clusters are read as GeometryPoint (see orp_utils.h).
+ *
  * TODO(Kukanani): THIS IMPLEMENTATION IS INCOMPLETE.
  * The cylinder is infinitely long, so although the axis of the object will
  * probably be correct, you would need to adjust the position along the
  * cylinder's Z-axis based on the maximum and minimum spatial extents of the
  * classified point cloud, after projecting on to the object's Z-axis
  */
-class CylinderClassifier : public Classifier3D {
+class CylinderClassifier : public ClassifierPlugin {
 protected:
-  /// used to find the cylindrical shape
-  pcl::SACSegmentationFromNormals<ORPPoint, pcl::Normal> seg;
+  /// Protects the parameters below, which dynamic_reconfigure can change
+  /// while clusters are being classified
+  std::mutex paramsMutex;
 
   /// tuning parameter for the the cylinder-finding algorithm.
   double normalDistanceWeight;
@@ -77,7 +83,8 @@ protected:
   double maxRadius;
 
   /// Enables usage of dynamic_reconfigure.
-  dynamic_reconfigure::Server<orp::CylinderClassifierConfig> reconfigureServer;
+  boost::shared_ptr<dynamic_reconfigure::Server<
+      orp::CylinderClassifierConfig> > reconfigureServer;
   /// Used for dynamic reconfigure internals
   dynamic_reconfigure::Server<orp::CylinderClassifierConfig>::CallbackType
       reconfigureCallbackType;
@@ -87,17 +94,23 @@ public:
    */
   CylinderClassifier();
 
+  /// Starts the dynamic_reconfigure server in node_private.
+  void initialize(ros::NodeHandle& node, ros::NodeHandle& node_private);
+
+  std::string method() const { return "cylinder"; }
+
+  bool needsPoints() const { return true; }
+
   /**
    * Dynamic reconfigure callback
    */
   void paramsChanged(orp::CylinderClassifierConfig &config, uint32_t level);
 
   /**
-   * Takes the incoming point cloud and runs classification on it, passing
-   * the result into the output topic.
-   * @param cloud the incoming cloud supplied from the topic publisher
+   * Fits a cylinder to the cluster and reports the cylinder's pose.
    */
-  void cb_classify(const sensor_msgs::PointCloud2& cloud);
+  void classifyCluster(const ClusterView& cluster,
+    std::vector<orp::WorldObject>& objects);
 };
 
 #endif
\ No newline at end of file
@@ -37,9 +37,7 @@
 #include <pcl_ros/transforms.h>
 
 //NRG internal files
-#include "orp/core/classifier3d.h"
-
-#include <mutex>
+#include "orp/core/classifier_plugin.h"
 
 
 /**
@@ -64,7 +62,7 @@ struct ObjHsv {
  * Hue-based classification - posterizing colors into red, green,
  * blue, yellow, orange, and purple
  */
-class HueClassifier : public Classifier3D {
+class HueClassifier : public ClassifierPlugin {
 protected:
 
   /**
@@ -72,25 +70,27 @@ protected:
    * This function looks for "hue_min", "hue_max", "sat_min", etc.
    * for each object on the parameter server and stores it internally.
    */
-  void loadTypeList();
-
-  std::mutex segmentation_mutex_;
+  void loadTypeList(ros::NodeHandle& node);
 
   std::vector<ObjHsv> obj_hsvs;
 public:
-  HueClassifier();
+  /// Loads the object types. Blocks until they're on the parameter server.
+  void initialize(ros::NodeHandle& node, ros::NodeHandle& node_private);
+
+  std::string method() const { return "hsv"; }
 
   /**
-   * Takes the incoming point cloud and runs classification on it, passing
-   * the result into the output topic.
-   * @param cloud the incoming cloud supplied from the topic publisher
+   * Labels the cluster with the first object type whose HSV range contains
+   * its mean color, if any.
    */
-  void cb_classify(const sensor_msgs::PointCloud2& cloud);
+  void classifyCluster(const ClusterView& cluster,
+    std::vector<orp::WorldObject>& objects);
 
   /**
-   * Get a string name that represents the most common color in this image.
+   * Get the name of the object type whose HSV range contains the mean color
+   * of the given cluster, or an empty string if there is none.
    */
-  std::string getClassByColor(const cv::Mat& cloud);
+  std::string getClassByColor(const orp::ClusterSummary& summary) const;
 };
 
 #endif
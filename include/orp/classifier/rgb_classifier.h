@@ -37,24 +37,25 @@
 #include <pcl_ros/transforms.h>
 
 //NRG internal files
-#include "orp/core/classifier3d.h"
+#include "orp/core/classifier_plugin.h"
 
 /**
  * @brief   RGB-only classification - posterizing colors into main color groups
  */
-class RGBClassifier : public Classifier3D {
+class RGBClassifier : public ClassifierPlugin {
 protected:
   ///For RGB cluster visualization
   cv::Mat M;
 public:
-  RGBClassifier();
+  void initialize(ros::NodeHandle& node, ros::NodeHandle& node_private);
+
+  std::string method() const { return "rgb"; }
 
   /**
-   * Takes the incoming point cloud and runs classification on it, passing
-   * the result into the output topic.
-   * @param cloud the incoming cloud supplied from the topic publisher
+   * Labels the cluster by its dominant mean color (red, green or blue).
    */
-  void cb_classify(const sensor_msgs::PointCloud2& cloud);
+  void classifyCluster(const ClusterView& cluster,
+    std::vector<orp::WorldObject>& objects);
 
   /**
    * Posterize the colors in a cv Mat. See
@@ -65,7 +66,7 @@ public:
   /**
    * Get a string name that represents the most common color in this image.
    */
-  std::string getColor(float r, float g, float b);
+  std::string getColor(float r, float g, float b) const;
 };
 
 #endif
\ No newline at end of file
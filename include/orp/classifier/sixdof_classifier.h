@@ -39,6 +39,9 @@
 /**
  * @brief   Uses the CVFH classifier to identify a 6-DOF pose for an object.
  *
+ * CVFH and CRH only look at positions and the normals estimated from them,
+ * so clusters are read as GeometryPoint (see orp_utils.h).
+ *
  * @version 1.0
  * @ingroup objectrecognition
  *
@@ -46,7 +49,7 @@
  */
 class SixDOFClassifier : public NNClassifier {
 public:
-  SixDOFClassifier();
+  std::string method() const { return "sixdof"; }
 
   /**
    * Load one histogram from a file, as long as it matches the known list of objects.
@@ -57,11 +60,11 @@ public:
   virtual bool loadHist(const boost::filesystem::path &path, FeatureVector &vec);
 
   /**
-   * Takes the incoming point cloud and runs classification on it, passing
-   * the result into the output topic.
-   * @param cloud the incoming cloud supplied from the topic publisher
+   * Matches the cluster's CVFH descriptor to the nearest known view, then
+   * aligns the two by their camera roll histograms to estimate its pose.
    */
-  void cb_classify(const sensor_msgs::PointCloud2& cloud);
+  void classifyCluster(const ClusterView& cluster,
+    std::vector<orp::WorldObject>& objects);
 };
 
 #endif
\ No newline at end of file
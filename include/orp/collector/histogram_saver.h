@@ -44,6 +44,7 @@
 #include <orp/Segmentation.h>
 #include <orp/HistogramSaverConfig.h>
 
+#include "orp/core/cluster_codec.h"
 #include "orp/core/orp_utils.h"
 
 /**
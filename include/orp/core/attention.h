@@ -0,0 +1,99 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _ATTENTION_H_
+#define _ATTENTION_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <ros/ros.h>
+#include <geometry_msgs/Point.h>
+
+#include <orp/AttentionRegion.h>
+
+/**
+ * Keeps track of the attention regions published for a node, and decides
+ * which of them each frame is focused on.
+ *
+ * A frame is focused on the active regions with the highest priority. While
+ * any region is active, a frame is still processed in full (focused on
+ * nothing) at unattendedRate, so that objects elsewhere in the scene don't
+ * go stale entirely.
+ */
+class AttentionRegions {
+public:
+  /**
+   * @param unattendedRate frames per second processed in full while regions
+   *                       are active. 0 never processes a frame in full then.
+   */
+  explicit AttentionRegions(double unattendedRate = 0.0);
+
+  /// Add a region, replacing the active one with the same id. Thread-safe.
+  void add(const orp::AttentionRegion &region);
+
+  /**
+   * Decide what a frame is focused on. Thread-safe.
+   * @param  now when the frame's processing starts
+   * @return     the regions to focus on. Empty if no region is active, or
+   *             if it is time to process a frame in full.
+   */
+  std::vector<orp::AttentionRegion> focus(const ros::Time &now);
+
+  /**
+   * Move a region into another frame.
+   * @param  region    the region to move
+   * @param  frame     the frame to move it to
+   * @param  transform from the region's frame to frame
+   * @return           the region, with its box grown to the bounding box of
+   *                   the moved corners
+   */
+  static orp::AttentionRegion transformed(const orp::AttentionRegion &region,
+    const std::string &frame, const Eigen::Affine3f &transform);
+
+  /**
+   * Whether a box (e.g. a cluster's bounding box) overlaps one of a set of
+   * regions. The regions must be in the box's frame.
+   */
+  static bool overlaps(const std::vector<orp::AttentionRegion> &regions,
+    const geometry_msgs::Point &min, const geometry_msgs::Point &max);
+
+private:
+  double unattendedPeriod;
+  /// when the next frame processed in full is due
+  ros::Time nextFull;
+  /// the regions received, each with its start time filled in
+  std::vector<orp::AttentionRegion> regions;
+  std::mutex mutex;
+};
+
+#endif
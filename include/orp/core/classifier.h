@@ -32,6 +32,7 @@
 #define _CLASSIFIER_H_
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <std_msgs/Empty.h>
 
@@ -44,6 +45,16 @@ protected:
   /// For getting private parameters
   ros::NodeHandle node_private_;
 
+  /// Callbacks for incoming data to classify. Kept off the global queue, so
+  /// that start/stop requests and reconfiguration are handled promptly
+  /// however long the data takes.
+  ros::CallbackQueue data_queue_;
+  /// Subscribe to data with this handle, so that the callbacks go on
+  /// data_queue_.
+  ros::NodeHandle data_node_;
+  /// Runs the data_queue_ callbacks on a thread of their own
+  ros::AsyncSpinner data_spinner_;
+
   /// Where to publish completed classifications
   std::string classification_topic_;
   /// Publishes completed classifications
@@ -77,6 +88,9 @@ public:
    */
   Classifier();
 
+  /// Stops the data spinner.
+  virtual ~Classifier();
+
   /**
    * If the autostart argument is true, then start. Call at the end of the
    * constructor. This has to be its own method because otherwise Classifier
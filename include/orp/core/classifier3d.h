@@ -31,44 +31,401 @@
 #ifndef _CLASSIFIER_3D_H_
 #define _CLASSIFIER_3D_H_
 
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/Header.h>
 
+#include <orp/CascadeStats.h>
+#include <orp/ClassifyClusters.h>
+#include <orp/FrameStats.h>
+#include <orp/GetCluster.h>
+#include <orp/Recognition.h>
 #include <orp/Segmentation.h>
+#include <orp/SegmentationRequest.h>
+#include <orp/SegmentationResult.h>
 
+#include <boost/shared_ptr.hpp>
+
+#include "orp/core/attention.h"
 #include "orp/core/classifier.h"
+#include "orp/core/classifier_plugin.h"
+#include "orp/core/classifier_scheduler.h"
+#include "orp/core/cluster_codec.h"
+#include "orp/core/cluster_tracker.h"
+#include "orp/core/latest_frame_slot.h"
+#include "orp/core/worker_pool.h"
+
+/// The answer to an asynchronous segmentation request.
+struct SegmentationReply {
+  /// false if the scene couldn't be segmented
+  bool ok;
+  /// true if the request was given up on before its result arrived
+  bool cancelled;
+  orp::Segmentation::Response response;
+};
 
 /**
  * @brief   A 3D classifier
  *
  * Extension of the basic classifier, but includes a segmentation client and
  * depth subscriber.
+ *
+ * Incoming clouds are handed to a separate classification thread through a
+ * LatestFrameSlot, so cb_classify always runs on the newest cloud and clouds
+ * that arrive while it's busy are dropped (and counted on ~frame_stats).
+ *
+ * By default each cloud is segmented with a blocking service call. If
+ * ~segmentation_depth is above 0, clouds are instead sent to segmentation
+ * asynchronously (see segmentAsync), with up to that many requests
+ * outstanding, and a second thread classifies the results in order. The
+ * next clouds are then being segmented while the current one is
+ * classified.
+ *
+ * If ~fused_scene is set, segmentation fuses its ~camera_topics itself.
+ * This node then only listens for the headers of the fused sets and asks
+ * for each to be segmented, so the fused cloud is never sent back and forth.
+ *
+ * The classification itself is done by ClassifierPlugins (see addPlugin).
+ * Each cluster is decoded once, if any plugin needs its points, and every
+ * plugin is run on every cluster, spread over a worker pool
+ * (~cluster_threads threads, one per core by default). The objects found
+ * are published together, in cluster order, as one ClassificationResult.
+ *
+ * If ~cascade is set, the plugins run as a cascade instead: the first stage
+ * classifies every cluster, and each later stage only gets the clusters
+ * whose best probability in the stage before it was under that stage's
+ * threshold. Each cluster's objects come from the last stage that found
+ * any, and the stages' pass-through rates are published on
+ * ~cascade_stats.
+ *
+ * Which plugins process each frame is decided by a ClassifierScheduler,
+ * from ~cpu_budget and each plugin's priority and target_rate parameters.
+ * Under load, low-priority plugins skip frames (a skipped cascade stage
+ * passes its clusters straight on). The rates achieved are published on
+ * ~scheduler_stats.
+ *
+ * AttentionRegions published on ~attention_topic focus the classification
+ * on part of the scene: while one is active, segmentation is asked for the
+ * clusters that overlap the highest-priority regions only, except for
+ * ~unattended_rate frames per second, which are classified in full.
+ *
+ * If ~track_clusters is set, a ClusterTracker matches each frame's clusters
+ * to the last frame's, and a plugin's objects for a cluster that hasn't
+ * moved or changed are reused instead of classifying it again, until
+ * ~track_refresh seconds have passed or it has drifted ~track_drift meters.
+ *
+ * Clusters from elsewhere can be classified on demand with ~classify_clusters
+ * (a batch) and ~recognize (one cluster). Every plugin runs on each of them,
+ * in parallel, whether or not the node has been started.
  */
 class Classifier3D : public Classifier {
 protected:
   /// Name of topic on which to listen for depth data.
   std::string depth_topic_;
-  /// Collects depth camera point clouds
+  /// If true, depth_topic_ carries the headers of segmentation's fused
+  /// camera sets rather than clouds, and segmentation is asked to fuse and
+  /// segment each set itself (~fused_scene)
+  bool fused_scene_;
+  /// Collects depth camera point clouds (on data_queue_)
   ros::Subscriber depth_sub_;
+  /// The newest cloud that hasn't been classified yet
+  LatestFrameSlot<sensor_msgs::PointCloud2ConstPtr> frame_slot_;
+  /// Takes clouds from frame_slot_ and classifies them
+  std::thread classify_thread_;
+  /// Publishes ingestion statistics after each classified cloud
+  ros::Publisher frame_stats_pub_;
+
+  /// Collects attention regions (on data_queue_)
+  ros::Subscriber attention_sub_;
+  /// The active attention regions
+  std::unique_ptr<AttentionRegions> attention_;
 
   /// Name of the service for segmentation
   std::string segmentation_service_;
   /// Makes calls to the segmentation server
   ros::ServiceClient segmentation_client_;
 
+  /// Maximum number of asynchronous segmentation requests awaiting
+  /// classification. 0 segments with the service instead.
+  int segmentation_depth_;
+  /// How long to wait for an asynchronous result before giving up on it
+  ros::Duration segmentation_timeout_;
+  /// Sends asynchronous segmentation requests
+  ros::Publisher segmentation_request_pub_;
+  /// Receives this node's asynchronous segmentation results (on
+  /// data_queue_)
+  ros::Subscriber segmentation_result_sub_;
+  /// Identifies this node's requests and results
+  std::string client_id_;
+  /// The id for the next asynchronous request
+  uint32_t next_request_id_;
+  /// Requests that haven't been answered yet, by id
+  std::map<uint32_t, std::promise<SegmentationReply> > pending_;
+  /// Protects next_request_id_ and pending_
+  std::mutex pending_mutex_;
+
+  /// A cloud whose segmentation has been requested but not classified yet
+  struct InFlight {
+    sensor_msgs::PointCloud2ConstPtr cloud;
+    uint32_t id;
+    std::future<SegmentationReply> reply;
+  };
+  /// Requests waiting to be classified, oldest first
+  std::deque<InFlight> in_flight_;
+  /// Set once classify_thread_ will send no more requests
+  bool requests_done_;
+  /// Protects in_flight_ and requests_done_
+  std::mutex in_flight_mutex_;
+  /// Signals changes to in_flight_ and requests_done_
+  std::condition_variable in_flight_changed_;
+  /// Classifies asynchronous results (only when segmentation_depth_ > 0)
+  std::thread result_thread_;
+
+  /// The classifiers run on each frame
+  std::vector<boost::shared_ptr<ClassifierPlugin> > plugins_;
+  /// Whether any plugin needs the points of the clusters
+  bool needs_points_;
+  /// The method name put on published ClassificationResults
+  std::string method_;
+  /// Runs plugins on several clusters at once. Null if ~cluster_threads is
+  /// 1, in which case everything runs on the classification thread.
+  std::unique_ptr<WorkerPool> cluster_pool_;
+  /// Picks the plugins that process each frame. Indexed like plugins_.
+  ClassifierScheduler scheduler_;
+  /// Publishes the rates scheduler_ achieved after each frame
+  ros::Publisher scheduler_stats_pub_;
+
+  /// Whether to reuse results for clusters that haven't changed
+  bool track_clusters_;
+  /// How closely clusters must match between frames (~track_* parameters)
+  ClusterTracker::Params track_params_;
+  /// Follows the clusters from frame to frame, with a result slot per
+  /// plugin (or one for the whole cascade). Made on the first frame.
+  std::unique_ptr<ClusterTracker> tracker_;
+
+  /// Whether to send each object's points along with it, rather than a
+  /// reference to its cluster
+  bool embed_clouds_;
+  /// How long a frame's clusters are kept for GetCluster. Should be at least
+  /// the recognizer's stale_time, which is how long its objects last.
+  ros::Duration cluster_cache_time_;
+  /// The name of the GetCluster service, for ClusterReferences
+  std::string cluster_service_;
+  /// Callbacks for the GetCluster, ClassifyClusters and Recognition
+  /// services. Kept off the global queue, which a node's main thread spins
+  /// alone, so that a long classification and start/stop requests or
+  /// reconfiguration don't wait on each other.
+  ros::CallbackQueue service_queue_;
+  /// Advertise services with this handle, so that the callbacks go on
+  /// service_queue_
+  ros::NodeHandle service_node_;
+  /// Runs the service_queue_ callbacks on a thread of their own, from init()
+  ros::AsyncSpinner service_spinner_;
+  /// Answers GetCluster requests
+  ros::ServiceServer cluster_server_;
+  /// Answers ClassifyClusters requests
+  ros::ServiceServer classify_server_;
+  /// Answers Recognition requests
+  ros::ServiceServer recognize_server_;
+  /// Counts classified frames, to tell them apart in ClusterReferences
+  uint32_t frame_count_;
+  /// A frame's segmentation, kept for GetCluster
+  struct CachedFrame
+  {
+    /// The frame count
+    uint32_t frame;
+    /// When the frame was classified
+    ros::Time stamp;
+    boost::shared_ptr<const orp::Segmentation::Response> segmentation;
+  };
+  /// The frames classified in the last cluster_cache_time_, oldest first
+  std::deque<CachedFrame> cache_;
+  /// Protects cache_, which is read by the service callbacks
+  std::mutex cache_mutex_;
+
+  /// A stage of the classifier cascade
+  struct CascadeStage {
+    /// method of the plugin that runs in this stage
+    std::string method;
+    /// clusters whose best probability is under this go on to the next stage
+    float threshold;
+    /// null until a plugin with this method is added
+    boost::shared_ptr<ClassifierPlugin> plugin;
+    /// the plugin's index in plugins_
+    size_t index;
+    /// clusters classified by this stage so far
+    uint64_t classified;
+    /// clusters passed on to the next stage so far
+    uint64_t forwarded;
+  };
+  /// The stages from ~cascade, in order. Empty if every plugin runs on
+  /// every cluster.
+  std::vector<CascadeStage> cascade_;
+  /// Publishes cascade_'s counts after each frame
+  ros::Publisher cascade_stats_pub_;
+
+  /// Store an incoming cloud for the classification thread.
+  void cb_depth(const sensor_msgs::PointCloud2ConstPtr& cloud);
+
+  /// Store an empty cloud with a fused set's header for the classification
+  /// thread. Segmentation fills in the points when it's segmented.
+  void cb_fusedFrame(const std_msgs::HeaderConstPtr& header);
+
+  /// Send the points of a recently classified cluster.
+  bool cb_getCluster(orp::GetCluster::Request& req,
+      orp::GetCluster::Response& res);
+
+  /// Classify a batch of clusters sent in by a client.
+  bool cb_classifyClusters(orp::ClassifyClusters::Request& req,
+      orp::ClassifyClusters::Response& res);
+
+  /// Classify one cluster sent in by a client, and return the most probable
+  /// object.
+  bool cb_recognize(orp::Recognition::Request& req,
+      orp::Recognition::Response& res);
+
+  /**
+   * Run every plugin on clusters that didn't come from this node's own
+   * segmentation, e.g. for a service request.
+   * @param clusters the clusters
+   * @param found    set to the objects found, one list per cluster and
+   *                 plugin (cluster i, plugin p at i * plugins + p)
+   */
+  void classifyClusters(const std::vector<sensor_msgs::PointCloud2>& clusters,
+      std::vector<std::vector<orp::WorldObject> >& found);
+
+  /// Start focusing on a new attention region.
+  void cb_attention(const orp::AttentionRegionConstPtr& region);
+
+  /// Pass an asynchronous result to the request that's waiting for it.
+  void cb_segmentationResult(
+      const boost::shared_ptr<orp::SegmentationResult>& result);
+
+  /**
+   * Classification thread body. When segmenting asynchronously, this only
+   * sends the requests, and result_thread_ classifies.
+   */
+  void classifyLoop();
+
+  /// Body of result_thread_
+  void resultLoop();
+
+  /// Stop and join the classification threads.
+  void stopThreads();
+
+  /**
+   * Ask segmentation for the clusters in a cloud without waiting for them.
+   * @param  cloud     the cloud to segment
+   * @param  attention the regions the clusters must overlap, if any
+   * @param  id        set to the request's id, for cancelSegmentation
+   * @return           becomes ready when the result arrives
+   */
+  std::future<SegmentationReply> segmentAsync(
+      const sensor_msgs::PointCloud2& cloud,
+      const std::vector<orp::AttentionRegion>& attention, uint32_t& id);
+
+  /// Forget an asynchronous request, e.g. after it timed out. Its future
+  /// is never fulfilled.
+  void cancelSegmentation(uint32_t id);
+
+  /// Give up on every request still waiting for its result. Their futures
+  /// become ready with SegmentationReply::cancelled set.
+  void cancelPending();
+
+  /// Run fn(0) ... fn(n-1) on cluster_pool_, or in turn if there is none.
+  void runParallel(size_t n, const std::function<void(size_t)>& fn);
+
+  /// Read the stages of the cascade from ~cascade, if it's set.
+  void loadCascade();
+
+  /**
+   * Run the cascade on a frame's clusters.
+   * @param clusters the clusters
+   * @param points   their decoded points, or null if they haven't been
+   *                 decoded yet. Filled in for the clusters that reach a
+   *                 stage which needs them.
+   * @param found    set to the objects found in each cluster
+   * @param methods  set to the method that found each cluster's objects
+   * @param run      which plugins may process this frame
+   * @param cpu      incremented by the CPU time each plugin used
+   * @param now      the time of the frame, for the tracker
+   */
+  void classifyCascade(ClusterSet& clusters,
+      std::vector<pcl::PointCloud<GeometryPoint>::Ptr>& points,
+      std::vector<std::vector<orp::WorldObject> >& found,
+      std::vector<std::string>& methods, const std::vector<bool>& run,
+      std::vector<double>& cpu, const ros::Time& now);
+
 public:
   /**
-   * Constructor. Don't forget to call init() afterwards.
+   * Constructor. Don't forget to add plugins and call init() afterwards.
    */
   Classifier3D();
 
+  /// Calls shutdown(), in case nothing has yet.
+  virtual ~Classifier3D();
+
+  /// Start answering the services, once the plugins are added, and
+  /// autostart if configured to.
+  virtual void init();
+
   /**
-   * callback for whenever a point cloud is received. Implementations of this
-   * method should emit a Classification message to some topic.
-   *
+   * Stop receiving clouds, results and service requests, and join the
+   * classification threads. They call virtual methods and plugins, so a
+   * derived class must call this first thing in its destructor, before its
+   * own members go away. Calling it again does nothing.
+   */
+  void shutdown();
+
+  /**
+   * Segment a cloud with the segmentation service, focused on the current
+   * attention regions, then classify it.
    * @param cloud the point cloud to generate a classification from.
    */
-  virtual void cb_classify(const sensor_msgs::PointCloud2& cloud) = 0;
+  virtual void cb_classify(const sensor_msgs::PointCloud2& cloud);
+
+  /**
+   * Initialize a classifier and add it to the ones run on each frame. Must
+   * be called before init().
+   *
+   * If ~cascade is set, the plugin becomes the stage with its method, and
+   * is neither initialized nor run if there is no such stage.
+   *
+   * @param plugin the classifier
+   * @param ns     the plugin reads its parameters from ~/ns, or from ~ if
+   *               ns is empty. Its scheduling priority and target_rate
+   *               are read from there too.
+   */
+  void addPlugin(const boost::shared_ptr<ClassifierPlugin>& plugin,
+      const std::string& ns = "");
+
+  /**
+   * Classify the clusters segmentation found in a cloud with every plugin
+   * (or with the cascade), and publish the result.
+   *
+   * The objects refer to their clusters (see ClusterReference), which
+   * stay available from ~get_cluster for ~cluster_cache_time. Their
+   * points are left out unless ~embed_clouds is set.
+   *
+   * @param cloud        the cloud that was segmented
+   * @param segmentation its clusters. Empty if segmentation failed. Kept
+   *                     for ~get_cluster.
+   */
+  virtual void classify(const sensor_msgs::PointCloud2& cloud,
+    const boost::shared_ptr<const orp::Segmentation::Response>&
+      segmentation);
 
   /**
    * Start listening to images
@@ -0,0 +1,118 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLASSIFIER_PLUGIN_H_
+#define _CLASSIFIER_PLUGIN_H_
+
+#include <string>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <ros/ros.h>
+#include <std_msgs/Header.h>
+
+#include <orp/ClusterSummary.h>
+#include <orp/WorldObject.h>
+
+#include "orp/core/orp_utils.h"
+
+/**
+ * One cluster of a segmented frame, as classifiers see it. Every classifier
+ * running on the frame shares the same views, so nothing in them may be
+ * modified.
+ */
+class ClusterView {
+public:
+  /// The header and summary must outlive the view.
+  ClusterView(const std_msgs::Header &header,
+    const orp::ClusterSummary &summary,
+    const pcl::PointCloud<GeometryPoint>::ConstPtr &points) :
+    header_(&header),
+    summary_(&summary),
+    points_(points)
+  {
+  }
+
+  const std_msgs::Header& header() const { return *header_; }
+
+  const orp::ClusterSummary& summary() const { return *summary_; }
+
+  /// The positions of the cluster's points. Null unless a classifier on the
+  /// frame needs points and the cluster has at least 3 of them.
+  const pcl::PointCloud<GeometryPoint>::ConstPtr& points() const
+  {
+    return points_;
+  }
+
+private:
+  const std_msgs::Header *header_;
+  const orp::ClusterSummary *summary_;
+  pcl::PointCloud<GeometryPoint>::ConstPtr points_;
+};
+
+/**
+ * @brief   A classifier that can be loaded into a Classifier3D host.
+ *
+ * Plugins are exported with pluginlib (see classifier_plugins.xml) so that
+ * classifier_host can run several of them on one segmented frame. Each of
+ * the single-classifier nodes hosts one plugin the same way.
+ */
+class ClassifierPlugin {
+public:
+  virtual ~ClassifierPlugin() {}
+
+  /**
+   * Set the classifier up. Called once, before any clusters are classified.
+   * @param node         the host's node handle
+   * @param node_private where to read the classifier's own parameters
+   */
+  virtual void initialize(ros::NodeHandle &node,
+    ros::NodeHandle &node_private) = 0;
+
+  /// The method name that tags this classifier's objects.
+  virtual std::string method() const = 0;
+
+  /// Whether classifyCluster reads the points of the cluster. If no plugin
+  /// does, the clusters are never decoded.
+  virtual bool needsPoints() const { return false; }
+
+  /**
+   * Classify one cluster. Called from several threads at once, for
+   * different clusters, so implementations must not modify shared state
+   * without locking it.
+   *
+   * @param cluster the cluster to classify
+   * @param objects add the objects found in the cluster (if any) here
+   */
+  virtual void classifyCluster(const ClusterView &cluster,
+    std::vector<orp::WorldObject> &objects) = 0;
+};
+
+#endif
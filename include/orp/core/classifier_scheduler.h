@@ -0,0 +1,145 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLASSIFIER_SCHEDULER_H_
+#define _CLASSIFIER_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include <orp/SchedulerStats.h>
+
+/// CPU time used by the calling thread so far, in seconds.
+double threadCpuSeconds();
+
+/**
+ * Decides which classifiers process each frame, within a CPU budget.
+ *
+ * The budget is a number of cores (cores times duty cycle). It fills a
+ * bucket of CPU time at that rate, up to a few seconds' worth, and every
+ * classifier run is paid for out of the bucket with the CPU time it actually
+ * used. Before each frame, the classifiers that are due (see the target
+ * rates) are considered from the highest priority down, and each one runs
+ * if the CPU time it usually takes is still left. The rest skip the frame,
+ * so that under load the low-priority classifiers run less often, instead of
+ * every classifier being slowed down.
+ *
+ * Not thread-safe: plan() and finish() are called once per frame, in turn,
+ * by the thread that classifies.
+ */
+class ClassifierScheduler {
+public:
+  /**
+   * @param budget the CPU time that may be used per second, in cores. 0 or
+   *               less doesn't limit the classifiers.
+   * @param burst  how many seconds of unused budget may be saved up
+   */
+  explicit ClassifierScheduler(double budget = 0.0, double burst = 1.0);
+
+  /**
+   * Add a classifier. Classifiers are identified by the order they are
+   * added in, starting at 0.
+   * @param method     the classifier's name in stats()
+   * @param priority   classifiers with higher priorities get the budget
+   *                   first
+   * @param targetRate frames per second the classifier should process, or
+   *                   0 for all of them
+   */
+  void add(const std::string &method, int priority, double targetRate);
+
+  /// Number of classifiers added.
+  size_t size() const { return classifiers.size(); }
+
+  /**
+   * Decide which classifiers process a new frame.
+   * @param  now when the frame's classification starts
+   * @return     whether each classifier should process the frame
+   */
+  std::vector<bool> plan(const ros::WallTime &now);
+
+  /**
+   * Account for the frame planned last.
+   * @param cpuSeconds CPU time each classifier used on the frame (0 for the
+   *                   ones that didn't run)
+   * @param overhead   CPU time used on the frame's behalf by no classifier
+   *                   in particular, like decoding its clusters
+   */
+  void finish(const std::vector<double> &cpuSeconds, double overhead = 0.0);
+
+  /// Rates and costs achieved over the last few seconds.
+  orp::SchedulerStats stats() const;
+
+private:
+  struct Entry {
+    std::string method;
+    int priority;
+    double targetRate;
+    /// when the classifier should process a frame next
+    double nextDue;
+    /// average CPU time per frame processed, in seconds
+    double cost;
+    bool measured;
+    uint64_t runs;
+    uint64_t skipped;
+    /// when the recent frames it processed started
+    std::deque<double> recentRuns;
+  };
+
+  /// Forget runs and CPU use from before the averaging window.
+  void trim(double now);
+
+  double budget;
+  /// most CPU time the bucket holds
+  double capacity;
+  /// CPU time that may be used right now. Negative after going over.
+  double credit;
+
+  std::vector<Entry> classifiers;
+  /// classifier indices, highest priority first
+  std::vector<size_t> order;
+  /// the last plan()
+  std::vector<bool> planned;
+  double planTime;
+
+  double started;
+  double lastFrame;
+  /// average time between frames, in seconds
+  double frameInterval;
+  /// (time, CPU seconds) of each recent frame
+  std::deque<std::pair<double, double> > recentUse;
+};
+
+#endif
@@ -0,0 +1,127 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLOUD_MESSAGE_POOL_H_
+#define _CLOUD_MESSAGE_POOL_H_
+
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include "orp/core/compact_point.h"
+#include "orp/core/object_pool.h"
+#include "orp/core/orp_utils.h"
+
+/**
+ * Recycled PointCloud2 messages, and a writer that fills them straight from
+ * ORP points.
+ *
+ * Messages are borrowed with acquire() and published through the returned
+ * pointer. Once roscpp (and any intra-process subscriber) is done with a
+ * message, it goes back to the pool with its data buffer still allocated,
+ * so publishing the same kind of cloud every frame stops reallocating.
+ *
+ * write() packs each point as x, y, z, rgb (16 bytes, no padding), using one
+ * shared set of field descriptors. This is the CompactPoint layout, so
+ * compact clouds are copied in with a single memcpy. Points without color
+ * are packed as x, y, z only (12 bytes). pcl::fromROSMsg reads this layout back
+ * into any point type by field name.
+ */
+class CloudMessagePool {
+public:
+  typedef boost::shared_ptr<sensor_msgs::PointCloud2> Ptr;
+
+  CloudMessagePool();
+
+  /// Borrow an empty message.
+  Ptr acquire();
+
+  /// Borrow a message and write a cloud into it.
+  template <typename PointT>
+  Ptr make(const pcl::PointCloud<PointT> &cloud, const std::string &frame) {
+    Ptr message = acquire();
+    write(cloud, frame, *message);
+    return message;
+  }
+
+  /// Borrow a message and write a compact cloud into it.
+  Ptr make(const CompactCloud &cloud, const std_msgs::Header &header,
+    bool withColor = true);
+
+  /**
+   * Write a cloud into a message, keeping its width and height. This and
+   * the other point cloud write are explicitly instantiated for the point
+   * types in point_traits.h.
+   * @param cloud the points to write
+   * @param frame the frame_id for the message header
+   * @param out   the message to fill. Its data buffer is reused.
+   */
+  template <typename PointT>
+  static void write(const pcl::PointCloud<PointT> &cloud,
+    const std::string &frame, sensor_msgs::PointCloud2 &out);
+
+  /**
+   * Write some of the points of a cloud into a message, as an unorganized
+   * cloud.
+   * @param cloud   the cloud containing the points
+   * @param indices the points of cloud to write, in order
+   * @param frame   the frame_id for the message header
+   * @param out     the message to fill. Its data buffer is reused.
+   */
+  template <typename PointT>
+  static void write(const pcl::PointCloud<PointT> &cloud,
+    const std::vector<int> &indices, const std::string &frame,
+    sensor_msgs::PointCloud2 &out);
+
+  /**
+   * Write a compact cloud into a message, as an unorganized cloud.
+   * @param cloud     the points to write
+   * @param header    the header for the message
+   * @param withColor if false, the rgb field is left out
+   * @param out       the message to fill. Its data buffer is reused.
+   */
+  static void write(const CompactCloud &cloud, const std_msgs::Header &header,
+    bool withColor, sensor_msgs::PointCloud2 &out);
+
+  /// The field descriptors used by write, with or without the rgb field.
+  static const std::vector<sensor_msgs::PointField>& fields(
+    bool withColor = true);
+
+  /// Size of one point written by write.
+  static const uint32_t kPointStep = 16;
+  /// Size of one point without color written by write.
+  static const uint32_t kGeometryPointStep = 12;
+
+private:
+  ObjectPool<sensor_msgs::PointCloud2> messages;
+};
+
+#endif
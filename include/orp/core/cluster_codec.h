@@ -0,0 +1,122 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLUSTER_CODEC_H_
+#define _CLUSTER_CODEC_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <orp/CompressedCluster.h>
+#include <orp/Segmentation.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "orp/core/compact_point.h"
+#include "orp/core/orp_utils.h"
+
+/**
+ * Encoding and decoding for orp::CompressedCluster.
+ *
+ * Positions are quantized to a grid and stored as deltas between sorted
+ * Morton keys, so the cost per point depends on how densely the cluster
+ * fills its grid rather than on its extent. A voxelized cluster sent at 1 mm
+ * takes about 2 bytes per point for positions, plus 3 for color, against 16
+ * bytes per point as a PointCloud2. The point order is not preserved.
+ */
+namespace ClusterCodec {
+  /**
+   * Compress some of the points of a cloud. Explicitly instantiated for the
+   * point types in point_traits.h; color is kept if the type has it.
+   * @param cloud      the cloud containing the points
+   * @param indices    the points of cloud to encode
+   * @param resolution the grid spacing in meters. It is raised if the
+   *                   cluster is too big to fit a 2^21 cell grid.
+   * @param frame      the frame_id for the message header
+   * @param out        the message to fill. Its data buffer is reused.
+   */
+  template <typename PointT>
+  void encode(const pcl::PointCloud<PointT> &cloud,
+    const std::vector<int> &indices, float resolution,
+    const std::string &frame, orp::CompressedCluster &out);
+
+  /**
+   * Decompress a cluster. Points without color are given rgba 0.
+   * @return false if the data is truncated or corrupt, in which case out
+   *         is left empty
+   */
+  bool decode(const orp::CompressedCluster &in, CompactCloud &out);
+
+  /**
+   * Decompress a cluster into a message in the layout CloudMessagePool
+   * writes.
+   * @return false if the data is truncated or corrupt, in which case out
+   *         has no points
+   */
+  bool decode(const orp::CompressedCluster &in,
+    sensor_msgs::PointCloud2 &out);
+};
+
+/**
+ * The clusters of a segmentation response, whether segmentation sent them as
+ * point clouds or compressed.
+ *
+ * Headers and summaries are available without touching the points.
+ * Compressed clusters are decoded the first time their cloud is asked for,
+ * so classifiers that work from the summaries alone never decode anything.
+ */
+class ClusterSet {
+public:
+  /// The response must outlive the set.
+  explicit ClusterSet(const orp::Segmentation::Response &response);
+
+  size_t size() const;
+
+  /// The header of cluster i, without decoding it.
+  const std_msgs::Header& header(size_t i) const;
+
+  const orp::ClusterSummary& summary(size_t i) const;
+
+  /// The points of cluster i. A cluster that fails to decode comes back
+  /// empty. Different clusters may be fetched from different threads at
+  /// once, but not the same one.
+  const sensor_msgs::PointCloud2& cloud(size_t i);
+
+private:
+  const orp::Segmentation::Response &response;
+  bool compressed;
+  std::vector<sensor_msgs::PointCloud2> decoded;
+  /// not vector<bool>, so that flags of different clusters don't share
+  /// bytes
+  std::vector<char> isDecoded;
+};
+
+#endif
@@ -0,0 +1,69 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLUSTER_SUMMARY_H_
+#define _CLUSTER_SUMMARY_H_
+
+#include <vector>
+
+#include <orp/ClusterSummary.h>
+
+#include "orp/core/orp_utils.h"
+
+/**
+ * Computes the basic properties of a cluster (centroid, axis-aligned and
+ * oriented bounding boxes, mean color) that nearly every classifier needs.
+ *
+ * The centroid, bounds, color and second moments are all accumulated in a
+ * single pass over the points, using Eigen's fixed-size (vectorized) types.
+ * The oriented bounding box then needs one more pass to project the points
+ * onto the principal axes.
+ *
+ * Both functions are explicitly instantiated for the point types in
+ * point_traits.h. For points without color, the color fields are left 0.
+ */
+namespace ClusterSummaries {
+  /**
+   * Summarize a subset of a point cloud.
+   * @param  cloud   the cloud containing the cluster
+   * @param  indices the indices of the points in cloud that form the cluster
+   * @return         the summary. point_count is 0 if there were no valid
+   *                 points.
+   */
+  template <typename PointT>
+  orp::ClusterSummary summarize(const pcl::PointCloud<PointT> &cloud,
+    const std::vector<int> &indices);
+
+  /// Summarize an entire point cloud.
+  template <typename PointT>
+  orp::ClusterSummary summarize(const pcl::PointCloud<PointT> &cloud);
+};
+
+#endif
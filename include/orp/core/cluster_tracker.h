@@ -0,0 +1,147 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CLUSTER_TRACKER_H_
+#define _CLUSTER_TRACKER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include <orp/ClusterSummary.h>
+#include <orp/WorldObject.h>
+
+/**
+ * Follows clusters from frame to frame, so that a classifier's result for a
+ * cluster can be reused while it stays the same physical object in nearly
+ * the same place.
+ *
+ * Each frame's clusters are matched to the previous frame's by centroid
+ * distance, bounding box extent and point count, using only their
+ * summaries. A result stored for a cluster carries over to its match in the
+ * next frame, and stays fresh until it is older than the refresh interval or
+ * the cluster's centroid has drifted too far from where it was classified.
+ *
+ * Results are kept in slots, e.g. one per classifier, so that each can be
+ * reused or refreshed on its own.
+ */
+class ClusterTracker {
+public:
+  /// How closely clusters have to match, and how long results stay fresh.
+  struct Params {
+    /// furthest a centroid may move from one frame to the next, in meters
+    double maxDistance;
+    /// largest change of each bounding box dimension between frames, as a
+    /// fraction of the previous dimension
+    double maxExtentChange;
+    /// largest change of the point count between frames, as a fraction of
+    /// the previous count
+    double maxCountChange;
+    /// results older than this many seconds are stale
+    double refresh;
+    /// results are stale once the centroid is this far from where they
+    /// were found, in meters
+    double drift;
+
+    Params();
+  };
+
+  /// @param slots number of results stored per cluster
+  ClusterTracker(const Params &params, size_t slots);
+
+  /**
+   * Match a new frame's clusters to the previous frame's. Afterwards,
+   * cluster i of this frame is tracked at index i, and unmatched clusters
+   * from the previous frame are forgotten.
+   * @param summaries the new frame's clusters
+   */
+  void update(const std::vector<orp::ClusterSummary> &summaries);
+
+  /// The id of cluster i, which stays the same while it is matched.
+  uint32_t id(size_t i) const { return tracks[i].id; }
+
+  /// Whether cluster i continues a cluster from the previous frame.
+  bool matched(size_t i) const { return tracks[i].matched; }
+
+  /**
+   * Whether the result stored in a slot for cluster i can be reused.
+   * @param now the time of the current frame
+   */
+  bool fresh(size_t i, size_t slot, const ros::Time &now) const;
+
+  /// The objects stored in a slot for cluster i.
+  const std::vector<orp::WorldObject>& objects(size_t i, size_t slot) const {
+    return tracks[i].results[slot].objects;
+  }
+
+  /// The method stored in a slot for cluster i.
+  const std::string& method(size_t i, size_t slot) const {
+    return tracks[i].results[slot].method;
+  }
+
+  /**
+   * Store the result of classifying cluster i.
+   * @param now when it was classified
+   */
+  void store(size_t i, size_t slot,
+    const std::vector<orp::WorldObject> &objects, const std::string &method,
+    const ros::Time &now);
+
+private:
+  struct Result {
+    bool valid;
+    std::vector<orp::WorldObject> objects;
+    std::string method;
+    ros::Time time;
+    /// the cluster's centroid when the result was found
+    geometry_msgs::Point centroid;
+  };
+  struct Track {
+    uint32_t id;
+    bool matched;
+    orp::ClusterSummary summary;
+    std::vector<Result> results;
+  };
+
+  /// Whether a cluster can be the same one as a track's from last frame.
+  bool similar(const orp::ClusterSummary &previous,
+    const orp::ClusterSummary &current) const;
+
+  Params params;
+  size_t slots;
+  uint32_t nextId;
+  /// one per cluster of the last frame, in order
+  std::vector<Track> tracks;
+};
+
+#endif
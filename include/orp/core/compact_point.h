@@ -0,0 +1,225 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _COMPACT_POINT_H_
+#define _COMPACT_POINT_H_
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "orp/core/orp_utils.h"
+
+/**
+ * A point with no padding: position and packed color in 16 bytes, half the
+ * size of ORPPoint (pcl::PointXYZRGB), which pads both the position and the
+ * color out to 16 bytes each for SSE.
+ *
+ * ORP uses this for its own passes over raw scene data (decoding, clipping,
+ * voxelizing), and converts to ORPPoint only where a PCL algorithm needs the
+ * padded layout. The memory layout is the same as the x, y, z, rgb fields
+ * CloudMessagePool writes, so clouds can be copied into messages as is.
+ */
+struct CompactPoint {
+  float x;
+  float y;
+  float z;
+  /// Color packed like PCL's rgba: 0xAARRGGBB
+  uint32_t rgba;
+
+  uint8_t r() const { return (rgba >> 16) & 0xff; }
+  uint8_t g() const { return (rgba >> 8) & 0xff; }
+  uint8_t b() const { return rgba & 0xff; }
+};
+
+static_assert(sizeof(CompactPoint) == 16, "CompactPoint must not be padded");
+
+typedef std::vector<CompactPoint> CompactCloud;
+
+/**
+ * A CompactPoint with its position stored as 16-bit integers relative to a
+ * bounding box (12 bytes). See PointQuantizer.
+ */
+struct QuantizedPoint {
+  uint32_t rgba;
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(QuantizedPoint) == 12,
+  "QuantizedPoint must not be padded");
+
+typedef std::vector<QuantizedPoint> QuantizedCloud;
+
+/**
+ * Converts points inside a box to and from QuantizedPoint. Each axis of the
+ * box is split into 65536 steps, so a 10 m range is stored at 0.15 mm
+ * resolution.
+ */
+class PointQuantizer {
+public:
+  /**
+   * @param minBound minimum corner of the box. Points outside the box are
+   *                 clamped to it.
+   * @param maxBound maximum corner of the box
+   */
+  PointQuantizer(const Eigen::Vector3f &minBound,
+    const Eigen::Vector3f &maxBound);
+
+  /// The size of one step on each axis.
+  Eigen::Vector3f resolution() const { return step; }
+
+  QuantizedPoint quantize(const CompactPoint &point) const;
+  CompactPoint dequantize(const QuantizedPoint &point) const;
+
+  void quantize(const CompactCloud &in, QuantizedCloud &out) const;
+  void dequantize(const QuantizedCloud &in, CompactCloud &out) const;
+
+private:
+  Eigen::Vector3f center;
+  Eigen::Vector3f step;
+  Eigen::Vector3f inverseStep;
+};
+
+/**
+ * Conversions between CompactCloud and the other cloud formats.
+ */
+namespace CompactClouds {
+  /// Find the byte offset of a named field, or -1 if there is no such field.
+  int fieldOffset(const sensor_msgs::PointCloud2 &cloud,
+    const std::string &name);
+
+  /**
+   * Read the points of a ROS cloud, transform them, and pass the ones that
+   * fall strictly inside the given bounds to fn, one CompactPoint at a time.
+   * This is the one decode loop behind decode() and VoxelHash::insert().
+   * @param cloud     the cloud to read. Must have float x/y/z fields; color
+   *                  is read from an rgb or rgba field if there is one.
+   * @param transform applied to each point before it is bounded
+   * @param minBound  minimum corner of the region to keep
+   * @param maxBound  maximum corner of the region to keep
+   * @param withColor if false, color isn't read and is left 0
+   * @param fn        called as fn(const CompactPoint&) for each kept point
+   * @return          false if the cloud has no x/y/z fields
+   */
+  template <typename Function>
+  bool forEachPoint(const sensor_msgs::PointCloud2 &cloud,
+    const Eigen::Affine3f &transform,
+    const Eigen::Vector3f &minBound, const Eigen::Vector3f &maxBound,
+    bool withColor, Function fn)
+  {
+    int xOffset = fieldOffset(cloud, "x");
+    int yOffset = fieldOffset(cloud, "y");
+    int zOffset = fieldOffset(cloud, "z");
+    if(xOffset < 0 || yOffset < 0 || zOffset < 0) {
+      return false;
+    }
+    int colorOffset = -1;
+    if(withColor) {
+      colorOffset = fieldOffset(cloud, "rgb");
+      if(colorOffset < 0) {
+        colorOffset = fieldOffset(cloud, "rgba");
+      }
+    }
+
+    for(uint32_t row = 0; row < cloud.height; ++row) {
+      const uint8_t *point = &cloud.data[row * cloud.row_step];
+      for(uint32_t col = 0; col < cloud.width;
+          ++col, point += cloud.point_step)
+      {
+        Eigen::Vector3f p;
+        memcpy(&p[0], point + xOffset, sizeof(float));
+        memcpy(&p[1], point + yOffset, sizeof(float));
+        memcpy(&p[2], point + zOffset, sizeof(float));
+        if(!pcl_isfinite(p[0]) || !pcl_isfinite(p[1]) ||
+           !pcl_isfinite(p[2]))
+        {
+          continue;
+        }
+        p = transform * p;
+        if((p.array() <= minBound.array()).any() ||
+           (p.array() >= maxBound.array()).any())
+        {
+          continue;
+        }
+
+        CompactPoint compact;
+        compact.x = p[0];
+        compact.y = p[1];
+        compact.z = p[2];
+        compact.rgba = 0;
+        if(colorOffset >= 0) {
+          memcpy(&compact.rgba, point + colorOffset, sizeof(uint32_t));
+        }
+        fn(compact);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Read the points of a ROS cloud, transform them, and keep the ones that
+   * fall strictly inside the given bounds. No intermediate PCL cloud is
+   * built.
+   * @param cloud     the cloud to read. Must have float x/y/z fields; color
+   *                  is read from an rgb or rgba field if there is one.
+   * @param transform applied to each point before it is bounded
+   * @param minBound  minimum corner of the region to keep
+   * @param maxBound  maximum corner of the region to keep
+   * @param out       filled with the points that were kept
+   * @param withColor if false, color isn't read and is left 0
+   * @return          false if the cloud has no x/y/z fields
+   */
+  bool decode(const sensor_msgs::PointCloud2 &cloud,
+    const Eigen::Affine3f &transform,
+    const Eigen::Vector3f &minBound, const Eigen::Vector3f &maxBound,
+    CompactCloud &out, bool withColor = true);
+
+  /// Whether a ROS cloud has an rgb or rgba field.
+  bool hasColor(const sensor_msgs::PointCloud2 &cloud);
+
+  /// Convert to the padded PCL layout.
+  ORPPoint toORPPoint(const CompactPoint &point);
+
+  /// Convert from the padded PCL layout.
+  CompactPoint fromORPPoint(const ORPPoint &point);
+
+  /// Convert a whole cloud to the padded PCL layout, as an unorganized cloud.
+  void toPC(const CompactCloud &in, PC &out);
+};
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Counts how often segmentation scratch storage (arenas, object pools and
+ * voxel grids) had to grow. Once the pipeline reaches a steady state this
+ * should stop increasing.
+ *
+ * Only that growth is counted. Allocations made by PCL, by ROS message
+ * buffers or by other containers in the stages are not, so a steady count
+ * doesn't mean the pipeline has stopped allocating.
+ */
+namespace ScratchGrowth {
+  /// Record that one piece of scratch storage grew.
+  void count();
+
+  /// Total growth recorded so far, from all threads.
+  uint64_t total();
+};
+
+/**
+ * A bump allocator for scratch memory that only lives as long as one frame.
+ *
+ * allocate() hands out consecutive pieces of a large block, and reset()
+ * releases all of them at once when the frame is done. If a frame needs
+ * more than one block, the blocks are merged into one big enough for the
+ * whole frame at the next reset, so after the first few frames there are no
+ * heap allocations at all.
+ *
+ * Not thread-safe; use one arena per frame in flight.
+ */
+class FrameArena {
+public:
+  /// @param blockSize initial size of the arena in bytes
+  explicit FrameArena(size_t blockSize = 1 << 20);
+  ~FrameArena();
+
+  /**
+   * Get uninitialized memory that stays valid until the next reset().
+   * @param bytes     the size of the memory
+   * @param alignment must be a power of two, no larger than 16
+   */
+  void* allocate(size_t bytes, size_t alignment = 16);
+
+  /// Get uninitialized memory for count objects of type T.
+  template <typename T>
+  T* allocate(size_t count) {
+    return static_cast<T*>(allocate(count * sizeof(T)));
+  }
+
+  /// Release everything allocated since the last reset.
+  void reset();
+
+  /// Bytes handed out since the last reset.
+  size_t used() const { return bytesUsed; }
+
+private:
+  /// Start a new block that can hold at least the given number of bytes.
+  void addBlock(size_t minBytes);
+
+  std::vector<char*> blocks;
+  std::vector<size_t> blockSizes;
+  /// offset of the next free byte in the last block
+  size_t offset;
+  size_t bytesUsed;
+
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+};
+
+/**
+ * An STL allocator that takes its memory from a FrameArena, for scratch
+ * containers like std::vector<int, ArenaAllocator<int> >. Deallocation is a
+ * no-op: the memory comes back when the arena is reset, so containers using
+ * it must not outlive the frame.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T* allocate(size_t n) { return arena->allocate<T>(n); }
+  void deallocate(T*, size_t) {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena != other.arena;
+  }
+
+  FrameArena *arena;
+};
+
+#endif
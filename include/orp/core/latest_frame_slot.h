@@ -0,0 +1,165 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _LATEST_FRAME_SLOT_H_
+#define _LATEST_FRAME_SLOT_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <ros/ros.h>
+
+#include <orp/FrameStats.h>
+
+/**
+ * Holds at most one frame waiting to be processed.
+ *
+ * A subscriber callback puts each incoming frame here and returns right
+ * away, and a processing thread takes the newest frame whenever it's ready
+ * for another one. A frame that is still waiting when a newer one arrives is
+ * dropped and counted, so under overload the processing thread always works
+ * on the freshest data rather than on a backlog of old frames.
+ *
+ * T should be cheap to copy, like a message ConstPtr.
+ */
+template <typename T>
+class LatestFrameSlot {
+public:
+  LatestFrameSlot() :
+    hasFrame(false), closed(false), received(0), processed(0), dropped(0)
+  {
+  }
+
+  /**
+   * Store a frame, replacing the waiting one if there is one. Frames put
+   * while the slot is closed are ignored.
+   * @return false if a waiting frame was dropped to make room.
+   */
+  bool put(const T &newFrame) {
+    bool replaced;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(closed) {
+        return true;
+      }
+      replaced = hasFrame;
+      frame = newFrame;
+      hasFrame = true;
+      ++received;
+      if(replaced) {
+        ++dropped;
+      }
+    }
+    frameAvailable.notify_one();
+    return !replaced;
+  }
+
+  /**
+   * Wait for a frame and take it out of the slot.
+   * @return false if the slot was closed while waiting.
+   */
+  bool take(T &out) {
+    std::unique_lock<std::mutex> lock(mutex);
+    frameAvailable.wait(lock, [this]{ return closed || hasFrame; });
+    if(closed) {
+      return false;
+    }
+    out = frame;
+    frame = T();
+    hasFrame = false;
+    return true;
+  }
+
+  /**
+   * Take the waiting frame out of the slot, if there is one, without
+   * waiting for it.
+   * @return false if no frame is waiting or the slot is closed.
+   */
+  bool tryTake(T &out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(closed || !hasFrame) {
+      return false;
+    }
+    out = frame;
+    frame = T();
+    hasFrame = false;
+    return true;
+  }
+
+  /// Wake up any waiting take() calls and make them (and later ones) fail.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      frame = T();
+      hasFrame = false;
+    }
+    frameAvailable.notify_all();
+  }
+
+  /// Allow take() to succeed again after close().
+  void reopen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = false;
+  }
+
+  /**
+   * Record that processing of a frame has started.
+   * @param  stamp the time the frame was captured
+   * @return       the statistics, including this frame
+   */
+  orp::FrameStats markProcessed(const ros::Time &stamp) {
+    orp::FrameStats stats;
+    stats.header.stamp = ros::Time::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    ++processed;
+    stats.received = received;
+    stats.processed = processed;
+    stats.dropped = dropped;
+    stats.age = (stats.header.stamp - stamp).toSec();
+    return stats;
+  }
+
+private:
+  T frame;
+  bool hasFrame;
+  bool closed;
+
+  uint64_t received;
+  uint64_t processed;
+  uint64_t dropped;
+
+  std::mutex mutex;
+  std::condition_variable frameAvailable;
+};
+
+#endif
@@ -0,0 +1,241 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _MORTON_H_
+#define _MORTON_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "orp/core/orp_utils.h"
+
+/**
+ * Morton (Z-order) keys for voxel coordinates.
+ *
+ * Interleaving the bits of the x, y and z voxel coordinates gives a key that
+ * keeps voxels which are close in space close together in the key order, so
+ * a cloud sorted by Morton key has much better memory locality for neighbor
+ * searches than one in sensor order. Every aligned cube of 2^k voxels on a
+ * side is one contiguous range of keys.
+ */
+namespace Morton {
+  /// Bits used for each axis. Voxel coordinates must be in [0, 2^21).
+  const int kAxisBits = 21;
+
+  /// The bits of a key that hold the x coordinate. Shifted left by one or
+  /// two, the bits of y or z.
+  const uint64_t kAxisMask = 0x1249249249249249ULL;
+
+  /// Spread the low 21 bits of v out so that there are two zero bits between
+  /// each of them.
+  inline uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffffULL;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+  }
+
+  /// Inverse of spreadBits.
+  inline uint64_t compactBits(uint64_t v) {
+    v &= 0x1249249249249249ULL;
+    v = (v | v >> 2)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v >> 4)  & 0x100f00f00f00f00fULL;
+    v = (v | v >> 8)  & 0x1f0000ff0000ffULL;
+    v = (v | v >> 16) & 0x1f00000000ffffULL;
+    v = (v | v >> 32) & 0x1fffffULL;
+    return v;
+  }
+
+  /// Interleave three voxel coordinates into one key.
+  inline uint64_t encode(uint32_t x, uint32_t y, uint32_t z) {
+    return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+  }
+
+  /// Recover the voxel coordinates from a key.
+  inline void decode(uint64_t key, uint32_t &x, uint32_t &y, uint32_t &z) {
+    x = compactBits(key);
+    y = compactBits(key >> 1);
+    z = compactBits(key >> 2);
+  }
+
+  /**
+   * Check whether a key lies in the box of voxels spanned by two corners.
+   * Masking out the other axes keeps the order of each coordinate, so the
+   * axes can be compared without decoding.
+   * @param  key    the key to check
+   * @param  minKey the key of the corner with the smallest coordinates
+   * @param  maxKey the key of the corner with the largest coordinates
+   * @return        true if every coordinate of key is within the box
+   */
+  inline bool inBox(uint64_t key, uint64_t minKey, uint64_t maxKey) {
+    for(int axis = 0; axis < 3; ++axis) {
+      uint64_t mask = kAxisMask << axis;
+      uint64_t value = key & mask;
+      if(value < (minKey & mask) || value > (maxKey & mask)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Find the smallest key in a box that is not smaller than the given key
+   * (the BIGMIN of Tropf and Herzog). A box spans several runs of keys, and
+   * this is the start of the next run, so a search over sorted keys can
+   * jump straight to it.
+   * @param  key    where to start looking
+   * @param  minKey the key of the corner with the smallest coordinates
+   * @param  maxKey the key of the corner with the largest coordinates
+   * @param  next   set to the key that was found
+   * @return        false if no key in the box is >= key
+   */
+  inline bool nextInBox(uint64_t key, uint64_t minKey, uint64_t maxKey,
+    uint64_t &next)
+  {
+    if(inBox(key, minKey, maxKey)) {
+      next = key;
+      return true;
+    }
+    bool found = false;
+    for(int bit = 3 * kAxisBits - 1; bit >= 0; --bit) {
+      uint64_t mask = 1ULL << bit;
+      // the lower bits of the same axis
+      uint64_t below = (kAxisMask << (bit % 3)) & (mask - 1);
+      bool keyBit = key & mask;
+      bool minBit = minKey & mask;
+      bool maxBit = maxKey & mask;
+      if(!keyBit && !minBit && maxBit) {
+        // the upper half of the box is a candidate; keep looking in the
+        // lower half
+        next = (minKey & ~(mask | below)) | mask;
+        found = true;
+        maxKey = (maxKey & ~(mask | below)) | below;
+      }
+      else if(!keyBit && minBit && maxBit) {
+        next = minKey;
+        return true;
+      }
+      else if(keyBit && !minBit && !maxBit) {
+        return found;
+      }
+      else if(keyBit && !minBit && maxBit) {
+        minKey = (minKey & ~(mask | below)) | mask;
+      }
+    }
+    return found;
+  }
+
+  /**
+   * Get the corners of the cube of voxels within a number of voxels of the
+   * voxel of a key, clipped to the range of the keys.
+   * @param key    the center of the cube
+   * @param radius how many voxels the cube reaches out from its center
+   * @param minKey set to the key of the corner with the smallest coordinates
+   * @param maxKey set to the key of the corner with the largest coordinates
+   */
+  inline void cubeAround(uint64_t key, uint32_t radius, uint64_t &minKey,
+    uint64_t &maxKey)
+  {
+    const uint32_t top = (1u << kAxisBits) - 1;
+    uint32_t center[3];
+    decode(key, center[0], center[1], center[2]);
+    uint32_t low[3], high[3];
+    for(int axis = 0; axis < 3; ++axis) {
+      low[axis] = center[axis] > radius ? center[axis] - radius : 0;
+      high[axis] = top - center[axis] > radius ? center[axis] + radius : top;
+    }
+    minKey = encode(low[0], low[1], low[2]);
+    maxKey = encode(high[0], high[1], high[2]);
+  }
+
+  /**
+   * Call a function for every key in a box, out of a sorted list of keys.
+   * Only the runs of keys that overlap the box are looked at.
+   * @param keys   keys sorted in ascending order
+   * @param minKey the key of the corner with the smallest coordinates
+   * @param maxKey the key of the corner with the largest coordinates
+   * @param fn     called with the index of each key in the box
+   */
+  template <typename Function>
+  void forEachInBox(const std::vector<uint64_t> &keys, uint64_t minKey,
+    uint64_t maxKey, Function fn)
+  {
+    std::vector<uint64_t>::const_iterator it =
+      std::lower_bound(keys.begin(), keys.end(), minKey);
+    while(it != keys.end() && *it <= maxKey) {
+      if(inBox(*it, minKey, maxKey)) {
+        fn(static_cast<size_t>(it - keys.begin()));
+        ++it;
+        continue;
+      }
+      uint64_t next;
+      if(!nextInBox(*it, minKey, maxKey, next)) {
+        break;
+      }
+      it = std::lower_bound(it, keys.end(), next);
+    }
+  }
+
+  /**
+   * Sort a cloud by the given per-point keys, and sort the keys to match.
+   * @param cloud the cloud to reorder
+   * @param keys  one key per point in cloud
+   */
+  template <typename PointT>
+  void sortCloud(pcl::PointCloud<PointT> &cloud,
+    std::vector<uint64_t> &keys)
+  {
+    std::vector<std::pair<uint64_t, int> > order(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+      order[i] = std::make_pair(keys[i], static_cast<int>(i));
+    }
+    std::sort(order.begin(), order.end());
+
+    pcl::PointCloud<PointT> sorted;
+    sorted.points.resize(order.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+      sorted.points[i] = cloud.points[order[i].second];
+      keys[i] = order[i].first;
+    }
+    sorted.width = sorted.points.size();
+    sorted.height = 1;
+    sorted.is_dense = cloud.is_dense;
+    sorted.header = cloud.header;
+    cloud.swap(sorted);
+  }
+};
+
+#endif
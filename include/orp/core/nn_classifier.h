@@ -48,7 +48,7 @@
 #include <orp/Segmentation.h>
 #include <orp/ClassificationResult.h>
 
-#include "orp/core/classifier3d.h"
+#include "orp/core/classifier_plugin.h"
 #include "orp/core/world_object.h"
 #include "orp/core/orp_utils.h"
 
@@ -93,14 +93,14 @@ struct KnownPose {
   /// centroid of point cloud
   Eigen::Vector4f centroid;
   /// raw point cloud
-  pcl::PointCloud<ORPPoint>::Ptr cloud;
+  pcl::PointCloud<GeometryPoint>::Ptr cloud;
 
   /**
    * TODO(Kukanani): structs don't usually have constructors, do they? Maybe
    * make this a class.
    */
   KnownPose() :
-    cloud(new pcl::PointCloud<ORPPoint>),
+    cloud(new pcl::PointCloud<GeometryPoint>),
     crh(new pcl::PointCloud<CRH90>) {};
 };
 
@@ -120,7 +120,7 @@ typedef std::vector<FeatureVector, Eigen::aligned_allocator<FeatureVector> >
  * to compare against feature vectors that have been previously saved
  * in a file, with a different feature vector for each object pose.
  */
-class NNClassifier : public Classifier3D {
+class NNClassifier : public ClassifierPlugin {
 protected:
   /// All known objects that can be detected.
   std::vector<std::string> fullTypeList;
@@ -133,10 +133,6 @@ protected:
 
   /// The indexed data for knn search.
   flann::Index<flann::ChiSquareDistance<float> >* kIndex;
-  /// The indices for the knn search.
-  flann::Matrix<int> kIndices;
-  /// The resulting distances for the knn search.
-  flann::Matrix<float> kDistances;
   /// The data for the knn search.
   flann::Matrix<float>* kData;
 
@@ -153,8 +149,10 @@ protected:
    * @param index the tree
    * @param model the query model
    * @param k the number of neighbors to search for
-   * @param indices the resultant neighbor indices
-   * @param distances the resultant neighbor distances
+   * @param indices the resultant neighbor indices. Allocated here; the
+   *                caller delete[]s indices.ptr().
+   * @param distances the resultant neighbor distances, allocated the same
+   *                  way
    *
    * @return number of matches found
    */
@@ -187,25 +185,19 @@ protected:
   /**
    * Load the list of objects and their properties from the parameter server. Blocks until the correct parameters become available.
    */
-  virtual void loadTypeList();
+  virtual void loadTypeList(ros::NodeHandle& node);
 
 public:
-  /**
-   * Constructor. Don't forget to call init() afterwards.
-   */
   NNClassifier();
   virtual ~NNClassifier();
 
   /**
-   * Actually set things up.
+   * Actually set things up: read the parameters and load the models.
    */
-  virtual void init();
+  virtual void initialize(ros::NodeHandle& node,
+    ros::NodeHandle& node_private);
 
-  /**
-   * Takes the incoming point cloud and stores it.
-   * @param cloud the incoming cloud supplied from the topic publisher
-   */
-  virtual void cb_classify(const sensor_msgs::PointCloud2& cloud) = 0;
+  bool needsPoints() const { return true; }
 };
 
 #endif
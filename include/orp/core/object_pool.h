@@ -0,0 +1,118 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _OBJECT_POOL_H_
+#define _OBJECT_POOL_H_
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "orp/core/frame_arena.h"
+
+/**
+ * Recycles heap objects (point clouds, index lists, ...) so that their
+ * storage can be reused from frame to frame.
+ *
+ * acquire() returns a shared pointer that gives the object back to the pool
+ * when the last copy of it goes away, instead of deleting it. Objects are
+ * cleared with the reset function before they are handed out again, but
+ * their containers keep their capacity. The pointers are the same type PCL
+ * uses for its Ptr typedefs, so pooled objects can be passed straight to PCL
+ * algorithms.
+ *
+ * Thread-safe. The pointers can safely outlive the pool.
+ */
+template <typename T>
+class ObjectPool {
+public:
+  typedef boost::shared_ptr<T> Ptr;
+
+  /// @param reset called on each object before it's reused
+  explicit ObjectPool(const std::function<void(T&)> &reset) :
+    state(new State())
+  {
+    state->reset = reset;
+  }
+
+  /// Get an object, either a recycled one or (if none are free) a new one.
+  Ptr acquire() {
+    T *object = NULL;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if(!state->free.empty()) {
+        object = state->free.back();
+        state->free.pop_back();
+      }
+    }
+    if(object) {
+      state->reset(*object);
+    }
+    else {
+      object = new T();
+      ScratchGrowth::count();
+    }
+    return Ptr(object, Recycler(state));
+  }
+
+private:
+  struct State {
+    std::function<void(T&)> reset;
+    std::vector<T*> free;
+    std::mutex mutex;
+
+    ~State() {
+      for(size_t i = 0; i < free.size(); ++i) {
+        delete free[i];
+      }
+    }
+  };
+
+  /// Deleter that returns objects to the pool.
+  struct Recycler {
+    explicit Recycler(const boost::shared_ptr<State> &state) : state(state) {}
+
+    void operator()(T *object) const {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->free.push_back(object);
+    }
+
+    boost::shared_ptr<State> state;
+  };
+
+  boost::shared_ptr<State> state;
+
+  ObjectPool(const ObjectPool&);
+  ObjectPool& operator=(const ObjectPool&);
+};
+
+#endif
@@ -32,6 +32,7 @@
 #define _ORP_UTILS_H_
 
 #define _USE_MATH_DEFINES
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <stdexcept>
@@ -43,12 +44,20 @@
 #include <interactive_markers/interactive_marker_server.h>
 #include <interactive_markers/menu_handler.h>
 
-/// ORP can be switched from RGBD mode to depth-only mode by removing the
-/// XYZ in this typedef.
-/// TODO(Kukanani): add a way to change this, maybe with a compile flag
-/// or CMake arg?
+/// The default ORP point type. Segmentation is templated on its point type
+/// (see point_traits.h) and can run depth-only with pcl::PointXYZ instead.
 typedef pcl::PointXYZRGB ORPPoint;
 
+/// The point type for work that only needs positions, like normal and shape
+/// descriptor estimation. Reading a colored cloud into it drops the color.
+///
+/// The geometric classifiers use it instead of being templated on a point
+/// type. Clusters reach them as messages, so the segmentation point type
+/// isn't known at compile time, and Classifier3D decodes each cluster once
+/// for all of its plugins. Normals are estimated from the positions by the
+/// classifiers themselves, since segmentation doesn't compute any.
+typedef pcl::PointXYZ GeometryPoint;
+
 /// An ORP point cloud
 typedef pcl::PointCloud<ORPPoint> PC;
 
@@ -83,6 +92,38 @@ namespace ORPUtils {
     return rad * 180.0 / M_PI;
   }
 
+  /**
+   * Convert an RGB color (0-255 per channel) to HSV, with hue in degrees
+   * (0-360) and saturation and value in the range 0-1.
+   */
+  static void hsvFromRgb(float r, float g, float b,
+    float &h, float &s, float &v)
+  {
+    float max = std::max(r, std::max(g, b));
+    float min = std::min(r, std::min(g, b));
+    float chroma = max - min;
+
+    v = max / 255.0f;
+    s = max > 0 ? chroma / max : 0.0f;
+
+    if(chroma <= 0) {
+      h = 0;
+      return;
+    }
+    if(max == r) {
+      h = 60.0f * (g - b) / chroma;
+    }
+    else if(max == g) {
+      h = 60.0f * (b - r) / chroma + 120.0f;
+    }
+    else {
+      h = 60.0f * (r - g) / chroma + 240.0f;
+    }
+    if(h < 0) {
+      h += 360.0f;
+    }
+  }
+
   /// Load a point cloud from the input file. Currently, PCD files only.
   static pcl::PointCloud<ORPPoint>::Ptr loadCloudFrom(std::string path) {
     pcl::PointCloud<ORPPoint>::Ptr cloud_out (new pcl::PointCloud<ORPPoint>);
@@ -0,0 +1,85 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _POINT_TRAITS_H_
+#define _POINT_TRAITS_H_
+
+#include <stdint.h>
+
+#include <pcl/point_types.h>
+
+/**
+ * What ORP needs to know about each point type it can be instantiated with.
+ *
+ * Code that is templated on the point type uses these to read and write
+ * color, so the same code compiles (and skips the color work entirely) for
+ * geometry-only points.
+ */
+template <typename PointT>
+struct PointTraits;
+
+/// Traits shared by the point types that carry an rgb field.
+template <typename PointT>
+struct ColorPointTraits {
+  static const bool kHasColor = true;
+
+  static void setColor(PointT &point, uint8_t r, uint8_t g, uint8_t b) {
+    point.r = r;
+    point.g = g;
+    point.b = b;
+    point.a = 255;
+  }
+
+  /// Color packed as 0xAARRGGBB.
+  static uint32_t rgba(const PointT &point) { return point.rgba; }
+};
+
+template <>
+struct PointTraits<pcl::PointXYZ> {
+  static const bool kHasColor = false;
+
+  static void setColor(pcl::PointXYZ&, uint8_t, uint8_t, uint8_t) {}
+
+  static uint32_t rgba(const pcl::PointXYZ&) { return 0; }
+};
+
+template <>
+struct PointTraits<pcl::PointXYZRGB> :
+  public ColorPointTraits<pcl::PointXYZRGB> {};
+
+/**
+ * Explicitly instantiate a template for every point type ORP supports.
+ * INSTANTIATE is a macro taking one point type.
+ */
+#define ORP_INSTANTIATE_POINT_TYPES(INSTANTIATE) \
+  INSTANTIATE(pcl::PointXYZ) \
+  INSTANTIATE(pcl::PointXYZRGB)
+
+#endif
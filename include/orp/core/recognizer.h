@@ -31,13 +31,17 @@
 #ifndef _RECOGNIZER_H_
 #define _RECOGNIZER_H_
 
+#include <atomic>
 #include <ctime>
 #include <fstream>
+#include <map>
 #include <string>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <dynamic_reconfigure/server.h>
 #include <std_msgs/Empty.h>
 #include <tf/transform_broadcaster.h>
@@ -49,6 +53,7 @@
 #include "orp/GetObjectPose.h"
 #include "orp/WorldObjects.h"
 #include "orp/ClassificationResult.h"
+#include "orp/GetCluster.h"
 #include "orp/GetObjects.h"
 
 #include "orp/core/world_object.h"
@@ -66,6 +71,14 @@ class Recognizer {
 private:
   /// Standard ROS node handle
   ros::NodeHandle n;
+  /// Classification results and the recognition timer are handled here
+  /// rather than on the global queue, so that services and start/stop
+  /// requests don't wait behind them.
+  ros::CallbackQueue dataQueue;
+  /// Node handle whose callbacks go on dataQueue
+  ros::NodeHandle dataNode;
+  /// Runs the dataQueue callbacks on a thread of their own
+  ros::AsyncSpinner dataSpinner;
   /// Enables usage of dynamic_reconfigure.
   dynamic_reconfigure::Server<orp::RecognizerConfig> reconfigureServer;
   /// Used for dynamic reconfigure internals
@@ -80,7 +93,9 @@ private:
   std::string recognitionFrame;
   /// A list of currently-accepted objects in the world.
   WorldObjectList model;
-  /// Prevents simultaneous modification to world object model.
+  /// Prevents simultaneous modification to world object model (and the
+  /// markers and settings used with it), which is shared between the data
+  /// thread and the service callbacks.
   std::mutex modelMutex;
   /// Manages the list of world object types.
   WorldObjectManager typeManager;
@@ -91,7 +106,7 @@ private:
   /// Where to look for classification messages to be published
   std::string classificationTopic;
   /// If true, udpate our model of the world (and remove old objects). Used
-  /// for lazy updates
+  /// for lazy updates. Guarded by modelMutex.
   bool dirty = false;
   /// if true, begin the recognition loop automatically (auto-subscribe to
   /// classification)
@@ -100,6 +115,27 @@ private:
   /// if true, publish old ORP messages instead of vision_msgs
   bool legacy = false;
 
+  /// if true, the classifiers only run when an object or pose query needs
+  /// newer results than the model has (see refreshObjects())
+  bool lazy = false;
+  /// In lazy mode, how old the last classification may be before a query
+  /// starts the classifiers again
+  ros::Duration freshness;
+  /// In lazy mode, the number of classification messages a query waits for
+  /// from each classification method
+  int burstSize;
+  /// In lazy mode, the classification methods a query waits for. If empty,
+  /// it waits for the ones that have reported before, or for the first one
+  /// to report if none has.
+  std::vector<std::string> lazyMethods;
+  /// In lazy mode, the longest a query waits for them
+  ros::Duration queryTimeout;
+  /// Lets one query at a time start the classifiers. Queries that arrive
+  /// meanwhile are answered from the same results.
+  std::mutex queryMutex;
+  /// When the last classification message arrived. Guarded by modelMutex.
+  ros::Time lastClassification;
+
 // ROS
 
   /// Publishes vision_msgs meta information
@@ -109,6 +145,11 @@ private:
 
   /// Listens for new recognized objects and adds them to the model.
   ros::Subscriber recognitionSub;
+  /// Whether recognitionSub is (being) set up. Guarded by modelMutex.
+  bool recognitionStarted = false;
+  /// Serializes startRecognition() and stopRecognition(), which set up and
+  /// shut down recognitionSub outside of modelMutex.
+  std::mutex recognitionMutex;
   /// Publishes a MarkerArray with information about detected objects
   ros::Publisher objectPub;
   /// Publishes a WorldObjects message that contains all the recognized
@@ -116,6 +157,8 @@ private:
   ros::Publisher markerPub;
   /// The stored list of markers to publish.
   visualization_msgs::MarkerArray markerMsg;
+  /// Used to self-start recognition
+  ros::Publisher startPub;
   /// Used to self-stop recognition
   ros::Publisher stopPub;
   /// listen for necessary transformations before publishing
@@ -162,7 +205,10 @@ private:
   /// Used to ensure that at least one detection has been processed when
   /// calling service to get objects. This way we can tell the difference
   /// between "no objects in scene" and "no classification results received"
-  int classification_count;
+  std::atomic<int> classification_count;
+  /// The number of classification messages processed (including empty
+  /// ones) from each classification method. Guarded by modelMutex.
+  std::map<std::string, int> methodFrames;
   /// Used to set the header.seq values in the messages published to
   /// /detected_objects.
   int object_sequence;
@@ -217,6 +263,26 @@ private:
    */
   void update();
 
+  /**
+   * Lazy mode: make sure the model is fresh enough to answer a query.
+   *
+   * If the last classification is older than the freshness bound, start the
+   * classifiers, wait (at most queryTimeout) for burstSize classification
+   * messages from each expected method, stop them again and update and
+   * publish the model. Otherwise, do nothing.
+   */
+  void refreshObjects();
+
+  /**
+   * Whether a lazy query has heard enough from the classifiers.
+   * @param  origFrames methodFrames when the query started the classifiers
+   * @param  methods    the methods to wait for. If empty, any one will do.
+   * @param  missing    filled with the methods still awaited, if any
+   * @return            true if each method sent burstSize messages since
+   */
+  bool burstComplete(const std::map<std::string, int> &origFrames,
+    const std::vector<std::string> &methods, std::string &missing);
+
   /**
    * Removes any objects that are older than the "stale time" (i.e., haven't
    * been detected for a while)
@@ -283,7 +349,11 @@ private:
    * If recognition is stopped when this is called, it will start it, and stop
    * it again once the call is complete. It will wait for at least one
    * classification result to be processed and then will return the current
-   * internal object state.
+   * internal object state. In lazy mode, it calls refreshObjects() instead.
+   *
+   * Objects are classified without their points by default. If
+   * req.include_clouds is set, the points are fetched from the classifiers
+   * that still have them (see ClusterReference).
    */
   bool cb_getObjects(orp::GetObjects::Request &req,
     orp::GetObjects::Response &response);
@@ -294,10 +364,17 @@ private:
    */
   void cb_processNewClassification(orp::ClassificationResult newObject);
 
+  /**
+   * Merge the objects in a classification result into the model.
+   * @param objects the result to merge
+   */
+  void mergeClassification(const orp::ClassificationResult& objects);
+
   /**
    * ROS service call handler. Searches the known world model for objects that
    * match the given request, and then provides a list of poses for objects
-   * that meet the given criteria.
+   * that meet the given criteria. In lazy mode, it calls refreshObjects()
+   * first.
    * @param  req      the request providing the object to search for
    * @param  response the response to fill with the poses found.
    * @return          true
@@ -313,6 +390,9 @@ public:
    */
   Recognizer();
 
+  /// Stops the data spinner.
+  ~Recognizer();
+
   /// Dynamic Reconfigure callback.
   void paramsChanged(orp::RecognizerConfig &config, uint32_t level);
 };
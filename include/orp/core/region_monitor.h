@@ -34,6 +34,8 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+#include <mutex>
+
 // TODO(Kukanani): clean up these includes and the whole header section.
 #include <pcl/ModelCoefficients.h>
 #include <pcl/point_types.h>
@@ -59,6 +61,8 @@
 #include <orp/Monitor.h>
 #include <orp/Region.h>
 
+#include "orp/core/cloud_message_pool.h"
+#include "orp/core/compact_point.h"
 #include "orp/core/orp_utils.h"
 
 /**
@@ -86,6 +90,8 @@ private:
 
   /// Publishes clipped cloud for visualization
   ros::Publisher boundedScenePublisher;
+  /// Recycled messages for boundedScenePublisher
+  CloudMessagePool messagePool;
 
   /// Listens for point clouds
   ros::Subscriber pointCloudSub;
@@ -105,27 +111,28 @@ private:
   float minZ; // near clipping in world space
   float maxZ; // far clipping in world space
 
-  ///input is stored here
-  PCPtr inputCloud;
-  ///used as intermediate step for cloud processing
-  PCPtr processCloud;
+  ///input is stored here, untransformed
+  sensor_msgs::PointCloud2 inputCloud;
+  ///transforms inputCloud into transformToFrame
+  Eigen::Affine3f inputTransform;
+  ///protects inputCloud and inputTransform
+  std::mutex inputMutex;
+  ///the points of inputCloud inside the region
+  CompactCloud processCloud;
 
 ///////////////////////////////////////////////////////////////////////////////
 // FILTERING STEPS (FUNCTIONS)
 ///////////////////////////////////////////////////////////////////////////////
 
   /**
-   * Spatially filter a point cloud
-   * @param  unclipped the point cloud to be filtered
-   * @param  minX      min bound to process
-   * @param  maxX      max bound to process
-   * @param  minY      min bound to process
-   * @param  maxY      max bound to process
-   * @param  minZ      min bound to process
-   * @param  maxZ      max bound to process
-   * @return           the filtered point cloud
+   * Transform the input cloud and keep the points inside the monitored
+   * region.
+   * @param  clipped  filled with the points inside the region
+   * @param  hasColor set to whether the input has color (depth-only
+   *                  sensors don't)
+   * @return          the header for the clipped cloud
    */
-  PCPtr& clipByDistance(PCPtr &unclipped);
+  std_msgs::Header clipByDistance(CompactCloud &clipped, bool &hasColor);
 
 public:
   /// Basic constructor
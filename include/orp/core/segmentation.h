@@ -38,15 +38,43 @@
 // see which can be moved to the .cpp file instead of slowing down the compile
 // here in the .h
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <ros/ros.h>
+#include <std_msgs/Header.h>
 
 #include <dynamic_reconfigure/server.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
 #include <tf/transform_listener.h>
 
+#include <orp/AttentionRegion.h>
+#include <orp/FrameStats.h>
+#include <orp/PipelineStats.h>
 #include <orp/Segmentation.h>
+#include <orp/SegmentationRequest.h>
+#include <orp/SegmentationResult.h>
 #include <orp/SegmentationConfig.h>
 
+#include "orp/core/attention.h"
+#include "orp/core/cloud_message_pool.h"
+#include "orp/core/cluster_codec.h"
+#include "orp/core/compact_point.h"
+#include "orp/core/frame_arena.h"
+#include "orp/core/latest_frame_slot.h"
+#include "orp/core/object_pool.h"
 #include "orp/core/orp_utils.h"
+#include "orp/core/point_traits.h"
+#include "orp/core/spsc_ring.h"
+#include "orp/core/voxel_hash.h"
+#include "orp/core/worker_pool.h"
 
 /**
  * @brief Performs point cloud segmentation to clarify noisy data for object
@@ -61,21 +89,35 @@
  * will result in improved performance, because it's very expensive to pass
  * point clouds from node to node.
  *
+ * The class is templated on the point type used after voxelization, and
+ * explicitly instantiated for the types in point_traits.h. The node picks
+ * one with the ~point_type parameter: "xyz" for depth-only sensors, which
+ * halves the size of every intermediate cloud and skips all color work, or
+ * "xyzrgb" (the default). Segmentation never estimates normals, so a type
+ * with normal fields would only carry zeros through every stage.
+ *
  * @version 2.0
  * @ingroup objectrecognition
  *
  * @author  Brian O'Neil <brian.oneil@lanl.gov>
  * @author  Adam Allevato <adam.d.allevato@gmail.com>
  */
+template <typename PointT>
 class Segmentation {
 private:
+  /// A cloud of the point type being segmented
+  typedef pcl::PointCloud<PointT> Cloud;
+  /// A smart pointer to a Cloud
+  typedef typename Cloud::Ptr CloudPtr;
+
 ///////////////////////////////////////////////////////////////////////////////
 // DYNAMIC RECONFIGURE
 ///////////////////////////////////////////////////////////////////////////////
   /**
    * Enables usage of dynamic_reconfigure for reognition algorithm parameters.
+   * Null when running offline.
    */
-  dynamic_reconfigure::Server<orp::SegmentationConfig>
+  boost::shared_ptr<dynamic_reconfigure::Server<orp::SegmentationConfig> >
     reconfigureServer;
   /**
    * Required for using dynamic_reconfigure.
@@ -93,14 +135,25 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 // CLASS VARS
 ///////////////////////////////////////////////////////////////////////////////
-  /// Standard ROS node handle
-  ros::NodeHandle node;
   /// Because of the time taken to process segmentations, use a multithreaded
   /// spinner.
   ros::AsyncSpinner spinner;
 
   /// Accepts the segmentation requests
   ros::ServiceServer segmentationServer;
+  /// Accepts asynchronous segmentation requests
+  ros::Subscriber requestSubscriber;
+  /// The results topic of one asynchronous client
+  struct ResultChannel {
+    ros::Publisher publisher;
+    /// results finished before the client connected, sent once it does
+    std::deque<orp::SegmentationResultConstPtr> waiting;
+  };
+  /// Answers asynchronous segmentation requests, with one topic per client
+  /// so that no client receives the others' clusters
+  std::map<std::string, ResultChannel> resultChannels;
+  /// Protects resultChannels
+  std::mutex resultChannelsMutex;
 
   /// Publishes planes cut from the scene
   ros::Publisher allPlanesPublisher;
@@ -118,16 +171,159 @@ private:
   /// Publishes the first (largest) cluster in the scene.
   ros::Publisher largestObjectPublisher;
 
-  /// Used to transform into the correct processing/recognition frames
-  tf::TransformListener listener;
+  /// Used to transform into the correct processing/recognition frames. Null
+  /// when running offline.
+  boost::shared_ptr<tf::TransformListener> listener;
 
   /// The frame to transform the recognition results into. This is useful if
   ///   you need to use recognition results for
   ///   motion planning in a specific frame, or pose x/y/z values, etc.
   std::string transformToFrame;
 
-  /// updated after each message received
-  std::string originalCloudFrame;
+
+///////////////////////////////////////////////////////////////////////////////
+// MULTI-CAMERA FUSION
+///////////////////////////////////////////////////////////////////////////////
+  /// Point cloud topics to fuse into one scene. If empty, no fusion is done.
+  std::vector<std::string> cameraTopics;
+  /// One subscriber per entry in cameraTopics, while fusedFramePublisher
+  /// has subscribers
+  std::vector<ros::Subscriber> cameraSubscribers;
+  /// The latest unmatched cloud from each camera (null if there is none)
+  std::vector<sensor_msgs::PointCloud2ConstPtr> pendingClouds;
+  /// The newest synchronized set of camera clouds that no request has fused
+  /// yet. It counts the sets that are replaced before they are fused.
+  LatestFrameSlot<std::vector<sensor_msgs::PointCloud2ConstPtr> > fusionSlot;
+  /// The set most recently taken from fusionSlot. Fused requests are
+  /// segmented from it until a newer set arrives.
+  std::vector<sensor_msgs::PointCloud2ConstPtr> fusedSet;
+  /// Protects pendingClouds, cameraSubscribers and fusedSet
+  std::mutex pendingMutex;
+  /// Clouds whose stamps differ by more than this won't be fused together
+  ros::Duration syncSlop;
+  /// Announces each synchronized set with the stamp of its newest cloud.
+  /// Classifiers with ~fused_scene set make a fused request for each.
+  ros::Publisher fusedFramePublisher;
+  /// Publishes ingestion statistics (one frame is one set of camera clouds)
+  /// each time a new set is fused
+  ros::Publisher fusionStatsPublisher;
+  /// Publishes each fused, voxelized scene, for visualization
+  ros::Publisher fusedScenePublisher;
+
+///////////////////////////////////////////////////////////////////////////////
+// PIPELINE
+///////////////////////////////////////////////////////////////////////////////
+  /// One segmentation request on its way through the stages.
+  struct Frame {
+    const sensor_msgs::PointCloud2 *scene;
+    orp::Segmentation::Response *response;
+    /// the clipped scene, until it is voxelized
+    boost::shared_ptr<CompactCloud> points;
+    /// the clipped scene, instead of points, when quantizePoints and
+    /// pipelined are set
+    boost::shared_ptr<QuantizedCloud> quantized;
+    /// the cloud as it is passed from stage to stage once it is voxelized
+    CloudPtr cloud;
+    /// the Morton key of each point in cloud, once it has been voxelized
+    std::vector<uint64_t> keys;
+    /// number of clipped points before voxelization
+    size_t preVoxel;
+    /// scratch memory for the stages, released when the frame is done
+    boost::shared_ptr<FrameArena> arena;
+    /// when the frame should be done by (zero if there's no deadline)
+    ros::WallTime deadline;
+    /// regions the clusters must overlap, if any (see buildClusters)
+    const std::vector<orp::AttentionRegion> *attention;
+    /// if true, scene is ignored and the latest set of camera clouds is
+    /// segmented instead (see fuseLatest)
+    bool fused;
+    /// false once a stage has decided the frame needs no more processing
+    bool active;
+    /// whether segmentation succeeded
+    bool result;
+    /// set by the last stage when pipelined
+    std::promise<void> done;
+  };
+
+  /// One step of the segmentation.
+  struct PipelineStage {
+    /// name used in the pipeline stats
+    std::string name;
+    /// does the work. Returns false if the remaining stages should be skipped.
+    bool (Segmentation::*run)(Frame &frame);
+    /// frames waiting for this stage (only when pipelined)
+    std::unique_ptr<SpscRing<Frame*> > input;
+    /// guards waiting on input (see pushFrame and popFrame)
+    std::mutex inputMutex;
+    /// signalled when a frame is pushed into or popped from input while
+    /// a thread waits on it, and when stopping is set
+    std::condition_variable inputChanged;
+    /// number of threads waiting for input to have a frame or some room
+    std::atomic<int> waiters;
+    /// runs this stage (only when pipelined)
+    std::thread thread;
+    /// tells the thread to exit once its input is empty
+    std::atomic<bool> stopping;
+    /// how long the stage took on its most recent frame
+    std::atomic<float> seconds;
+  };
+
+  /**
+   * If true, each stage runs on its own thread, and frames are handed from
+   * stage to stage through bounded rings. While one frame is in plane
+   * removal, the next can already be decoding, so throughput is limited by
+   * the slowest stage rather than by the sum of all of them. This only helps
+   * if several segmentation requests are in flight at once, e.g. from
+   * classifiers with ~segmentation_depth above 0.
+   */
+  bool pipelined;
+  /// The stages, in order
+  std::vector<std::unique_ptr<PipelineStage> > stages;
+  /// Serializes spinner threads pushing into the first stage's ring
+  std::mutex pipelineEntryMutex;
+  /// Set when shutting down, so that new requests are refused
+  bool pipelineClosed;
+  /// Publishes the queue depth and latest time of each stage
+  ros::Publisher pipelineStatsPublisher;
+
+  /// Add a stage to the end of the pipeline.
+  void addStage(const std::string &name, bool (Segmentation::*run)(Frame&));
+  /// Run one stage on a frame and time it.
+  void runStage(PipelineStage &stage, Frame &frame);
+  /// Thread body for a pipelined stage
+  void stageLoop(size_t index);
+  /**
+   * Add a frame to a stage's input, blocking while the input is full. The
+   * lock is only taken to wait, or to wake a waiting thread.
+   */
+  void pushFrame(PipelineStage &stage, Frame *frame);
+  /**
+   * Take the next frame from a stage's input, blocking while the input is
+   * empty. Like pushFrame, this doesn't lock unless it has to.
+   * @return false if the stage is stopping and its input is empty
+   */
+  bool popFrame(PipelineStage &stage, Frame *&frame);
+  /// Wake the threads waiting on a stage's input after it changed.
+  void wakeWaiters(PipelineStage &stage);
+  /// Publish the stage stats.
+  void publishPipelineStats();
+
+  /// Transform the scene to the clipping frame and clip it.
+  bool decodeStage(Frame &frame);
+  /// Voxelize the clipped cloud.
+  bool voxelStage(Frame &frame);
+  /// Remove the primary planes.
+  bool planeStage(Frame &frame);
+  /// Find the clusters and fill in the response.
+  bool clusterStage(Frame &frame);
+  /**
+   * How many points of a degraded frame's cloud to skip per point that is
+   * clustered. The cloud is in Morton order, so taking every stride-th
+   * point thins it out evenly. The stride is as large as it can be while
+   * the points on a surface stay within half the cluster tolerance of each
+   * other, so clusters don't fall apart.
+   */
+  size_t degradedStride() const;
 
 ///////////////////////////////////////////////////////////////////////////////
 // SEGMENTATION PARAMS
@@ -156,7 +352,8 @@ private:
   /// Publish a point cloud of the bounded scene after voxelization?
   bool _publishVoxelScene;
 
-  /// Maximum number of object clusters to process
+  /// Maximum number of object clusters to process when a frame misses its
+  /// deadline
   int maxClusters;
   /**
    * The maximum number of iterations to perform when looking for planar
@@ -184,6 +381,12 @@ private:
    * and you will get errors.
    */
   float voxelLeafSize;
+  /**
+   * If larger than voxelLeafSize, planes are searched for in a copy of the
+   * voxelized cloud downsampled to this leaf size, and the planes found
+   * there are then removed from the full-resolution cloud.
+   */
+  float planeLeafSize;
   /**
    * The maximum distance between points in a cluster (used in the Euclidean
    * clustering algorithm).
@@ -202,6 +405,64 @@ private:
    * should be ignored anyway.
    */
   int maxClusterSize;
+  /**
+   * If greater than 0, the clipped scene is split into square tiles of this
+   * size (in x and y), which are voxelized and clustered in parallel. Clusters
+   * that cross tile borders are stitched back together, so the clusters are
+   * the same as without tiling.
+   */
+  float tileSize;
+
+  /**
+   * If greater than 0, the time (in seconds from when a request arrives) by
+   * which each frame should be done. Plane removal stops early once it's
+   * past, and the response is marked degraded. A degraded frame finds its
+   * clusters in a subsample of its points (see degradedStride), fills them
+   * back in from the whole cloud (see gatherClusters), and keeps at most
+   * maxClusters clusters. This bounds the latency of cluttered
+   * scenes, where plane removal can otherwise take many rounds and leave
+   * many points to cluster.
+   */
+  float frameDeadline;
+
+  /**
+   * If true, the clipped scene is held as 16-bit coordinates inside the
+   * clipping box between the decode and voxel stages, which cuts the memory
+   * each queued frame holds by a quarter. The resolution is the box size
+   * divided by 65535 (0.03 mm for a 2 m box), well below any useful voxel
+   * size. Only used when pipelined: otherwise no frame is ever queued, and
+   * the voxel stage runs right after decoding.
+   */
+  bool quantizePoints;
+
+  /**
+   * If greater than 0, clusters are sent compressed (see cluster_codec.h),
+   * with their points snapped to a grid of this spacing, instead of as point
+   * clouds. Useful when the classifiers are on another machine or the
+   * responses are recorded.
+   */
+  float clusterResolution;
+
+  /// Runs the per-tile work in tiled mode
+  WorkerPool workers;
+
+  /// Recycled clouds for the intermediate results of each step, so that in
+  /// steady state the point storage isn't reallocated for every frame
+  ObjectPool<Cloud> cloudPool;
+  /// Recycled compact clouds for the clipped scene
+  ObjectPool<CompactCloud> compactPool;
+  /// Recycled quantized clouds for the clipped scene
+  ObjectPool<QuantizedCloud> quantizedPool;
+  /// Recycled plane inlier lists
+  ObjectPool<pcl::PointIndices> indicesPool;
+  /// Recycled plane coefficients
+  ObjectPool<pcl::ModelCoefficients> coefficientsPool;
+  /// Recycled voxel grids
+  ObjectPool<VoxelHash> gridPool;
+  /// One scratch arena for each frame in flight
+  ObjectPool<FrameArena> arenaPool;
+  /// Recycled messages for the debug clouds
+  CloudMessagePool messagePool;
 
   /// Input is stored here
   // PCPtr inputCloud;
@@ -218,28 +479,44 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 
   /**
-   * Spatially filter a point cloud
-   * @param  unclipped the point cloud to be filtered
-   * @param  minX      min bound to process
-   * @param  maxX      max bound to process
-   * @param  minY      min bound to process
-   * @param  maxY      max bound to process
-   * @param  minZ      min bound to process
-   * @param  maxZ      max bound to process
-   * @return           the filtered point cloud
+   * Look up the transform from a frame into transformToFrame.
+   * @param  frame     the frame to transform from
+   * @param  stamp     the time of the transform
+   * @param  timeout   how long to wait for the transform
+   * @param  transform filled with the transform, or identity if there is no
+   *                   transform to apply
+   * @return           false if the transform wasn't available in time
+   */
+  bool lookupClippingTransform(const std::string &frame,
+      const ros::Time &stamp, const ros::Duration &timeout,
+      Eigen::Affine3f &transform);
+
+  /**
+   * Create a voxel grid based on point cloud data. Like PCL's VoxelGrid, see
+   * http://www.pointclouds.org/documentation/tutorials/voxel_grid.php, but
+   * using a sparse VoxelHash so that small leaf sizes can't overflow the grid
+   * indices. The output is sorted in Morton order, so points that are close
+   * in space are also close in memory.
+   * @param  loose    unstructured (not on a grid) point cloud
+   * @param  gridSize the distance between voxels in the grid
+   * @param  keys     filled with the Morton key of each output point
+   * @return          the points of the voxel grid created from the input
    */
-  PCPtr clipByDistance(PCPtr &unclipped,
-      float minX, float maxX, float minY, float maxY, float minZ, float maxZ);
+  CloudPtr voxelGridify(const CompactCloud &loose, float gridSize,
+      std::vector<uint64_t> &keys);
 
   /**
-   * Create a voxel grid based on point cloud data. See
-   * http://www.pointclouds.org/documentation/tutorials/voxel_grid.php and
-   * http://docs.pointclouds.org/1.7.1/classpcl_1_1_voxel_grid.html.
+   * Same as voxelGridify, but each tile is voxelized on its own worker. Tile
+   * edges are snapped to voxel edges, so the same voxels come out, in the
+   * same (Morton) order.
    * @param  loose    unstructured (not on a grid) point cloud
    * @param  gridSize the distance between voxels in the grid
+   * @param  tileSize approximate width of each tile
+   * @param  keys     filled with the Morton key of each output point
    * @return          the points of the voxel grid created from the input
    */
-  PCPtr voxelGridify(PCPtr &loose, float gridSize);
+  CloudPtr voxelGridifyTiled(const CompactCloud &loose, float gridSize,
+      float tileSize, std::vector<uint64_t> &keys);
 
   /**
    * Segment out planar clouds. See
@@ -254,11 +531,37 @@ private:
    * @param  parentFrame       The frame to use for the message containing all
    *                           plane point clouds (if such a message is to be
    *                           published)
+   * @param  arena             scratch memory for the current frame
+   * @param  keys              if not null, the Morton key of each input
+   *                           point. Keys of removed points are removed too.
+   * @param  deadline          if not zero, no more planes are searched for
+   *                           after this time
+   * @param  cutShort          if not null, set to true if the deadline
+   *                           stopped the search
    * @return                   the point cloud with primary planes removed as
-   *                           specified.
+   *                           specified. Point order is preserved.
+   */
+  CloudPtr removePrimaryPlanes(CloudPtr &input, int maxIterations,
+      float thresholdDistance, float percentageGood, std::string parentFrame,
+      FrameArena &arena, std::vector<uint64_t> *keys = NULL,
+      const ros::WallTime &deadline = ros::WallTime(), bool *cutShort = NULL);
+
+  /**
+   * Like removePrimaryPlanes, but the plane models are fit on a coarser voxel
+   * grid built from the input, which has far fewer points to search. All the
+   * planes are then removed from the input in one pass: any point within
+   * thresholdDistance of one of them is taken out.
+   * @param  input             the point cloud from which to remove planes
+   * @param  coarseLeafSize    the leaf size of the grid to fit planes on
+   * @see removePrimaryPlanes for the other parameters
+   * @return                   the point cloud with primary planes removed.
+   *                           Point order is preserved.
    */
-  PCPtr removePrimaryPlanes(PCPtr &input, int maxIterations,
-      float thresholdDistance, float percentageGood, std::string parentFrame);
+  CloudPtr removePrimaryPlanesCoarse(CloudPtr &input, float coarseLeafSize,
+      int maxIterations, float thresholdDistance, float percentageGood,
+      std::string parentFrame, FrameArena &arena,
+      std::vector<uint64_t> *keys = NULL,
+      const ros::WallTime &deadline = ros::WallTime(), bool *cutShort = NULL);
 
   /**
    * Euclidean clustering algorithm. See
@@ -269,24 +572,166 @@ private:
    * @param minClusterSize   clusters of size less than this will be discarded
    * @param maxClusterSize   clusters of size greater than this will be
    *                         discarded
-   * @return                 a vector of point clouds, each representing a
-   *                         cluster from the clustering algorithm.
+   * @param clusterIndices   filled with the points in each cluster, in the
+   *                         order of the cloud. Pass it to buildClusters to
+   *                         get the response.
+   */
+  void cluster(CloudPtr &input, float clusterTolerance, int minClusterSize,
+      int maxClusterSize, IndexVector &clusterIndices);
+
+  /**
+   * Same as cluster, but each tile is clustered on its own worker. Clusters
+   * with points within clusterTolerance of each other across a tile border
+   * are then merged, and the size limits are applied to the merged clusters,
+   * so buildClusters gives the same result as for clustering the whole cloud
+   * at once.
+   * @param tileSize the width of each tile. It is raised to clusterTolerance
+   *                 if it's smaller than that.
+   * @param keys     the Morton key of each input point, in ascending order.
+   *                 The neighbors of points at tile borders are found in the
+   *                 runs of keys around them.
+   * @param arena    scratch memory for the current frame
+   * @see cluster
+   */
+  void clusterTiled(CloudPtr &input, float clusterTolerance, int minClusterSize,
+      int maxClusterSize, float tileSize, const std::vector<uint64_t> &keys,
+      FrameArena &arena, IndexVector &clusterIndices);
+
+  /**
+   * Fill in clusters that were found in a subsample of a cloud with the
+   * points of the whole cloud. Each point joins the cluster of the nearest
+   * sampled point within clusterTolerance of it, looked for first among the
+   * sampled points on either side of it in Morton order, then in the cube of
+   * voxels around it. Points with no sampled cluster point that close are
+   * left out.
+   * @param input          the whole cloud
+   * @param keys           the Morton key of each point in input, in
+   *                       ascending order
+   * @param stride         the subsample is points 0, stride, 2 * stride, ...
+   *                       of input
+   * @param arena          scratch memory for the current frame
+   * @param clusterIndices the clusters, as indices into the subsample. They
+   *                       are replaced with indices into input.
+   */
+  void gatherClusters(const CloudPtr &input,
+      const std::vector<uint64_t> &keys, size_t stride, FrameArena &arena,
+      IndexVector &clusterIndices);
+
+  /**
+   * Sort clusters from largest to smallest (ties in Morton order of their
+   * first points, so the order is the same with or without tiling), then
+   * build the cluster messages and their summaries. The clusters go in
+   * response.compressed_clusters if clusterResolution is set, and in
+   * response.clusters otherwise. If
+   * response.degraded is set, only the largest maxClusters are built.
+   * @param input          the cloud that clusterIndices refer to
+   * @param clusterIndices the points in each cluster
+   * @param response       filled with one cluster and one summary per cluster
+   * @param attention      if not empty, the clusters that don't overlap one
+   *                       of these regions are left out before any message
+   *                       is built for them. Regions that can't be moved
+   *                       into transformToFrame are ignored.
+   */
+  void buildClusters(CloudPtr &input, IndexVector &clusterIndices,
+      orp::Segmentation::Response &response,
+      const std::vector<orp::AttentionRegion> &attention =
+        std::vector<orp::AttentionRegion>());
+  /**
+   * Transform the latest set of time-synchronized camera clouds into the
+   * clipping frame and voxelize them into one grid, which becomes the
+   * frame's voxelized cloud. Used by decodeStage for fused requests, so the
+   * fused scene goes straight into plane removal.
+   * @param frame the frame to fill in
+   * @return      false if there is no set of camera clouds yet
+   */
+  bool fuseLatest(Frame &frame);
+
+  /**
+   * Subscribe to the cameras while anything listens to fusedFramePublisher,
+   * and unsubscribe once nothing does, so that no camera clouds are
+   * received while no classifier is running.
    */
-  std::vector<sensor_msgs::PointCloud2> cluster(PCPtr &input,
-      float clusterTolerance, int minClusterSize, int maxClusterSize);
+  void cb_fusionSubscribers(const ros::SingleSubscriberPublisher &);
+
 public:
   /**
-   * Default constructor
+   * Set up the segmentation node: read the parameters and start serving
+   * requests.
    */
   Segmentation();
 
+  /**
+   * Set up for offline use, e.g. by tools that replay recorded clouds: only
+   * segment() is useful, and nothing touches ROS (no topics, services, tf or
+   * dynamic_reconfigure). Clouds are not transformed, so their points must
+   * already be in the frame the config's spatial bounds are in.
+   * @param config        the parameters. The publish flags are ignored.
+   * @param workerThreads threads for the per-tile work in tiled mode. 0 is
+   *                      one per core; tools that run several offline
+   *                      segmentations at once should pass 1.
+   */
+  explicit Segmentation(const orp::SegmentationConfig &config,
+    size_t workerThreads = 0);
+
+  /// Stops the pipeline threads.
+  ~Segmentation();
+
+  /**
+   * Called whenever one of the fused cameras publishes a cloud. Once every
+   * camera has a cloud within syncSlop of the others, they are put in
+   * fusionSlot as one set, and its stamp is published on ~fused_frames.
+   * @param cloud  the incoming cloud
+   * @param camera the index of the camera in cameraTopics
+   */
+  void cb_camera(const sensor_msgs::PointCloud2ConstPtr &cloud,
+      size_t camera);
+
   /// Start!
   void run();
 
-  /// Do the segmentation steps enabled by parameter flags and return the
-  /// result.
+  /**
+   * Do the segmentation steps enabled by parameter flags.
+   * @param scene    the cloud to segment
+   * @param response  filled with the clusters and their summaries
+   * @param attention if not empty, only the clusters that overlap one of
+   *                  these regions are returned
+   * @param fused     if true, the latest set of camera clouds is segmented
+   *                  instead of scene
+   * @return false if the scene couldn't be segmented
+   */
+  bool segment(const sensor_msgs::PointCloud2 &scene,
+      orp::Segmentation::Response &response,
+      const std::vector<orp::AttentionRegion> &attention =
+        std::vector<orp::AttentionRegion>(), bool fused = false);
+
+  /// Segmentation service callback.
   bool cb_segment(orp::Segmentation::Request &req,
       orp::Segmentation::Response &response);
+
+  /**
+   * Called for each asynchronous request. Requests are handled concurrently
+   * on the spinner threads, so with the pipeline enabled several of them
+   * can be in different stages at once.
+   */
+  void cb_segmentRequest(const orp::SegmentationRequestConstPtr &request);
+
+  /**
+   * Send a result to its client, on results/<client>. The topic is
+   * advertised when the client's first result is ready. Until the client
+   * has connected to it, results are held (up to the topic's queue size)
+   * rather than published to no one, and cb_resultSubscriber sends them.
+   * @param result the result to send
+   */
+  void publishResult(const orp::SegmentationResultConstPtr &result);
+
+  /**
+   * Called when a client connects to its results topic. Sends it the
+   * results that were finished before it connected.
+   * @param subscriber the new connection
+   * @param client     the client's name, as in its requests
+   */
+  void cb_resultSubscriber(const ros::SingleSubscriberPublisher &subscriber,
+      const std::string &client);
 };
 
 #endif
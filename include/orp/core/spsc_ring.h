@@ -0,0 +1,111 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * A bounded, lock-free queue for exactly one producer thread and one
+ * consumer thread.
+ *
+ * push() and pop() never block; callers decide how to wait when the ring is
+ * full or empty. With more than one producer (or consumer), the producers
+ * (or consumers) must be serialized by the caller.
+ */
+template <typename T>
+class SpscRing {
+public:
+  /// @param capacity the maximum number of items in the ring (at least 1)
+  explicit SpscRing(size_t capacity) :
+    slots(capacity + 1), head(0), tail(0)
+  {
+  }
+
+  /// Maximum number of items the ring can hold.
+  size_t capacity() const { return slots.size() - 1; }
+
+  /**
+   * Add an item at the back. Producer thread only.
+   * @return false if the ring is full.
+   */
+  bool push(const T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = increment(t);
+    if(next == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots[t] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Remove the item at the front. Consumer thread only.
+   * @return false if the ring is empty.
+   */
+  bool pop(T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = slots[h];
+    head.store(increment(h), std::memory_order_release);
+    return true;
+  }
+
+  /// Number of items in the ring. Only a snapshot if other threads are
+  /// pushing or popping.
+  size_t size() const {
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return t >= h ? t - h : t + slots.size() - h;
+  }
+
+private:
+  size_t increment(size_t i) const {
+    return i + 1 == slots.size() ? 0 : i + 1;
+  }
+
+  std::vector<T> slots;
+  /// Next slot to pop. Written only by the consumer.
+  std::atomic<size_t> head;
+  /// Next slot to push. Written only by the producer.
+  std::atomic<size_t> tail;
+
+  SpscRing(const SpscRing&);
+  SpscRing& operator=(const SpscRing&);
+};
+
+#endif
@@ -0,0 +1,168 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _VOXEL_HASH_H_
+#define _VOXEL_HASH_H_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "orp/core/compact_point.h"
+#include "orp/core/orp_utils.h"
+
+/**
+ * A sparse voxel grid, stored as a hash table from voxel coordinates to the
+ * running totals of the points that fell into each voxel.
+ *
+ * The grid is aligned to multiples of the leaf size (the same way as PCL's
+ * VoxelGrid), so points from several clouds can be fused into it one at a
+ * time, and the output is the centroid and mean color of each occupied voxel.
+ * Memory and output size scale with the number of occupied voxels, not the
+ * number of points inserted.
+ *
+ * Voxels are keyed by the Morton code of their coordinates (see morton.h),
+ * and are output in key order.
+ *
+ * The table is open-addressed in one flat array, and clear() keeps it
+ * allocated, so a grid that is reused from frame to frame stops allocating
+ * memory once it has grown to fit the scene.
+ *
+ * With color tracking turned off, only positions are averaged, for clouds
+ * from depth-only sensors.
+ */
+class VoxelHash {
+public:
+  /**
+   * Constructor.
+   * @param leafSize the edge length of each voxel
+   */
+  explicit VoxelHash(float leafSize = 0.005f);
+
+  /// Change the voxel size. This also clears the grid.
+  void setLeafSize(float leafSize);
+
+  /// The current voxel size.
+  float getLeafSize() const { return leafSize; }
+
+  /// Turn color averaging on or off (it's on by default). This also clears
+  /// the grid.
+  void setTrackColor(bool track);
+
+  /// Remove all points, keeping the allocated table for the next frame.
+  void clear();
+
+  /// Number of occupied voxels.
+  size_t size() const { return occupied; }
+
+  /// Add a single point.
+  void insert(const CompactPoint &point);
+
+  /// Add all (finite) points of a cloud. Explicitly instantiated for the
+  /// point types in point_traits.h.
+  template <typename PointT>
+  void insert(const pcl::PointCloud<PointT> &cloud);
+
+  /// Add all (finite) points of a cloud.
+  void insert(const CompactCloud &cloud);
+
+  /**
+   * Transform the points of a ROS cloud and add the ones that fall strictly
+   * inside the given bounds. This reads directly from the message data, so no
+   * intermediate PCL cloud is built for the raw points.
+   * @param cloud     the cloud to add. Must have float x/y/z fields; color is
+   *                  read from an rgb or rgba field if there is one.
+   * @param transform applied to each point before it is bounded and inserted
+   * @param minBound  minimum corner of the region to keep
+   * @param maxBound  maximum corner of the region to keep
+   * @return          the number of points inserted
+   */
+  size_t insert(const sensor_msgs::PointCloud2 &cloud,
+    const Eigen::Affine3f &transform,
+    const Eigen::Vector3f &minBound, const Eigen::Vector3f &maxBound);
+
+  /**
+   * Output one point per occupied voxel, in Morton order. Explicitly
+   * instantiated for the point types in point_traits.h.
+   * @param out  filled with the centroid and mean color of each voxel
+   * @param keys if not null, filled with the Morton key of each output point
+   */
+  template <typename PointT>
+  void getCloud(pcl::PointCloud<PointT> &out,
+    std::vector<uint64_t> *keys = NULL) const;
+
+  /// The Morton key of the voxel that contains the given position.
+  uint64_t keyFor(float x, float y, float z) const;
+
+private:
+  /// Running totals for one voxel.
+  struct Voxel {
+    Eigen::Vector3f sum;
+    uint32_t r, g, b;
+    uint32_t count;
+
+    Voxel() : sum(Eigen::Vector3f::Zero()), r(0), g(0), b(0), count(0) {}
+  };
+
+  /// One entry of the hash table.
+  struct Slot {
+    uint64_t key;
+    Voxel voxel;
+  };
+
+  /// Marks an empty slot. Morton keys only use the low 63 bits.
+  static const uint64_t kEmptyKey = ~0ULL;
+
+  /// Find the slot for a key, claiming an empty one if it isn't there yet.
+  Voxel& lookup(uint64_t key);
+
+  /// Double the size of the table (or create it).
+  void grow();
+
+  /// Add a point given its coordinates and color.
+  void add(float x, float y, float z, uint8_t r, uint8_t g, uint8_t b);
+
+  float leafSize;
+  float inverseLeafSize;
+  bool trackColor;
+
+  std::vector<Slot> slots;
+  /// number of occupied slots
+  size_t occupied;
+  /// slots.size() - 1; the size is always a power of two
+  size_t slotMask;
+  /// Scratch space for sorting the output, kept to avoid reallocating it
+  mutable std::vector<std::pair<uint64_t, size_t> > order;
+};
+
+#endif
@@ -0,0 +1,86 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that run queued tasks.
+ *
+ * Several threads (for example, ROS spinner threads handling separate
+ * requests) may share one pool. Tasks must not block waiting on other tasks
+ * in the same pool.
+ */
+class WorkerPool {
+public:
+  /**
+   * Start the worker threads.
+   * @param numThreads how many threads to start. If 0, use one per core.
+   */
+  explicit WorkerPool(size_t numThreads = 0);
+
+  /// Finishes any queued tasks, then stops the threads.
+  ~WorkerPool();
+
+  /// Number of worker threads.
+  size_t size() const { return threads.size(); }
+
+  /// Queue a task to run on one of the workers.
+  void post(const std::function<void()> &task);
+
+  /**
+   * Run fn(0) ... fn(n-1) across the workers and the calling thread, and
+   * block until all of them have finished. If any call throws, the first
+   * exception is rethrown here once the rest have finished.
+   */
+  void parallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+private:
+  /// Worker thread body
+  void work();
+
+  std::vector<std::thread> threads;
+  std::deque<std::function<void()> > tasks;
+  std::mutex tasksMutex;
+  std::condition_variable tasksAvailable;
+  bool stopping;
+
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif
@@ -49,6 +49,7 @@
 #include <tf_conversions/tf_eigen.h>
 #include <visualization_msgs/Marker.h>
 
+#include <orp/ClusterReference.h>
 #include <orp/WorldObject.h>
 
 #include "orp/core/grasp.h"
@@ -344,6 +345,8 @@ protected:
   /// Point cloud representing this object. Usually will be the point cloud
   /// used to detect the object in the first place.
   sensor_msgs::PointCloud2 cloud;
+  /// Where cloud can be fetched from when it was left out.
+  orp::ClusterReference cluster;
 
   //list of all detectable items
   std::vector<std::string> fullSensorModel;
@@ -432,6 +435,14 @@ public:
   /// @return the point cloud associated with this object.
   sensor_msgs::PointCloud2 getCloud() { return cloud; };
 
+  /// Set the cluster this object was classified from
+  void setClusterReference(const orp::ClusterReference& _cluster) {
+    cluster = _cluster;
+  }
+
+  /// @return the cluster this object was classified from
+  const orp::ClusterReference& getClusterReference() { return cluster; };
+
   /// Get whatever markers are appropriate for the object in it's current
   /// state.
   std::vector<visualization_msgs::Marker> getMarkers();
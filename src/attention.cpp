@@ -0,0 +1,154 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/attention.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/// When a region stops being active.
+ros::Time expiry(const orp::AttentionRegion &region)
+{
+  return region.header.stamp + region.lifetime;
+}
+
+} // namespace
+
+AttentionRegions::AttentionRegions(double unattendedRate) :
+  unattendedPeriod(unattendedRate > 0 ? 1.0 / unattendedRate : 0.0)
+{
+}
+
+void AttentionRegions::add(const orp::AttentionRegion &region)
+{
+  orp::AttentionRegion stored = region;
+  if(stored.header.stamp.isZero()) {
+    stored.header.stamp = ros::Time::now();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for(size_t i = 0; i < regions.size(); ++i) {
+    if(regions[i].id == stored.id) {
+      regions[i] = stored;
+      return;
+    }
+  }
+  regions.push_back(stored);
+}
+
+std::vector<orp::AttentionRegion> AttentionRegions::focus(
+  const ros::Time &now)
+{
+  std::vector<orp::AttentionRegion> focused;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // forget the expired regions; the ones that haven't started yet stay
+  size_t kept = 0;
+  for(size_t i = 0; i < regions.size(); ++i) {
+    if(expiry(regions[i]) > now) {
+      regions[kept++] = regions[i];
+    }
+  }
+  regions.resize(kept);
+
+  int priority = std::numeric_limits<int>::min();
+  for(size_t i = 0; i < regions.size(); ++i) {
+    const orp::AttentionRegion &region = regions[i];
+    if(region.header.stamp > now) {
+      continue;
+    }
+    if(region.priority > priority) {
+      focused.clear();
+      priority = region.priority;
+    }
+    if(region.priority == priority) {
+      focused.push_back(region);
+    }
+  }
+  if(focused.empty()) {
+    // the first frame after the regions go away is processed in full
+    // anyway, so the period starts over with the next region
+    nextFull = ros::Time();
+    return focused;
+  }
+
+  if(unattendedPeriod > 0 && now >= nextFull) {
+    // the first full frame comes a period after focusing starts
+    bool starting = nextFull.isZero();
+    nextFull = now + ros::Duration(unattendedPeriod);
+    if(!starting) {
+      focused.clear();
+    }
+  }
+  return focused;
+}
+
+orp::AttentionRegion AttentionRegions::transformed(
+  const orp::AttentionRegion &region, const std::string &frame,
+  const Eigen::Affine3f &transform)
+{
+  const orp::Region &box = region.box;
+  Eigen::AlignedBox3f moved;
+  for(int corner = 0; corner < 8; ++corner) {
+    Eigen::Vector3f point(
+      (corner & 1) ? box.max_x : box.min_x,
+      (corner & 2) ? box.max_y : box.min_y,
+      (corner & 4) ? box.max_z : box.min_z);
+    moved.extend(transform * point);
+  }
+
+  orp::AttentionRegion result = region;
+  result.header.frame_id = frame;
+  result.box.min_x = moved.min().x();
+  result.box.min_y = moved.min().y();
+  result.box.min_z = moved.min().z();
+  result.box.max_x = moved.max().x();
+  result.box.max_y = moved.max().y();
+  result.box.max_z = moved.max().z();
+  return result;
+}
+
+bool AttentionRegions::overlaps(
+  const std::vector<orp::AttentionRegion> &regions,
+  const geometry_msgs::Point &min, const geometry_msgs::Point &max)
+{
+  for(size_t i = 0; i < regions.size(); ++i) {
+    const orp::Region &box = regions[i].box;
+    if(min.x <= box.max_x && max.x >= box.min_x &&
+       min.y <= box.max_y && max.y >= box.min_y &&
+       min.z <= box.max_z && max.z >= box.min_z)
+    {
+      return true;
+    }
+  }
+  return false;
+}
@@ -30,6 +30,7 @@
 
 #include <eigen_conversions/eigen_msg.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pluginlib/class_list_macros.h>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "orp/core/orp_utils.h"
@@ -37,78 +38,32 @@
 
 #include <sstream>
 
-int main(int argc, char **argv)
-{
-  // Start up the name and handle command-line arguments.
-  srand (static_cast <unsigned> (time(0)));
-
-  ros::init(argc, argv, "basic_classifier");
-
-  ROS_INFO("Starting basic Classifier");
-  BasicClassifier v;
-  v.init();
-
-  ros::AsyncSpinner spinner(2);
-  spinner.start();
-
-  ros::waitForShutdown();
-  return 1;
-}
-
-BasicClassifier::BasicClassifier():
-  Classifier3D()
+void BasicClassifier::initialize(ros::NodeHandle& node,
+  ros::NodeHandle& node_private)
 {
 }
 
-void BasicClassifier::cb_classify(const sensor_msgs::PointCloud2& cloud)
+void BasicClassifier::classifyCluster(const ClusterView& cluster,
+  std::vector<orp::WorldObject>& objects)
 {
-  ROS_DEBUG_NAMED("Basic Classfiier",
-      "Received point cloud to find objects");
-
-  orp::ClassificationResult classRes;
-  classRes.method = "basic";
-
-  orp::Segmentation seg_srv;
-  seg_srv.request.scene = cloud;
-  bool segmentation_succeeded = segmentation_client_.call(seg_srv);
-  if(!segmentation_succeeded)
-  {
-    ROS_ERROR_STREAM_THROTTLE_NAMED(5, "Basic Classifier", "Could not call segmentation service at " << segmentation_service_);
+  const orp::ClusterSummary& summary = cluster.summary();
+  if(summary.point_count < 3 || summary.point_count > 500) {
+    return;
   }
-  std::vector<sensor_msgs::PointCloud2> clouds = seg_srv.response.clusters;
-
-  if(!clouds.empty()) {
-    for(auto eachCloud = clouds.begin();
-        eachCloud != clouds.end(); eachCloud++)
-    {
-      if(eachCloud->width < 3 || eachCloud->width > 500) {
-        continue;
-      }
-      pcl::PointCloud<ORPPoint>::Ptr thisCluster(
-          new pcl::PointCloud<ORPPoint>);
-      pcl::fromROSMsg(*eachCloud, *thisCluster);
 
-      orp::WorldObject thisObject;
-      thisObject.label = "object";
-      thisObject.pose.header.frame_id = eachCloud->header.frame_id;
+  orp::WorldObject thisObject;
+  thisObject.label = "object";
+  thisObject.pose.header.frame_id = cluster.header().frame_id;
 
-      Eigen::Vector4f clusterCentroid;
-      pcl::compute3DCentroid(*thisCluster, clusterCentroid);
+  thisObject.pose.pose.position = summary.centroid;
 
-      Eigen::Affine3d finalPose;
-      finalPose(0,3) = clusterCentroid(0);
-      finalPose(1,3) = clusterCentroid(1);
-      finalPose(2,3) = clusterCentroid(2);
-      tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
+  thisObject.pose.pose.orientation.x = 0;
+  thisObject.pose.pose.orientation.y = 0;
+  thisObject.pose.pose.orientation.z = 0;
+  thisObject.pose.pose.orientation.w = 1;
 
-      thisObject.pose.pose.orientation.x = 0;
-      thisObject.pose.pose.orientation.y = 0;
-      thisObject.pose.pose.orientation.z = 0;
-      thisObject.pose.pose.orientation.w = 1;
-
-      thisObject.probability = 0.75;
-      classRes.result.push_back(thisObject);
-    }
-  }
-  classification_pub_.publish(classRes);
+  thisObject.probability = 0.75;
+  objects.push_back(thisObject);
 }
+
+PLUGINLIB_EXPORT_CLASS(BasicClassifier, ClassifierPlugin)
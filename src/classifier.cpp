@@ -32,8 +32,12 @@
 
 Classifier::Classifier():
   node_private_("~"),
-  node_("")
+  node_(""),
+  data_spinner_(1, &data_queue_)
 {
+  data_node_.setCallbackQueue(&data_queue_);
+  data_spinner_.start();
+
   //load configuration parameters and defaults
   node_private_.param<std::string>("classification_topic",
       classification_topic_, "classification");
@@ -46,6 +50,11 @@ Classifier::Classifier():
   stop_sub_ = node_.subscribe(stop_topic_, 1, &Classifier::cb_stop, this);
 }
 
+Classifier::~Classifier()
+{
+  data_spinner_.stop();
+}
+
 void Classifier::init()
 {
   //autostart
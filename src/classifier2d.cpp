@@ -34,7 +34,7 @@
 
 Classifier2D::Classifier2D():
   Classifier(),
-  image_transport_(node_)
+  image_transport_(data_node_)
 {
   node_private_.param<std::string>("image_topic",
       image_topic_, "/camera/rgb/image_raw");
@@ -29,36 +29,924 @@
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "orp/core/classifier3d.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <pcl_conversions/pcl_conversions.h>
+
+#include "orp/core/cluster_summary.h"
 #include "orp/core/world_object.h"
 #include "orp/core/orp_utils.h"
 
+namespace {
+
+/// Decode cluster i into points[i], unless it's too small to classify.
+void decodeCluster(ClusterSet& clusters, size_t i,
+    std::vector<pcl::PointCloud<GeometryPoint>::Ptr>& points)
+{
+  if(points[i] || clusters.summary(i).point_count < 3)
+  {
+    return;
+  }
+  points[i].reset(new pcl::PointCloud<GeometryPoint>);
+  pcl::fromROSMsg(clusters.cloud(i), *points[i]);
+}
+
+/// Copy objects found in an earlier frame, restamped for the cluster now.
+void reuseObjects(const std::vector<orp::WorldObject>& objects,
+    const std_msgs::Header& header, std::vector<orp::WorldObject>& out)
+{
+  out = objects;
+  for(size_t i = 0; i < out.size(); ++i)
+  {
+    out[i].pose.header.stamp = header.stamp;
+  }
+}
+
+/// The highest probability among a cluster's objects, 0 if there are none.
+float bestProbability(const std::vector<orp::WorldObject>& objects)
+{
+  float best = 0.0f;
+  for(size_t i = 0; i < objects.size(); ++i)
+  {
+    best = std::max(best, objects[i].probability);
+  }
+  return best;
+}
+
+} // namespace
+
 Classifier3D::Classifier3D():
-  Classifier()
+  Classifier(),
+  next_request_id_(0),
+  requests_done_(false),
+  needs_points_(false),
+  service_node_("~"),
+  service_spinner_(1, &service_queue_),
+  frame_count_(0)
 {
+  service_node_.setCallbackQueue(&service_queue_);
+
   // allow remapping to different segmentation service
   node_private_.param<std::string>("segmentation_service",
       segmentation_service_, "segmentation/segmentation");
   segmentation_client_ =
       node_.serviceClient<orp::Segmentation>(segmentation_service_);
 
+  node_private_.param<int>("segmentation_depth", segmentation_depth_, 0);
+  double timeout;
+  node_private_.param<double>("segmentation_timeout", timeout, 5.0);
+  segmentation_timeout_ = ros::Duration(timeout);
+  if(segmentation_depth_ > 0)
+  {
+    std::string request_topic, result_topic;
+    node_private_.param<std::string>("segmentation_requests", request_topic,
+        "segmentation/requests");
+    node_private_.param<std::string>("segmentation_results", result_topic,
+        "segmentation/results");
+    client_id_ = ros::this_node::getName();
+    segmentation_request_pub_ =
+        node_.advertise<orp::SegmentationRequest>(request_topic,
+          segmentation_depth_);
+    // segmentation answers each client on a topic of its own; the node
+    // name already starts with a slash
+    segmentation_result_sub_ = data_node_.subscribe(result_topic + client_id_,
+        10, &Classifier3D::cb_segmentationResult, this);
+  }
+
   // allow remapping to different depth cloud topic, but by default
-  // use the default camera's point cloud
+  // use the default camera's point cloud, or segmentation's fused cameras
+  node_private_.param<bool>("fused_scene", fused_scene_, false);
   node_private_.param<std::string>("depth_topic", depth_topic_,
+    fused_scene_ ? "segmentation/fused_frames" :
     "/camera/depth_registered/points");
+
+  frame_stats_pub_ = node_private_.advertise<orp::FrameStats>(
+      "frame_stats", 1);
+
+  std::string attention_topic;
+  double unattended_rate;
+  node_private_.param<std::string>("attention_topic", attention_topic,
+      "attention");
+  node_private_.param<double>("unattended_rate", unattended_rate, 1.0);
+  attention_.reset(new AttentionRegions(unattended_rate));
+
+  // objects refer to their clusters, which are kept as long as the
+  // recognizer keeps the objects, unless their points are sent along
+  node_private_.param<bool>("embed_clouds", embed_clouds_, false);
+  double cluster_cache_time;
+  node_private_.param<double>("cluster_cache_time", cluster_cache_time, 2.0);
+  cluster_cache_time_ = ros::Duration(std::max(0.0, cluster_cache_time));
+  if(!cluster_cache_time_.isZero())
+  {
+    cluster_service_ = ros::this_node::getName() + "/get_cluster";
+    cluster_server_ = service_node_.advertiseService("get_cluster",
+        &Classifier3D::cb_getCluster, this);
+  }
+
+  // on-demand classification, which works without a camera
+  classify_server_ = service_node_.advertiseService("classify_clusters",
+      &Classifier3D::cb_classifyClusters, this);
+  recognize_server_ = service_node_.advertiseService("recognize",
+      &Classifier3D::cb_recognize, this);
+  attention_sub_ = data_node_.subscribe(attention_topic, 10,
+      &Classifier3D::cb_attention, this);
+
+  // 0 is one thread per core
+  int cluster_threads;
+  node_private_.param<int>("cluster_threads", cluster_threads, 0);
+  if(cluster_threads != 1)
+  {
+    // parallelFor also runs tasks on the calling thread
+    cluster_pool_.reset(new WorkerPool(cluster_threads > 1 ?
+        cluster_threads - 1 : 0));
+  }
+
+  // cores x duty cycle; 0 runs every plugin on every frame
+  double cpu_budget, cpu_burst;
+  node_private_.param<double>("cpu_budget", cpu_budget, 0.0);
+  node_private_.param<double>("cpu_burst", cpu_burst, 1.0);
+  scheduler_ = ClassifierScheduler(cpu_budget, cpu_burst);
+
+  node_private_.param<bool>("track_clusters", track_clusters_, false);
+  node_private_.param<double>("track_distance", track_params_.maxDistance,
+      track_params_.maxDistance);
+  node_private_.param<double>("track_extent_change",
+      track_params_.maxExtentChange, track_params_.maxExtentChange);
+  node_private_.param<double>("track_count_change",
+      track_params_.maxCountChange, track_params_.maxCountChange);
+  node_private_.param<double>("track_refresh", track_params_.refresh,
+      track_params_.refresh);
+  node_private_.param<double>("track_drift", track_params_.drift,
+      track_params_.drift);
+  scheduler_stats_pub_ = node_private_.advertise<orp::SchedulerStats>(
+      "scheduler_stats", 1);
+
+  loadCascade();
+}
+
+void Classifier3D::loadCascade()
+{
+  XmlRpc::XmlRpcValue list;
+  if(!node_private_.getParam("cascade", list))
+  {
+    return;
+  }
+  if(list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("~cascade must be a list of {method, threshold} entries; "
+      "running every classifier on every cluster.");
+    return;
+  }
+
+  for(int i = 0; i < list.size(); ++i) {
+    XmlRpc::XmlRpcValue &entry = list[i];
+    if(entry.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+       !entry.hasMember("method"))
+    {
+      ROS_ERROR("Skipping entry %d of ~cascade, which needs a method.", i);
+      continue;
+    }
+    CascadeStage stage;
+    stage.method = static_cast<std::string>(entry["method"]);
+    // without a threshold, only certain answers stop a cluster
+    stage.threshold = 1.0f;
+    if(entry.hasMember("threshold"))
+    {
+      XmlRpc::XmlRpcValue &threshold = entry["threshold"];
+      stage.threshold = threshold.getType() == XmlRpc::XmlRpcValue::TypeInt ?
+          static_cast<int>(threshold) : static_cast<double>(threshold);
+    }
+    stage.index = 0;
+    stage.classified = 0;
+    stage.forwarded = 0;
+    cascade_.push_back(stage);
+  }
+  if(!cascade_.empty())
+  {
+    cascade_stats_pub_ = node_private_.advertise<orp::CascadeStats>(
+        "cascade_stats", 1);
+  }
+}
+
+Classifier3D::~Classifier3D()
+{
+  shutdown();
+}
+
+void Classifier3D::init()
+{
+  service_spinner_.start();
+  Classifier::init();
+}
+
+void Classifier3D::shutdown()
+{
+  // no more clouds, results or requests may arrive once the members start
+  // going away
+  data_spinner_.stop();
+  service_spinner_.stop();
+  stopThreads();
 }
 
 void Classifier3D::start()
 {
   Classifier::start();
-  depth_sub_ = node_.subscribe(depth_topic_, 1,
-      &Classifier3D::cb_classify, this);
+  for(size_t s = 0; s < cascade_.size(); ++s)
+  {
+    if(!cascade_[s].plugin)
+    {
+      ROS_WARN("No classifier has method %s; skipping that cascade stage.",
+          cascade_[s].method.c_str());
+    }
+  }
+  if(!classify_thread_.joinable())
+  {
+    frame_slot_.reopen();
+    requests_done_ = false;
+    classify_thread_ = std::thread(&Classifier3D::classifyLoop, this);
+    if(segmentation_depth_ > 0)
+    {
+      result_thread_ = std::thread(&Classifier3D::resultLoop, this);
+    }
+  }
+  if(fused_scene_)
+  {
+    depth_sub_ = data_node_.subscribe(depth_topic_, 1,
+        &Classifier3D::cb_fusedFrame, this);
+  }
+  else
+  {
+    depth_sub_ = data_node_.subscribe(depth_topic_, 1,
+        &Classifier3D::cb_depth, this);
+  }
 }
 
 void Classifier3D::stop()
 {
-  Classifier::stop();
   if(depth_sub_ != NULL)
   {
     depth_sub_.shutdown();
   }
+  // let the current classification finish before its publisher goes away
+  stopThreads();
+  Classifier::stop();
+}
+
+void Classifier3D::stopThreads()
+{
+  frame_slot_.close();
+  if(classify_thread_.joinable())
+  {
+    classify_thread_.join();
+  }
+  // No more requests go out now. Rather than wait up to
+  // segmentation_timeout_ for each one still out, give up on them, so the
+  // result thread only classifies the results that have already arrived.
+  cancelPending();
+  if(result_thread_.joinable())
+  {
+    result_thread_.join();
+  }
+}
+
+void Classifier3D::cb_depth(const sensor_msgs::PointCloud2ConstPtr& cloud)
+{
+  frame_slot_.put(cloud);
+}
+
+void Classifier3D::cb_fusedFrame(const std_msgs::HeaderConstPtr& header)
+{
+  sensor_msgs::PointCloud2Ptr frame(new sensor_msgs::PointCloud2);
+  frame->header = *header;
+  frame_slot_.put(frame);
+}
+
+bool Classifier3D::cb_getCluster(orp::GetCluster::Request& req,
+    orp::GetCluster::Response& res)
+{
+  boost::shared_ptr<const orp::Segmentation::Response> segmentation;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    for(size_t i = 0; i < cache_.size(); ++i)
+    {
+      if(cache_[i].frame == req.frame)
+      {
+        segmentation = cache_[i].segmentation;
+        break;
+      }
+    }
+  }
+  res.found = false;
+  if(segmentation)
+  {
+    // only this cluster is decoded
+    ClusterSet clusters(*segmentation);
+    if(req.index < clusters.size())
+    {
+      res.cloud = clusters.cloud(req.index);
+      res.found = true;
+    }
+  }
+  return true;
+}
+
+void Classifier3D::classifyClusters(
+    const std::vector<sensor_msgs::PointCloud2>& clusters,
+    std::vector<std::vector<orp::WorldObject> >& found)
+{
+  const size_t num_clusters = clusters.size();
+  const size_t num_plugins = plugins_.size();
+
+  // these clusters come without summaries, so they're decoded to make them
+  std::vector<orp::ClusterSummary> summaries(num_clusters);
+  std::vector<pcl::PointCloud<GeometryPoint>::Ptr> points(num_clusters);
+  runParallel(num_clusters, [&](size_t i) {
+    pcl::PointCloud<ORPPoint> colored;
+    pcl::fromROSMsg(clusters[i], colored);
+    summaries[i] = ClusterSummaries::summarize(colored);
+    if(needs_points_ && summaries[i].point_count >= 3)
+    {
+      points[i].reset(new pcl::PointCloud<GeometryPoint>);
+      pcl::fromROSMsg(clusters[i], *points[i]);
+    }
+  });
+  std::vector<ClusterView> views;
+  views.reserve(num_clusters);
+  for(size_t i = 0; i < num_clusters; ++i)
+  {
+    views.push_back(ClusterView(clusters[i].header, summaries[i], points[i]));
+  }
+
+  found.assign(num_clusters * num_plugins, std::vector<orp::WorldObject>());
+  runParallel(found.size(), [&](size_t slot) {
+    plugins_[slot % num_plugins]->classifyCluster(views[slot / num_plugins],
+        found[slot]);
+  });
+}
+
+bool Classifier3D::cb_classifyClusters(
+    orp::ClassifyClusters::Request& req,
+    orp::ClassifyClusters::Response& res)
+{
+  std::vector<std::vector<orp::WorldObject> > found;
+  classifyClusters(req.clusters, found);
+
+  const size_t num_plugins = plugins_.size();
+  for(size_t slot = 0; slot < found.size(); ++slot)
+  {
+    for(size_t j = 0; j < found[slot].size(); ++j)
+    {
+      if(found[slot][j].probability < req.threshold)
+      {
+        continue;
+      }
+      res.objects.push_back(found[slot][j]);
+      res.cluster_indices.push_back(slot / num_plugins);
+      res.methods.push_back(plugins_[slot % num_plugins]->method());
+    }
+  }
+  return true;
+}
+
+bool Classifier3D::cb_recognize(orp::Recognition::Request& req,
+    orp::Recognition::Response& res)
+{
+  std::vector<std::vector<orp::WorldObject> > found;
+  classifyClusters(std::vector<sensor_msgs::PointCloud2>(1, req.cluster),
+      found);
+
+  // the first of the most probable objects, if any is probable enough
+  const orp::WorldObject* best = NULL;
+  for(size_t slot = 0; slot < found.size(); ++slot)
+  {
+    for(size_t j = 0; j < found[slot].size(); ++j)
+    {
+      const orp::WorldObject& object = found[slot][j];
+      if(object.probability >= req.threshold &&
+         (!best || object.probability > best->probability))
+      {
+        best = &object;
+      }
+    }
+  }
+  if(best)
+  {
+    res.label = best->label;
+    res.pose = best->pose;
+  }
+  return true;
+}
+
+void Classifier3D::cb_attention(const orp::AttentionRegionConstPtr& region)
+{
+  attention_->add(*region);
+}
+
+void Classifier3D::cb_classify(const sensor_msgs::PointCloud2& cloud)
+{
+  orp::Segmentation seg_srv;
+  seg_srv.request.scene = cloud;
+  seg_srv.request.attention = attention_->focus(ros::Time::now());
+  seg_srv.request.fused = fused_scene_;
+  if(!segmentation_client_.call(seg_srv))
+  {
+    ROS_ERROR_STREAM_THROTTLE(5, "Could not call segmentation service at "
+        << segmentation_service_);
+  }
+  classify(cloud, boost::shared_ptr<orp::Segmentation::Response>(
+      new orp::Segmentation::Response(std::move(seg_srv.response))));
+}
+
+void Classifier3D::addPlugin(
+    const boost::shared_ptr<ClassifierPlugin>& plugin, const std::string& ns)
+{
+  if(!cascade_.empty())
+  {
+    bool staged = false;
+    for(size_t s = 0; s < cascade_.size(); ++s)
+    {
+      if(cascade_[s].method == plugin->method() && !cascade_[s].plugin)
+      {
+        cascade_[s].plugin = plugin;
+        cascade_[s].index = plugins_.size();
+        staged = true;
+        break;
+      }
+    }
+    if(!staged)
+    {
+      ROS_WARN("Classifier %s isn't a stage of ~cascade and won't be run.",
+          plugin->method().c_str());
+      return;
+    }
+  }
+  ros::NodeHandle plugin_private(node_private_, ns);
+  plugin->initialize(node_, plugin_private);
+  plugins_.push_back(plugin);
+  needs_points_ = needs_points_ || plugin->needsPoints();
+
+  int priority;
+  double target_rate;
+  plugin_private.param<int>("priority", priority, 0);
+  plugin_private.param<double>("target_rate", target_rate, 0.0);
+  scheduler_.add(plugin->method(), priority, target_rate);
+  method_ += (method_.empty() ? "" : "+") + plugin->method();
+}
+
+void Classifier3D::runParallel(size_t n,
+    const std::function<void(size_t)>& fn)
+{
+  if(cluster_pool_)
+  {
+    cluster_pool_->parallelFor(n, fn);
+  }
+  else
+  {
+    for(size_t i = 0; i < n; ++i)
+    {
+      fn(i);
+    }
+  }
+}
+
+void Classifier3D::classify(const sensor_msgs::PointCloud2& cloud,
+  const boost::shared_ptr<const orp::Segmentation::Response>& segmentation)
+{
+  ClusterSet clusters(*segmentation);
+  const size_t num_clusters = clusters.size();
+  std::vector<pcl::PointCloud<GeometryPoint>::Ptr> points(num_clusters);
+
+  const std::vector<bool> run = scheduler_.plan(ros::WallTime::now());
+  std::vector<double> cpu(plugins_.size(), 0.0);
+  double overhead = 0.0;
+
+  // match the clusters to the last frame's, so their results can be reused
+  const ros::Time now = ros::Time::now();
+  if(track_clusters_)
+  {
+    if(!tracker_)
+    {
+      tracker_.reset(new ClusterTracker(track_params_,
+          cascade_.empty() ? plugins_.size() : 1));
+    }
+    std::vector<orp::ClusterSummary> summaries(num_clusters);
+    for(size_t i = 0; i < num_clusters; ++i)
+    {
+      summaries[i] = clusters.summary(i);
+    }
+    tracker_->update(summaries);
+  }
+
+  // the objects found, in the order they're published, and the method that
+  // found each list
+  std::vector<std::vector<orp::WorldObject> > found;
+  std::vector<std::string> methods;
+  if(!cascade_.empty())
+  {
+    classifyCascade(clusters, points, found, methods, run, cpu, now);
+  }
+  else
+  {
+    // one list of objects per cluster and plugin, in cluster order, so that
+    // the result doesn't depend on which task finishes first. Results the
+    // tracker still has are reused, even for plugins the scheduler skipped.
+    const size_t num_plugins = plugins_.size();
+    found.resize(num_clusters * num_plugins);
+    std::vector<size_t> tasks;
+    std::vector<char> decode(num_clusters, 0);
+    for(size_t slot = 0; slot < found.size(); ++slot)
+    {
+      const size_t i = slot / num_plugins;
+      const size_t p = slot % num_plugins;
+      methods.push_back(plugins_[p]->method());
+      if(tracker_ && tracker_->fresh(i, p, now))
+      {
+        reuseObjects(tracker_->objects(i, p), clusters.header(i),
+            found[slot]);
+      }
+      else if(run[p])
+      {
+        tasks.push_back(slot);
+        decode[i] = decode[i] || plugins_[p]->needsPoints();
+      }
+    }
+
+    // decode each cluster once, for all of the plugins
+    std::vector<double> decode_cpu(num_clusters, 0.0);
+    runParallel(num_clusters, [&](size_t i) {
+      if(decode[i])
+      {
+        const double start = threadCpuSeconds();
+        decodeCluster(clusters, i, points);
+        decode_cpu[i] = threadCpuSeconds() - start;
+      }
+    });
+    for(size_t i = 0; i < num_clusters; ++i)
+    {
+      overhead += decode_cpu[i];
+    }
+    std::vector<ClusterView> views;
+    views.reserve(num_clusters);
+    for(size_t i = 0; i < num_clusters; ++i)
+    {
+      views.push_back(ClusterView(clusters.header(i), clusters.summary(i),
+          points[i]));
+    }
+
+    std::vector<double> task_cpu(tasks.size(), 0.0);
+    runParallel(tasks.size(), [&](size_t k) {
+      const double start = threadCpuSeconds();
+      const size_t slot = tasks[k];
+      plugins_[slot % num_plugins]->classifyCluster(
+          views[slot / num_plugins], found[slot]);
+      task_cpu[k] = threadCpuSeconds() - start;
+    });
+    for(size_t k = 0; k < tasks.size(); ++k)
+    {
+      const size_t slot = tasks[k];
+      const size_t p = slot % num_plugins;
+      cpu[p] += task_cpu[k];
+      if(tracker_)
+      {
+        tracker_->store(slot / num_plugins, p, found[slot], methods[slot],
+            now);
+      }
+    }
+  }
+  scheduler_.finish(cpu, overhead);
+  scheduler_stats_pub_.publish(scheduler_.stats());
+
+  // keep the clusters around for GetCluster, and point the objects at them
+  // instead of sending their points
+  const uint32_t frame = frame_count_++;
+  if(!cluster_cache_time_.isZero())
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    CachedFrame cached;
+    cached.frame = frame;
+    cached.stamp = now;
+    cached.segmentation = segmentation;
+    cache_.push_back(cached);
+    while(now - cache_.front().stamp > cluster_cache_time_)
+    {
+      cache_.pop_front();
+    }
+  }
+  const size_t per_cluster = cascade_.empty() ? plugins_.size() : 1;
+
+  orp::ClassificationResult classRes;
+  classRes.method = method_;
+  for(size_t k = 0; k < found.size(); ++k)
+  {
+    const size_t i = k / per_cluster;
+    for(size_t j = 0; j < found[k].size(); ++j)
+    {
+      orp::WorldObject& object = found[k][j];
+      if(!cluster_cache_time_.isZero())
+      {
+        object.cluster.source = cluster_service_;
+      }
+      object.cluster.frame = frame;
+      object.cluster.index = i;
+      object.cluster.header = clusters.header(i);
+      object.cluster.summary = clusters.summary(i);
+      if(embed_clouds_ && object.cloud.data.empty())
+      {
+        object.cloud = clusters.cloud(i);
+      }
+      else if(!embed_clouds_)
+      {
+        object.cloud = sensor_msgs::PointCloud2();
+      }
+    }
+    classRes.result.insert(classRes.result.end(), found[k].begin(),
+        found[k].end());
+    classRes.result_methods.insert(classRes.result_methods.end(),
+        found[k].size(), methods[k]);
+  }
+  if(classification_pub_ != NULL)
+  {
+    classification_pub_.publish(classRes);
+  }
+}
+
+void Classifier3D::classifyCascade(ClusterSet& clusters,
+    std::vector<pcl::PointCloud<GeometryPoint>::Ptr>& points,
+    std::vector<std::vector<orp::WorldObject> >& found,
+    std::vector<std::string>& methods, const std::vector<bool>& run,
+    std::vector<double>& cpu, const ros::Time& now)
+{
+  found.assign(clusters.size(), std::vector<orp::WorldObject>());
+  methods.assign(clusters.size(), std::string());
+
+  // the tracker keeps the cascade's final answer for each cluster
+  std::vector<size_t> active;
+  for(size_t i = 0; i < clusters.size(); ++i)
+  {
+    if(tracker_ && tracker_->fresh(i, 0, now))
+    {
+      reuseObjects(tracker_->objects(i, 0), clusters.header(i), found[i]);
+      methods[i] = tracker_->method(i, 0);
+    }
+    else
+    {
+      active.push_back(i);
+    }
+  }
+  // clusters no stage runs on this frame have nothing to store
+  std::vector<char> classified(clusters.size(), 0);
+
+  // the last stage that runs on this frame doesn't forward anything
+  size_t last = 0;
+  for(size_t s = 0; s < cascade_.size(); ++s)
+  {
+    if(cascade_[s].plugin && run[cascade_[s].index])
+    {
+      last = s;
+    }
+  }
+
+  for(size_t s = 0; s < cascade_.size() && !active.empty(); ++s)
+  {
+    CascadeStage& stage = cascade_[s];
+    // a stage the scheduler skipped leaves its clusters to the next one
+    if(!stage.plugin || !run[stage.index])
+    {
+      continue;
+    }
+    const bool needs_points = stage.plugin->needsPoints();
+
+    // clusters are only decoded once they reach a stage that needs them
+    std::vector<std::vector<orp::WorldObject> > stage_found(active.size());
+    std::vector<double> task_cpu(active.size(), 0.0);
+    runParallel(active.size(), [&](size_t k) {
+      const double start = threadCpuSeconds();
+      const size_t i = active[k];
+      if(needs_points)
+      {
+        decodeCluster(clusters, i, points);
+      }
+      stage.plugin->classifyCluster(ClusterView(clusters.header(i),
+          clusters.summary(i), points[i]), stage_found[k]);
+      task_cpu[k] = threadCpuSeconds() - start;
+    });
+    for(size_t k = 0; k < active.size(); ++k)
+    {
+      cpu[stage.index] += task_cpu[k];
+    }
+
+    std::vector<size_t> forward;
+    for(size_t k = 0; k < active.size(); ++k)
+    {
+      const size_t i = active[k];
+      classified[i] = 1;
+      const bool unsure = bestProbability(stage_found[k]) < stage.threshold;
+      // some classifiers (like sixdof) don't give probabilities, so the
+      // latest stage with an answer wins rather than the most probable one
+      if(!stage_found[k].empty())
+      {
+        found[i].swap(stage_found[k]);
+        methods[i] = stage.method;
+      }
+      if(s < last && unsure)
+      {
+        forward.push_back(i);
+      }
+    }
+    stage.classified += active.size();
+    stage.forwarded += forward.size();
+    active.swap(forward);
+  }
+
+  if(tracker_)
+  {
+    for(size_t i = 0; i < clusters.size(); ++i)
+    {
+      if(classified[i])
+      {
+        tracker_->store(i, 0, found[i], methods[i], now);
+      }
+    }
+  }
+
+  orp::CascadeStats stats;
+  stats.header.stamp = ros::Time::now();
+  for(size_t s = 0; s < cascade_.size(); ++s)
+  {
+    const CascadeStage& stage = cascade_[s];
+    stats.methods.push_back(stage.method);
+    stats.thresholds.push_back(stage.threshold);
+    stats.classified.push_back(stage.classified);
+    stats.forwarded.push_back(stage.forwarded);
+    stats.pass_rates.push_back(stage.classified == 0 ? 0.0f :
+        static_cast<float>(stage.forwarded) / stage.classified);
+  }
+  cascade_stats_pub_.publish(stats);
+}
+
+void Classifier3D::classifyLoop()
+{
+  sensor_msgs::PointCloud2ConstPtr cloud;
+  if(segmentation_depth_ <= 0)
+  {
+    while(frame_slot_.take(cloud))
+    {
+      frame_stats_pub_.publish(
+          frame_slot_.markProcessed(cloud->header.stamp));
+      cb_classify(*cloud);
+    }
+    return;
+  }
+
+  while(true)
+  {
+    // wait for room before taking a cloud, so that the cloud sent is the
+    // newest one
+    {
+      std::unique_lock<std::mutex> lock(in_flight_mutex_);
+      in_flight_changed_.wait(lock, [this]{
+        return in_flight_.size() <
+          static_cast<size_t>(segmentation_depth_);
+      });
+    }
+    if(!frame_slot_.take(cloud))
+    {
+      break;
+    }
+    frame_stats_pub_.publish(frame_slot_.markProcessed(cloud->header.stamp));
+
+    InFlight request;
+    request.cloud = cloud;
+    request.reply = segmentAsync(*cloud,
+        attention_->focus(ros::Time::now()), request.id);
+    {
+      std::lock_guard<std::mutex> lock(in_flight_mutex_);
+      in_flight_.push_back(std::move(request));
+    }
+    in_flight_changed_.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(in_flight_mutex_);
+    requests_done_ = true;
+  }
+  in_flight_changed_.notify_all();
+}
+
+void Classifier3D::resultLoop()
+{
+  const std::chrono::duration<double> timeout(segmentation_timeout_.toSec());
+  while(true)
+  {
+    InFlight request;
+    {
+      std::unique_lock<std::mutex> lock(in_flight_mutex_);
+      in_flight_changed_.wait(lock, [this]{
+        return requests_done_ || !in_flight_.empty();
+      });
+      if(in_flight_.empty())
+      {
+        return;
+      }
+      request = std::move(in_flight_.front());
+      in_flight_.pop_front();
+    }
+    // the next request can go out while this one is classified
+    in_flight_changed_.notify_all();
+
+    if(request.reply.wait_for(timeout) != std::future_status::ready)
+    {
+      ROS_WARN_STREAM_THROTTLE(5, "No segmentation result for request "
+          << request.id << " within " << segmentation_timeout_.toSec()
+          << " s; skipping that cloud.");
+      cancelSegmentation(request.id);
+      continue;
+    }
+    SegmentationReply reply = request.reply.get();
+    if(reply.cancelled)
+    {
+      continue;
+    }
+    if(!reply.ok)
+    {
+      ROS_DEBUG("Segmentation request %u failed.", request.id);
+    }
+    classify(*request.cloud, boost::shared_ptr<orp::Segmentation::Response>(
+        new orp::Segmentation::Response(std::move(reply.response))));
+  }
+}
+
+std::future<SegmentationReply> Classifier3D::segmentAsync(
+    const sensor_msgs::PointCloud2& cloud,
+    const std::vector<orp::AttentionRegion>& attention, uint32_t& id)
+{
+  orp::SegmentationRequestPtr request(new orp::SegmentationRequest);
+  request->client = client_id_;
+  request->scene = cloud;
+  request->attention = attention;
+  request->fused = fused_scene_;
+
+  std::future<SegmentationReply> reply;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    id = next_request_id_++;
+    std::promise<SegmentationReply> &promise = pending_[id];
+    reply = promise.get_future();
+  }
+  request->id = id;
+  segmentation_request_pub_.publish(request);
+  return reply;
+}
+
+void Classifier3D::cancelSegmentation(uint32_t id)
+{
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  pending_.erase(id);
+}
+
+void Classifier3D::cancelPending()
+{
+  std::map<uint32_t, std::promise<SegmentationReply> > cancelled;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    cancelled.swap(pending_);
+  }
+  for(std::map<uint32_t, std::promise<SegmentationReply> >::iterator it =
+      cancelled.begin(); it != cancelled.end(); ++it)
+  {
+    SegmentationReply reply;
+    reply.ok = false;
+    reply.cancelled = true;
+    it->second.set_value(std::move(reply));
+  }
+}
+
+void Classifier3D::cb_segmentationResult(
+    const boost::shared_ptr<orp::SegmentationResult>& result)
+{
+  std::promise<SegmentationReply> promise;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    std::map<uint32_t, std::promise<SegmentationReply> >::iterator it =
+        pending_.find(result->id);
+    if(it == pending_.end())
+    {
+      // cancelled after timing out
+      return;
+    }
+    promise = std::move(it->second);
+    pending_.erase(it);
+  }
+
+  SegmentationReply reply;
+  reply.ok = result->success;
+  reply.cancelled = false;
+  reply.response.clusters.swap(result->clusters);
+  reply.response.compressed_clusters.swap(result->compressed_clusters);
+  reply.response.summaries.swap(result->summaries);
+  reply.response.degraded = result->degraded;
+  reply.response.degraded_stage.swap(result->degraded_stage);
+  promise.set_value(std::move(reply));
 }
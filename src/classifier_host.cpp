@@ -0,0 +1,97 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/app/classifier_host.h"
+
+#include <string>
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "classifier_host");
+
+  ClassifierHost host;
+  if(!host.loadPlugins()) {
+    ROS_FATAL("No classifier plugins could be loaded from ~plugins.");
+    return -1;
+  }
+  host.init();
+
+  ros::spin();
+  host.shutdown();
+  return 1;
+}
+
+ClassifierHost::ClassifierHost() :
+  Classifier3D(),
+  loader_("orp", "ClassifierPlugin")
+{
+}
+
+ClassifierHost::~ClassifierHost()
+{
+  // the plugins' code lives in libraries that go away with loader_, which
+  // is destroyed before the base class releases them
+  shutdown();
+  plugins_.clear();
+  cascade_.clear();
+}
+
+bool ClassifierHost::loadPlugins()
+{
+  XmlRpc::XmlRpcValue list;
+  if(!node_private_.getParam("plugins", list) ||
+     list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("~plugins must be a list of {name, type} entries.");
+    return false;
+  }
+
+  for(int i = 0; i < list.size(); ++i) {
+    XmlRpc::XmlRpcValue &entry = list[i];
+    if(entry.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+       !entry.hasMember("name") || !entry.hasMember("type"))
+    {
+      ROS_ERROR("Skipping entry %d of ~plugins, which needs a name and a "
+        "type.", i);
+      continue;
+    }
+    std::string name = static_cast<std::string>(entry["name"]);
+    std::string type = static_cast<std::string>(entry["type"]);
+    try {
+      addPlugin(loader_.createInstance(type), name);
+      ROS_INFO("Loaded classifier %s (%s)", name.c_str(), type.c_str());
+    }
+    catch(pluginlib::PluginlibException &e) {
+      ROS_ERROR("Couldn't load classifier %s (%s): %s", name.c_str(),
+        type.c_str(), e.what());
+    }
+  }
+  return !plugins_.empty();
+}
@@ -0,0 +1,198 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/classifier_scheduler.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+namespace {
+
+/// Seconds over which effective rates and CPU load are measured
+const double kWindow = 5.0;
+
+/// Weight of the newest frame in the average costs and frame interval
+const double kSmoothing = 0.2;
+
+} // namespace
+
+double threadCpuSeconds()
+{
+  timespec now;
+  if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0.0;
+  }
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+ClassifierScheduler::ClassifierScheduler(double budget, double burst) :
+  budget(budget),
+  capacity(std::max(budget, 0.0) * std::max(burst, 0.0)),
+  credit(capacity),
+  planTime(0.0),
+  started(-1.0),
+  lastFrame(-1.0),
+  frameInterval(0.0)
+{
+}
+
+void ClassifierScheduler::add(const std::string &method, int priority,
+  double targetRate)
+{
+  Entry entry;
+  entry.method = method;
+  entry.priority = priority;
+  entry.targetRate = std::max(targetRate, 0.0);
+  entry.nextDue = 0.0;
+  entry.cost = 0.0;
+  entry.measured = false;
+  entry.runs = 0;
+  entry.skipped = 0;
+  classifiers.push_back(entry);
+
+  // keep the order stable, so equal priorities go in the order added
+  order.push_back(classifiers.size() - 1);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return classifiers[a].priority > classifiers[b].priority;
+  });
+}
+
+std::vector<bool> ClassifierScheduler::plan(const ros::WallTime &now)
+{
+  const double t = now.toSec();
+  if(started < 0) {
+    started = t;
+  }
+  if(lastFrame >= 0) {
+    const double interval = t - lastFrame;
+    frameInterval = frameInterval > 0 ?
+      (1 - kSmoothing) * frameInterval + kSmoothing * interval : interval;
+    credit = std::min(capacity, credit + budget * interval);
+  }
+  lastFrame = t;
+  planTime = t;
+
+  planned.assign(classifiers.size(), false);
+  double available = credit;
+  bool first = true;
+  for(size_t k = 0; k < order.size(); ++k) {
+    Entry &entry = classifiers[order[k]];
+
+    // frames seldom arrive exactly when a classifier is due, so take the
+    // one nearest to that time
+    if(entry.targetRate > 0 && t < entry.nextDue - 0.5 * frameInterval) {
+      continue;
+    }
+
+    // something that costs more than the bucket holds can still run once
+    // the bucket is full
+    const bool affordable = budget <= 0 || !entry.measured ||
+      entry.cost <= available || (first && credit >= capacity);
+    if(!affordable) {
+      ++entry.skipped;
+      continue;
+    }
+    planned[order[k]] = true;
+    available -= entry.cost;
+    first = false;
+    if(entry.targetRate > 0) {
+      // don't catch up on frames missed while over budget
+      entry.nextDue = std::max(entry.nextDue + 1.0 / entry.targetRate, t);
+    }
+  }
+  return planned;
+}
+
+void ClassifierScheduler::finish(const std::vector<double> &cpuSeconds,
+  double overhead)
+{
+  double used = overhead;
+  for(size_t i = 0; i < classifiers.size() && i < planned.size(); ++i) {
+    if(!planned[i]) {
+      continue;
+    }
+    Entry &entry = classifiers[i];
+    const double cost = i < cpuSeconds.size() ? cpuSeconds[i] : 0.0;
+    entry.cost = entry.measured ?
+      (1 - kSmoothing) * entry.cost + kSmoothing * cost : cost;
+    entry.measured = true;
+    ++entry.runs;
+    entry.recentRuns.push_back(planTime);
+    used += cost;
+  }
+  if(budget > 0) {
+    credit -= used;
+  }
+  recentUse.push_back(std::make_pair(planTime, used));
+  trim(planTime);
+}
+
+void ClassifierScheduler::trim(double now)
+{
+  for(size_t i = 0; i < classifiers.size(); ++i) {
+    std::deque<double> &runs = classifiers[i].recentRuns;
+    while(!runs.empty() && runs.front() < now - kWindow) {
+      runs.pop_front();
+    }
+  }
+  while(!recentUse.empty() && recentUse.front().first < now - kWindow) {
+    recentUse.pop_front();
+  }
+}
+
+orp::SchedulerStats ClassifierScheduler::stats() const
+{
+  orp::SchedulerStats stats;
+  stats.header.stamp = ros::Time::now();
+  stats.cpu_budget = std::max(budget, 0.0);
+
+  // until a whole window has gone by, average over the time so far
+  const double window = started < 0 ? 0.0 :
+    std::min(kWindow, planTime - started);
+  double used = 0.0;
+  for(size_t i = 0; i < recentUse.size(); ++i) {
+    used += recentUse[i].second;
+  }
+  stats.cpu_load = window > 0 ? used / window : 0.0;
+
+  for(size_t i = 0; i < classifiers.size(); ++i) {
+    const Entry &entry = classifiers[i];
+    stats.methods.push_back(entry.method);
+    stats.priorities.push_back(entry.priority);
+    stats.target_rates.push_back(entry.targetRate);
+    stats.effective_rates.push_back(window > 0 ?
+      entry.recentRuns.size() / window : 0.0);
+    stats.costs.push_back(entry.cost);
+    stats.runs.push_back(entry.runs);
+    stats.skipped.push_back(entry.skipped);
+  }
+  return stats;
+}
@@ -0,0 +1,189 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/cloud_message_pool.h"
+
+#include <cstring>
+
+#include <pcl_conversions/pcl_conversions.h>
+
+#include "orp/core/point_traits.h"
+
+namespace {
+  sensor_msgs::PointField makeField(const std::string &name,
+    uint32_t offset)
+  {
+    sensor_msgs::PointField field;
+    field.name = name;
+    field.offset = offset;
+    field.datatype = sensor_msgs::PointField::FLOAT32;
+    field.count = 1;
+    return field;
+  }
+
+  /// Set up everything but the data and the point count.
+  void writeLayout(const std_msgs::Header &header, bool isDense,
+    bool withColor, sensor_msgs::PointCloud2 &out)
+  {
+    out.header = header;
+    // assigning over the previous (identical) fields reuses their storage
+    out.fields = CloudMessagePool::fields(withColor);
+    out.is_bigendian = false;
+    out.point_step = withColor ? CloudMessagePool::kPointStep :
+      CloudMessagePool::kGeometryPointStep;
+    out.is_dense = isDense;
+  }
+
+  template <typename PointT>
+  void writeLayout(const pcl::PointCloud<PointT> &cloud,
+    const std::string &frame, sensor_msgs::PointCloud2 &out)
+  {
+    std_msgs::Header header;
+    pcl_conversions::fromPCL(cloud.header, header);
+    header.frame_id = frame;
+    writeLayout(header, cloud.is_dense, PointTraits<PointT>::kHasColor, out);
+  }
+
+  template <typename PointT>
+  inline void writePoint(const PointT &point, uint8_t *out) {
+    memcpy(out, &point.x, 3 * sizeof(float));
+    if(PointTraits<PointT>::kHasColor) {
+      uint32_t rgba = PointTraits<PointT>::rgba(point);
+      memcpy(out + 3 * sizeof(float), &rgba, sizeof(uint32_t));
+    }
+  }
+}
+
+const uint32_t CloudMessagePool::kPointStep;
+const uint32_t CloudMessagePool::kGeometryPointStep;
+
+CloudMessagePool::CloudMessagePool() :
+  messages([](sensor_msgs::PointCloud2 &message) {
+    message.data.clear();
+    message.width = 0;
+    message.height = 0;
+  })
+{
+}
+
+CloudMessagePool::Ptr CloudMessagePool::acquire()
+{
+  return messages.acquire();
+}
+
+CloudMessagePool::Ptr CloudMessagePool::make(const CompactCloud &cloud,
+  const std_msgs::Header &header, bool withColor)
+{
+  Ptr message = acquire();
+  write(cloud, header, withColor, *message);
+  return message;
+}
+
+const std::vector<sensor_msgs::PointField>& CloudMessagePool::fields(
+  bool withColor)
+{
+  static const std::vector<sensor_msgs::PointField> shared = {
+    makeField("x", 0),
+    makeField("y", 4),
+    makeField("z", 8),
+    makeField("rgb", 12)
+  };
+  static const std::vector<sensor_msgs::PointField> geometry(
+    shared.begin(), shared.begin() + 3);
+  return withColor ? shared : geometry;
+}
+
+template <typename PointT>
+void CloudMessagePool::write(const pcl::PointCloud<PointT> &cloud,
+  const std::string &frame, sensor_msgs::PointCloud2 &out)
+{
+  writeLayout(cloud, frame, out);
+  out.width = cloud.width;
+  out.height = cloud.height;
+  if(out.width * out.height != cloud.points.size()) {
+    out.width = cloud.points.size();
+    out.height = 1;
+  }
+  out.row_step = out.width * out.point_step;
+  out.data.resize(cloud.points.size() * out.point_step);
+
+  uint8_t *data = out.data.data();
+  for(size_t i = 0; i < cloud.points.size(); ++i, data += out.point_step) {
+    writePoint(cloud.points[i], data);
+  }
+}
+
+template <typename PointT>
+void CloudMessagePool::write(const pcl::PointCloud<PointT> &cloud,
+  const std::vector<int> &indices, const std::string &frame,
+  sensor_msgs::PointCloud2 &out)
+{
+  writeLayout(cloud, frame, out);
+  out.width = indices.size();
+  out.height = 1;
+  out.row_step = out.width * out.point_step;
+  out.data.resize(indices.size() * out.point_step);
+
+  uint8_t *data = out.data.data();
+  for(size_t i = 0; i < indices.size(); ++i, data += out.point_step) {
+    writePoint(cloud.points[indices[i]], data);
+  }
+}
+
+void CloudMessagePool::write(const CompactCloud &cloud,
+  const std_msgs::Header &header, bool withColor,
+  sensor_msgs::PointCloud2 &out)
+{
+  static_assert(sizeof(CompactPoint) == kPointStep,
+    "CompactPoint must match the message layout");
+
+  writeLayout(header, true, withColor, out);
+  out.width = cloud.size();
+  out.height = 1;
+  out.row_step = out.width * out.point_step;
+  out.data.resize(cloud.size() * out.point_step);
+  if(withColor) {
+    if(!cloud.empty()) {
+      memcpy(out.data.data(), cloud.data(), out.data.size());
+    }
+    return;
+  }
+  uint8_t *data = out.data.data();
+  for(size_t i = 0; i < cloud.size(); ++i, data += kGeometryPointStep) {
+    memcpy(data, &cloud[i].x, kGeometryPointStep);
+  }
+}
+
+#define ORP_INSTANTIATE_CLOUD_MESSAGE_POOL(T) \
+  template void CloudMessagePool::write<T>(const pcl::PointCloud<T>&, \
+    const std::string&, sensor_msgs::PointCloud2&); \
+  template void CloudMessagePool::write<T>(const pcl::PointCloud<T>&, \
+    const std::vector<int>&, const std::string&, sensor_msgs::PointCloud2&);
+ORP_INSTANTIATE_POINT_TYPES(ORP_INSTANTIATE_CLOUD_MESSAGE_POOL)
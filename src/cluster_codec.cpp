@@ -0,0 +1,236 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/cluster_codec.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <Eigen/Core>
+#include <pcl_conversions/pcl_conversions.h>
+#include <ros/ros.h>
+
+#include "orp/core/cloud_message_pool.h"
+#include "orp/core/morton.h"
+#include "orp/core/point_traits.h"
+
+namespace {
+  /// The largest cell coordinate a Morton key can hold on each axis.
+  const uint32_t kMaxCell = (1u << Morton::kAxisBits) - 1;
+
+  void appendVarint(uint64_t value, std::vector<uint8_t> &out) {
+    while(value >= 0x80) {
+      out.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+  }
+
+  bool readVarint(const std::vector<uint8_t> &in, size_t &pos,
+    uint64_t &value)
+  {
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+      if(pos >= in.size()) return false;
+      uint8_t byte = in[pos++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if(!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+}
+
+template <typename PointT>
+void ClusterCodec::encode(const pcl::PointCloud<PointT> &cloud,
+  const std::vector<int> &indices, float resolution,
+  const std::string &frame, orp::CompressedCluster &out)
+{
+  pcl_conversions::fromPCL(cloud.header, out.header);
+  out.header.frame_id = frame;
+  out.point_count = indices.size();
+  out.has_color = PointTraits<PointT>::kHasColor;
+  out.data.clear();
+
+  Eigen::Vector3f min = Eigen::Vector3f::Constant(
+    std::numeric_limits<float>::max());
+  Eigen::Vector3f max = -min;
+  for(size_t i = 0; i < indices.size(); ++i) {
+    Eigen::Vector3f p = cloud.points[indices[i]].getVector3fMap();
+    min = min.cwiseMin(p);
+    max = max.cwiseMax(p);
+  }
+  if(indices.empty()) {
+    min.setZero();
+    max.setZero();
+  }
+
+  float extent = (max - min).maxCoeff();
+  resolution = std::max(resolution, extent / kMaxCell);
+  if(resolution <= 0) {
+    // a single point, or every point in the same place
+    resolution = 1.0f;
+  }
+  out.resolution = resolution;
+  out.origin.x = min.x();
+  out.origin.y = min.y();
+  out.origin.z = min.z();
+
+  std::vector<std::pair<uint64_t, int> > order(indices.size());
+  for(size_t i = 0; i < indices.size(); ++i) {
+    Eigen::Vector3f cell =
+      (cloud.points[indices[i]].getVector3fMap() - min) / resolution;
+    uint32_t x = std::min<uint32_t>(cell.x() + 0.5f, kMaxCell);
+    uint32_t y = std::min<uint32_t>(cell.y() + 0.5f, kMaxCell);
+    uint32_t z = std::min<uint32_t>(cell.z() + 0.5f, kMaxCell);
+    order[i] = std::make_pair(Morton::encode(x, y, z), indices[i]);
+  }
+  std::sort(order.begin(), order.end());
+
+  // most deltas in a dense cluster fit in one or two bytes
+  out.data.reserve(order.size() * (out.has_color ? 5 : 2));
+  uint64_t previous = 0;
+  for(size_t i = 0; i < order.size(); ++i) {
+    appendVarint(order[i].first - previous, out.data);
+    previous = order[i].first;
+  }
+  if(PointTraits<PointT>::kHasColor) {
+    for(size_t i = 0; i < order.size(); ++i) {
+      uint32_t rgba = PointTraits<PointT>::rgba(cloud.points[order[i].second]);
+      out.data.push_back((rgba >> 16) & 0xff);
+      out.data.push_back((rgba >> 8) & 0xff);
+      out.data.push_back(rgba & 0xff);
+    }
+  }
+}
+
+bool ClusterCodec::decode(const orp::CompressedCluster &in, CompactCloud &out)
+{
+  // Every point takes at least one byte of key (and three of color), so a
+  // larger count is corrupt. Check before allocating anything for it.
+  size_t bytesPerPoint = in.has_color ? 4 : 1;
+  if(in.point_count > in.data.size() / bytesPerPoint) {
+    out.clear();
+    return false;
+  }
+  out.resize(in.point_count);
+  const Eigen::Vector3f origin(in.origin.x, in.origin.y, in.origin.z);
+
+  size_t pos = 0;
+  uint64_t key = 0;
+  for(size_t i = 0; i < out.size(); ++i) {
+    uint64_t delta;
+    if(!readVarint(in.data, pos, delta)) {
+      out.clear();
+      return false;
+    }
+    key += delta;
+    uint32_t x, y, z;
+    Morton::decode(key, x, y, z);
+    out[i].x = origin.x() + x * in.resolution;
+    out[i].y = origin.y() + y * in.resolution;
+    out[i].z = origin.z() + z * in.resolution;
+    out[i].rgba = 0;
+  }
+
+  if(in.has_color) {
+    if(in.data.size() - pos != 3 * out.size()) {
+      out.clear();
+      return false;
+    }
+    const uint8_t *color = in.data.data() + pos;
+    for(size_t i = 0; i < out.size(); ++i, color += 3) {
+      out[i].rgba = 0xff000000u | (color[0] << 16) | (color[1] << 8) |
+        color[2];
+    }
+  }
+  else if(pos != in.data.size()) {
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
+bool ClusterCodec::decode(const orp::CompressedCluster &in,
+  sensor_msgs::PointCloud2 &out)
+{
+  CompactCloud points;
+  bool ok = decode(in, points);
+  CloudMessagePool::write(points, in.header, in.has_color, out);
+  return ok;
+}
+
+ClusterSet::ClusterSet(const orp::Segmentation::Response &response) :
+  response(response),
+  compressed(!response.compressed_clusters.empty())
+{
+  if(compressed) {
+    decoded.resize(response.compressed_clusters.size());
+    isDecoded.resize(response.compressed_clusters.size(), false);
+  }
+}
+
+size_t ClusterSet::size() const
+{
+  return compressed ? response.compressed_clusters.size() :
+    response.clusters.size();
+}
+
+const std_msgs::Header& ClusterSet::header(size_t i) const
+{
+  return compressed ? response.compressed_clusters[i].header :
+    response.clusters[i].header;
+}
+
+const orp::ClusterSummary& ClusterSet::summary(size_t i) const
+{
+  return response.summaries[i];
+}
+
+const sensor_msgs::PointCloud2& ClusterSet::cloud(size_t i)
+{
+  if(!compressed) {
+    return response.clusters[i];
+  }
+  if(!isDecoded[i]) {
+    if(!ClusterCodec::decode(response.compressed_clusters[i], decoded[i])) {
+      ROS_WARN("Compressed cluster %lu is corrupt; treating it as empty.",
+        static_cast<unsigned long>(i));
+    }
+    isDecoded[i] = true;
+  }
+  return decoded[i];
+}
+
+#define ORP_INSTANTIATE_CLUSTER_CODEC(T) \
+  template void ClusterCodec::encode<T>(const pcl::PointCloud<T>&, \
+    const std::vector<int>&, float, const std::string&, \
+    orp::CompressedCluster&);
+ORP_INSTANTIATE_POINT_TYPES(ORP_INSTANTIATE_CLUSTER_CODEC)
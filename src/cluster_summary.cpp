@@ -0,0 +1,192 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/cluster_summary.h"
+
+#include <limits>
+
+#include <Eigen/Eigenvalues>
+
+#include "orp/core/point_traits.h"
+
+namespace {
+  template <typename PointT>
+  inline bool isValid(const PointT &pt) {
+    return pcl_isfinite(pt.x) && pcl_isfinite(pt.y) && pcl_isfinite(pt.z);
+  }
+
+  /// Running totals for one pass over a cluster.
+  struct Accumulator {
+    /// sum of [x y z 1] * [x y z 1]^T. The last column holds the coordinate
+    /// sums (and the point count in the corner), so the centroid and the
+    /// covariance both come out of this one matrix.
+    Eigen::Matrix4d moments;
+    Eigen::Vector4f min;
+    Eigen::Vector4f max;
+    Eigen::Vector4d color;
+
+    Accumulator() :
+      moments(Eigen::Matrix4d::Zero()),
+      min(Eigen::Vector4f::Constant(std::numeric_limits<float>::max())),
+      max(Eigen::Vector4f::Constant(-std::numeric_limits<float>::max())),
+      color(Eigen::Vector4d::Zero())
+    {
+    }
+
+    template <typename PointT>
+    inline void add(const PointT &pt) {
+      if(!isValid(pt)) {
+        return;
+      }
+      Eigen::Vector4f p = pt.getVector4fMap();
+      p[3] = 1.0f;
+      Eigen::Vector4d pd = p.cast<double>();
+      moments.noalias() += pd * pd.transpose();
+      min = min.cwiseMin(p);
+      max = max.cwiseMax(p);
+      if(PointTraits<PointT>::kHasColor) {
+        uint32_t rgba = PointTraits<PointT>::rgba(pt);
+        color += Eigen::Vector4d((rgba >> 16) & 0xff, (rgba >> 8) & 0xff,
+          rgba & 0xff, 0);
+      }
+    }
+  };
+
+  template <typename PointT>
+  orp::ClusterSummary finish(const Accumulator &acc,
+    const pcl::PointCloud<PointT> &cloud,
+    const std::vector<int> *indices)
+  {
+    orp::ClusterSummary summary;
+    double count = acc.moments(3, 3);
+    summary.point_count = static_cast<uint32_t>(count);
+    if(summary.point_count == 0) {
+      summary.obb_pose.orientation.w = 1;
+      return summary;
+    }
+
+    Eigen::Vector3d centroid = acc.moments.block<3, 1>(0, 3) / count;
+    summary.centroid.x = centroid[0];
+    summary.centroid.y = centroid[1];
+    summary.centroid.z = centroid[2];
+
+    summary.aabb_min.x = acc.min[0];
+    summary.aabb_min.y = acc.min[1];
+    summary.aabb_min.z = acc.min[2];
+    summary.aabb_max.x = acc.max[0];
+    summary.aabb_max.y = acc.max[1];
+    summary.aabb_max.z = acc.max[2];
+
+    Eigen::Vector4d meanColor = acc.color / count;
+    summary.mean_r = meanColor[0];
+    summary.mean_g = meanColor[1];
+    summary.mean_b = meanColor[2];
+    ORPUtils::hsvFromRgb(summary.mean_r, summary.mean_g, summary.mean_b,
+      summary.mean_h, summary.mean_s, summary.mean_v);
+
+    // Principal axes, ordered from major to minor, forming a right-handed
+    // frame.
+    Eigen::Matrix3d covariance =
+      acc.moments.topLeftCorner<3, 3>() / count -
+      centroid * centroid.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Matrix3d axes;
+    axes.col(0) = solver.eigenvectors().col(2);
+    axes.col(1) = solver.eigenvectors().col(1);
+    axes.col(2) = axes.col(0).cross(axes.col(1));
+
+    // Second pass: extents of the cluster along the principal axes.
+    Eigen::Matrix3f toAxes = axes.transpose().cast<float>();
+    Eigen::Vector3f origin = centroid.cast<float>();
+    Eigen::Vector3f obbMin = Eigen::Vector3f::Constant(
+      std::numeric_limits<float>::max());
+    Eigen::Vector3f obbMax = -obbMin;
+    size_t n = indices ? indices->size() : cloud.points.size();
+    for(size_t i = 0; i < n; ++i) {
+      const PointT &pt = cloud.points[indices ? (*indices)[i] : i];
+      if(!isValid(pt)) {
+        continue;
+      }
+      Eigen::Vector3f projected = toAxes * (pt.getVector3fMap() - origin);
+      obbMin = obbMin.cwiseMin(projected);
+      obbMax = obbMax.cwiseMax(projected);
+    }
+
+    Eigen::Vector3d obbCenter =
+      centroid + axes * ((obbMin + obbMax) / 2.0f).cast<double>();
+    Eigen::Quaterniond obbRotation(axes);
+    obbRotation.normalize();
+    summary.obb_pose.position.x = obbCenter[0];
+    summary.obb_pose.position.y = obbCenter[1];
+    summary.obb_pose.position.z = obbCenter[2];
+    summary.obb_pose.orientation.x = obbRotation.x();
+    summary.obb_pose.orientation.y = obbRotation.y();
+    summary.obb_pose.orientation.z = obbRotation.z();
+    summary.obb_pose.orientation.w = obbRotation.w();
+    summary.obb_dimensions.x = obbMax[0] - obbMin[0];
+    summary.obb_dimensions.y = obbMax[1] - obbMin[1];
+    summary.obb_dimensions.z = obbMax[2] - obbMin[2];
+
+    return summary;
+  }
+}
+
+template <typename PointT>
+orp::ClusterSummary ClusterSummaries::summarize(
+  const pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices)
+{
+  Accumulator acc;
+  for(std::vector<int>::const_iterator it = indices.begin();
+      it != indices.end(); ++it)
+  {
+    acc.add(cloud.points[*it]);
+  }
+  return finish(acc, cloud, &indices);
+}
+
+template <typename PointT>
+orp::ClusterSummary ClusterSummaries::summarize(
+  const pcl::PointCloud<PointT> &cloud)
+{
+  Accumulator acc;
+  for(typename pcl::PointCloud<PointT>::const_iterator it = cloud.begin();
+      it != cloud.end(); ++it)
+  {
+    acc.add(*it);
+  }
+  return finish(acc, cloud, NULL);
+}
+
+#define ORP_INSTANTIATE_CLUSTER_SUMMARIES(T) \
+  template orp::ClusterSummary ClusterSummaries::summarize<T>( \
+    const pcl::PointCloud<T>&, const std::vector<int>&); \
+  template orp::ClusterSummary ClusterSummaries::summarize<T>( \
+    const pcl::PointCloud<T>&);
+ORP_INSTANTIATE_POINT_TYPES(ORP_INSTANTIATE_CLUSTER_SUMMARIES)
@@ -0,0 +1,169 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/cluster_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double distance(const geometry_msgs::Point &a, const geometry_msgs::Point &b)
+{
+  const double dx = a.x - b.x;
+  const double dy = a.y - b.y;
+  const double dz = a.z - b.z;
+  return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/// Whether b is within fraction of a. Tiny values are compared against a
+/// floor so that noise on a thin side doesn't count as a change.
+bool near(double a, double b, double fraction, double floor)
+{
+  return std::fabs(b - a) <= fraction * std::max(std::fabs(a), floor);
+}
+
+/// A possible match between a track and a new cluster.
+struct Candidate {
+  double distance;
+  size_t track;
+  size_t cluster;
+
+  bool operator<(const Candidate &other) const {
+    return distance < other.distance;
+  }
+};
+
+} // namespace
+
+ClusterTracker::Params::Params() :
+  maxDistance(0.03),
+  maxExtentChange(0.2),
+  maxCountChange(0.3),
+  refresh(2.0),
+  drift(0.01)
+{
+}
+
+ClusterTracker::ClusterTracker(const Params &params, size_t slots) :
+  params(params),
+  slots(slots),
+  nextId(0)
+{
+}
+
+bool ClusterTracker::similar(const orp::ClusterSummary &previous,
+  const orp::ClusterSummary &current) const
+{
+  // 1 cm keeps a flat object's thickness from deciding the match
+  const double floor = 0.01;
+  return
+    near(previous.aabb_max.x - previous.aabb_min.x,
+      current.aabb_max.x - current.aabb_min.x, params.maxExtentChange,
+      floor) &&
+    near(previous.aabb_max.y - previous.aabb_min.y,
+      current.aabb_max.y - current.aabb_min.y, params.maxExtentChange,
+      floor) &&
+    near(previous.aabb_max.z - previous.aabb_min.z,
+      current.aabb_max.z - current.aabb_min.z, params.maxExtentChange,
+      floor) &&
+    near(previous.point_count, current.point_count, params.maxCountChange,
+      1.0);
+}
+
+void ClusterTracker::update(const std::vector<orp::ClusterSummary> &summaries)
+{
+  // closest pairs first; each track and cluster is matched at most once
+  std::vector<Candidate> candidates;
+  for(size_t t = 0; t < tracks.size(); ++t) {
+    for(size_t c = 0; c < summaries.size(); ++c) {
+      const double d = distance(tracks[t].summary.centroid,
+        summaries[c].centroid);
+      if(d <= params.maxDistance &&
+         similar(tracks[t].summary, summaries[c]))
+      {
+        Candidate candidate = {d, t, c};
+        candidates.push_back(candidate);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  std::vector<Track> updated(summaries.size());
+  std::vector<bool> trackUsed(tracks.size(), false);
+  std::vector<bool> clusterUsed(summaries.size(), false);
+  for(size_t k = 0; k < candidates.size(); ++k) {
+    const Candidate &candidate = candidates[k];
+    if(trackUsed[candidate.track] || clusterUsed[candidate.cluster]) {
+      continue;
+    }
+    trackUsed[candidate.track] = true;
+    clusterUsed[candidate.cluster] = true;
+    Track &track = updated[candidate.cluster];
+    track.id = tracks[candidate.track].id;
+    track.matched = true;
+    track.results.swap(tracks[candidate.track].results);
+  }
+
+  for(size_t c = 0; c < summaries.size(); ++c) {
+    Track &track = updated[c];
+    if(!clusterUsed[c]) {
+      track.id = nextId++;
+      track.matched = false;
+      track.results.resize(slots);
+      for(size_t s = 0; s < slots; ++s) {
+        track.results[s].valid = false;
+      }
+    }
+    track.summary = summaries[c];
+  }
+  tracks.swap(updated);
+}
+
+bool ClusterTracker::fresh(size_t i, size_t slot, const ros::Time &now) const
+{
+  const Track &track = tracks[i];
+  const Result &result = track.results[slot];
+  return result.valid &&
+    (now - result.time).toSec() < params.refresh &&
+    distance(result.centroid, track.summary.centroid) < params.drift;
+}
+
+void ClusterTracker::store(size_t i, size_t slot,
+  const std::vector<orp::WorldObject> &objects, const std::string &method,
+  const ros::Time &now)
+{
+  Result &result = tracks[i].results[slot];
+  result.valid = true;
+  result.objects = objects;
+  result.method = method;
+  result.time = now;
+  result.centroid = tracks[i].summary.centroid;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/compact_point.h"
+
+#include <cmath>
+
+PointQuantizer::PointQuantizer(const Eigen::Vector3f &minBound,
+  const Eigen::Vector3f &maxBound)
+{
+  center = 0.5f * (minBound + maxBound);
+  step = (maxBound - minBound) / 65535.0f;
+  step = step.cwiseMax(Eigen::Vector3f::Constant(1e-9f));
+  inverseStep = step.cwiseInverse();
+}
+
+QuantizedPoint PointQuantizer::quantize(const CompactPoint &point) const
+{
+  Eigen::Vector3f q =
+    ((Eigen::Vector3f(point.x, point.y, point.z) - center).cwiseProduct(
+      inverseStep)).array().round().matrix();
+  q = q.cwiseMax(Eigen::Vector3f::Constant(-32768.0f)).cwiseMin(
+    Eigen::Vector3f::Constant(32767.0f));
+
+  QuantizedPoint out;
+  out.rgba = point.rgba;
+  out.x = static_cast<int16_t>(q[0]);
+  out.y = static_cast<int16_t>(q[1]);
+  out.z = static_cast<int16_t>(q[2]);
+  out.reserved = 0;
+  return out;
+}
+
+CompactPoint PointQuantizer::dequantize(const QuantizedPoint &point) const
+{
+  CompactPoint out;
+  out.x = center[0] + point.x * step[0];
+  out.y = center[1] + point.y * step[1];
+  out.z = center[2] + point.z * step[2];
+  out.rgba = point.rgba;
+  return out;
+}
+
+void PointQuantizer::quantize(const CompactCloud &in,
+  QuantizedCloud &out) const
+{
+  out.resize(in.size());
+  for(size_t i = 0; i < in.size(); ++i) {
+    out[i] = quantize(in[i]);
+  }
+}
+
+void PointQuantizer::dequantize(const QuantizedCloud &in,
+  CompactCloud &out) const
+{
+  out.resize(in.size());
+  for(size_t i = 0; i < in.size(); ++i) {
+    out[i] = dequantize(in[i]);
+  }
+}
+
+int CompactClouds::fieldOffset(const sensor_msgs::PointCloud2 &cloud,
+  const std::string &name)
+{
+  for(size_t i = 0; i < cloud.fields.size(); ++i) {
+    if(cloud.fields[i].name == name) {
+      return cloud.fields[i].offset;
+    }
+  }
+  return -1;
+}
+
+bool CompactClouds::decode(const sensor_msgs::PointCloud2 &cloud,
+  const Eigen::Affine3f &transform,
+  const Eigen::Vector3f &minBound, const Eigen::Vector3f &maxBound,
+  CompactCloud &out, bool withColor)
+{
+  out.clear();
+  out.reserve(cloud.width * cloud.height);
+  return forEachPoint(cloud, transform, minBound, maxBound, withColor,
+    [&out](const CompactPoint &point) { out.push_back(point); });
+}
+
+bool CompactClouds::hasColor(const sensor_msgs::PointCloud2 &cloud)
+{
+  return fieldOffset(cloud, "rgb") >= 0 || fieldOffset(cloud, "rgba") >= 0;
+}
+
+ORPPoint CompactClouds::toORPPoint(const CompactPoint &point)
+{
+  ORPPoint out;
+  out.x = point.x;
+  out.y = point.y;
+  out.z = point.z;
+  out.rgba = point.rgba;
+  return out;
+}
+
+CompactPoint CompactClouds::fromORPPoint(const ORPPoint &point)
+{
+  CompactPoint out;
+  out.x = point.x;
+  out.y = point.y;
+  out.z = point.z;
+  out.rgba = point.rgba;
+  return out;
+}
+
+void CompactClouds::toPC(const CompactCloud &in, PC &out)
+{
+  out.points.resize(in.size());
+  for(size_t i = 0; i < in.size(); ++i) {
+    out.points[i] = toORPPoint(in[i]);
+  }
+  out.width = out.points.size();
+  out.height = 1;
+  out.is_dense = true;
+}
@@ -32,44 +32,32 @@
 
 #include <sstream>
 
-/**
- * Starts up the name and handles command-line arguments.
- * @param  argc num args
- * @param  argv args
- * @return      1 if all is well.
- */
-int main(int argc, char **argv)
-{
-  ros::init(argc, argv, "cylinder_classifier");
-
-  ROS_INFO("Starting Cylinder Classifier");
-  CylinderClassifier v;
-  v.init();
-
-  ros::AsyncSpinner spinner(2);
-  spinner.start();
-
-  ros::waitForShutdown();
-  return 1;
-} //main
+#include <pluginlib/class_list_macros.h>
 
 CylinderClassifier::CylinderClassifier():
-  Classifier3D(),
   normalDistanceWeight(0.1),
   maxIterations(10000),
   distanceThreshold(0.05),
   minRadius(0.0005),
   maxRadius(0.1)
+{
+}
+
+void CylinderClassifier::initialize(ros::NodeHandle& node,
+  ros::NodeHandle& node_private)
 {
   //dynamic reconfigure
+  reconfigureServer.reset(new dynamic_reconfigure::Server<
+      orp::CylinderClassifierConfig>(node_private));
   reconfigureCallbackType =
       boost::bind(&CylinderClassifier::paramsChanged, this, _1, _2);
-  reconfigureServer.setCallback(reconfigureCallbackType);
+  reconfigureServer->setCallback(reconfigureCallbackType);
 }
 
 void CylinderClassifier::paramsChanged(
     orp::CylinderClassifierConfig &config, uint32_t level)
 {
+  std::lock_guard<std::mutex> lock(paramsMutex);
   normalDistanceWeight = config.normal_distance_weight;
   maxIterations = config.max_iterations;
   distanceThreshold = config.distance_threshold;
@@ -78,86 +66,77 @@ void CylinderClassifier::paramsChanged(
 
 }
 
-void CylinderClassifier::cb_classify(const sensor_msgs::PointCloud2& cloud) {
-  orp::ClassificationResult classRes;
-  classRes.method = "cylinder";
-
-  orp::Segmentation seg_srv;
-  seg_srv.request.scene = cloud;
-  segmentation_client_.call(seg_srv);
-  std::vector<sensor_msgs::PointCloud2> clouds = seg_srv.response.clusters;
-
-  if(!clouds.empty()) {
-    for(std::vector<sensor_msgs::PointCloud2>::iterator eachCloud = clouds.begin(); eachCloud != clouds.end(); eachCloud++) {
-      orp::WorldObject thisObject;
-      if(eachCloud->width < 3) {
-        // cloud is too small to perform model estimation
-        continue;
-      }
-      pcl::PointCloud<ORPPoint>::Ptr thisCluster (new pcl::PointCloud<ORPPoint>);
-      pcl::fromROSMsg(*eachCloud, *thisCluster);
-
-      Eigen::Vector4f clusterCentroid;
-      pcl::compute3DCentroid(*thisCluster, clusterCentroid);
-
-      pcl::PointCloud<pcl::Normal>::Ptr thisClusterNormals (new pcl::PointCloud<pcl::Normal>);
-      pcl::NormalEstimation<ORPPoint, pcl::Normal> ne;
-
-      pcl::search::KdTree<ORPPoint>::Ptr tree (new pcl::search::KdTree<ORPPoint> ());
-      ne.setSearchMethod (tree);
-      ne.setInputCloud (thisCluster);
-      ne.setKSearch (50);
-      ne.compute (*thisClusterNormals);
-
-      seg.setOptimizeCoefficients (true);
-      seg.setModelType (pcl::SACMODEL_CYLINDER);
-      seg.setMethodType (pcl::SAC_RANSAC);
-      seg.setNormalDistanceWeight (normalDistanceWeight);
-      seg.setMaxIterations (maxIterations);
-      seg.setDistanceThreshold (distanceThreshold);
-      seg.setRadiusLimits (minRadius, maxRadius);
-      seg.setInputCloud (thisCluster);
-      seg.setInputNormals (thisClusterNormals);
-
-      pcl::ModelCoefficients::Ptr coefficients_cylinder (new pcl::ModelCoefficients);
-      pcl::PointIndices::Ptr inliers_cylinder (new pcl::PointIndices);
-      seg.segment (*inliers_cylinder, *coefficients_cylinder);
-      // std::cerr << "Cylinder coefficients: " << *coefficients_cylinder << std::endl;
-
-      Eigen::Affine3d finalPose;
-
-      finalPose(0,3) = coefficients_cylinder->values[0];
-      finalPose(1,3) = coefficients_cylinder->values[1];
-
-      // the z value is so special because the cylinder model has infinite
-      // height. So instead we take the midway point between the highest-z and
-      // lowest-z points as the center. Using a centroid-based approach
-      // wouldn't work because sometimes we can see the top/bottom of the
-      // object, which would throw us off.
-      //
-      // TODO(kukanani): fix this to work for arbitrary axis orientations by
-      //   finding the principal components, generating bounding box, etc.
-      ORPPoint min_pt, max_pt;
-      pcl::getMinMax3D(*thisCluster, min_pt, max_pt);
-
-      finalPose(2,3) = (max_pt.z + min_pt.z)/2.0f;
-
-      // http://answers.ros.org/question/31006/how-can-a-vector3-axis-be-used-to-produce-a-quaternion/
-      Eigen::Vector3d start_vector(0.0, 0.0, 1.0); //cylinder default axis orientation: up
-      Eigen::Vector3d axis_vector(coefficients_cylinder->values[3],
-                                  coefficients_cylinder->values[3], // 4?
-                                  coefficients_cylinder->values[5]);
-      Eigen::Quaterniond rotation;
-      rotation.setFromTwoVectors(start_vector, axis_vector).normalize();
-      Eigen::Matrix3d rotMat; rotMat = rotation;
-      finalPose.linear() = rotMat;
-
-      tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
-
-      // Use some default object type for now.
-      thisObject.label = "obj_red";
-      classRes.result.push_back(thisObject);
-    }
+void CylinderClassifier::classifyCluster(const ClusterView& cluster,
+  std::vector<orp::WorldObject>& objects)
+{
+  orp::WorldObject thisObject;
+  const orp::ClusterSummary& summary = cluster.summary();
+  if(summary.point_count < 3) {
+    // cloud is too small to perform model estimation
+    return;
+  }
+  const pcl::PointCloud<GeometryPoint>::ConstPtr& thisCluster =
+    cluster.points();
+
+  pcl::PointCloud<pcl::Normal>::Ptr thisClusterNormals (new pcl::PointCloud<pcl::Normal>);
+  pcl::NormalEstimation<GeometryPoint, pcl::Normal> ne;
+
+  pcl::search::KdTree<GeometryPoint>::Ptr tree (new pcl::search::KdTree<GeometryPoint> ());
+  ne.setSearchMethod (tree);
+  ne.setInputCloud (thisCluster);
+  ne.setKSearch (50);
+  ne.compute (*thisClusterNormals);
+
+  // one per call, since clusters are classified in parallel
+  pcl::SACSegmentationFromNormals<GeometryPoint, pcl::Normal> seg;
+  seg.setOptimizeCoefficients (true);
+  seg.setModelType (pcl::SACMODEL_CYLINDER);
+  seg.setMethodType (pcl::SAC_RANSAC);
+  {
+    std::lock_guard<std::mutex> lock(paramsMutex);
+    seg.setNormalDistanceWeight (normalDistanceWeight);
+    seg.setMaxIterations (maxIterations);
+    seg.setDistanceThreshold (distanceThreshold);
+    seg.setRadiusLimits (minRadius, maxRadius);
   }
-  classification_pub_.publish(classRes);
-}
\ No newline at end of file
+  seg.setInputCloud (thisCluster);
+  seg.setInputNormals (thisClusterNormals);
+
+  pcl::ModelCoefficients::Ptr coefficients_cylinder (new pcl::ModelCoefficients);
+  pcl::PointIndices::Ptr inliers_cylinder (new pcl::PointIndices);
+  seg.segment (*inliers_cylinder, *coefficients_cylinder);
+  // std::cerr << "Cylinder coefficients: " << *coefficients_cylinder << std::endl;
+
+  Eigen::Affine3d finalPose;
+
+  finalPose(0,3) = coefficients_cylinder->values[0];
+  finalPose(1,3) = coefficients_cylinder->values[1];
+
+  // the z value is so special because the cylinder model has infinite
+  // height. So instead we take the midway point between the highest-z and
+  // lowest-z points as the center. Using a centroid-based approach
+  // wouldn't work because sometimes we can see the top/bottom of the
+  // object, which would throw us off.
+  //
+  // TODO(kukanani): fix this to work for arbitrary axis orientations by
+  //   finding the principal components, generating bounding box, etc.
+  finalPose(2,3) = (summary.aabb_max.z + summary.aabb_min.z)/2.0f;
+
+  // http://answers.ros.org/question/31006/how-can-a-vector3-axis-be-used-to-produce-a-quaternion/
+  Eigen::Vector3d start_vector(0.0, 0.0, 1.0); //cylinder default axis orientation: up
+  Eigen::Vector3d axis_vector(coefficients_cylinder->values[3],
+                              coefficients_cylinder->values[3], // 4?
+                              coefficients_cylinder->values[5]);
+  Eigen::Quaterniond rotation;
+  rotation.setFromTwoVectors(start_vector, axis_vector).normalize();
+  Eigen::Matrix3d rotMat; rotMat = rotation;
+  finalPose.linear() = rotMat;
+
+  tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
+
+  // Use some default object type for now.
+  thisObject.label = "obj_red";
+  objects.push_back(thisObject);
+}
+
+PLUGINLIB_EXPORT_CLASS(CylinderClassifier, ClassifierPlugin)
@@ -0,0 +1,109 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/frame_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+  std::atomic<uint64_t> scratchGrowth(0);
+}
+
+void ScratchGrowth::count()
+{
+  ++scratchGrowth;
+}
+
+uint64_t ScratchGrowth::total()
+{
+  return scratchGrowth;
+}
+
+FrameArena::FrameArena(size_t blockSize) :
+  offset(0),
+  bytesUsed(0)
+{
+  addBlock(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+  for(size_t i = 0; i < blocks.size(); ++i) {
+    std::free(blocks[i]);
+  }
+}
+
+void FrameArena::addBlock(size_t minBytes)
+{
+  size_t size = blockSizes.empty() ? minBytes :
+    std::max(minBytes, 2 * blockSizes.back());
+  char *block = static_cast<char*>(std::malloc(size));
+  if(!block) {
+    throw std::bad_alloc();
+  }
+  blocks.push_back(block);
+  blockSizes.push_back(size);
+  offset = 0;
+  ScratchGrowth::count();
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+  // malloc'd blocks are aligned to at least 16 bytes, so aligning the offset
+  // aligns the address
+  size_t start = (offset + alignment - 1) & ~(alignment - 1);
+  if(start + bytes > blockSizes.back()) {
+    addBlock(bytes + alignment);
+    start = 0;
+  }
+  offset = start + bytes;
+  bytesUsed += bytes;
+  return blocks.back() + start;
+}
+
+void FrameArena::reset()
+{
+  if(blocks.size() > 1) {
+    // This frame didn't fit in one block; make one that would have.
+    size_t total = 0;
+    for(size_t i = 0; i < blocks.size(); ++i) {
+      total += blockSizes[i];
+      std::free(blocks[i]);
+    }
+    blocks.clear();
+    blockSizes.clear();
+    addBlock(total);
+  }
+  offset = 0;
+  bytesUsed = 0;
+}
@@ -101,12 +101,13 @@ bool HistogramSaver::cb_saveCloud(orp::SaveCloud::Request &req,
 
   segClient.call(segSrvCall);
 
-  if(segSrvCall.response.clusters.size() < 1) {
+  ClusterSet clusters(segSrvCall.response);
+  if(clusters.size() < 1) {
     ROS_ERROR("no points returned from segmentation node.");
     return false;
   }
   pcl::PointCloud<ORPPoint>::Ptr cluster (new pcl::PointCloud<ORPPoint>);
-  pcl::fromROSMsg(segSrvCall.response.clusters.at(0), *cluster);
+  pcl::fromROSMsg(clusters.cloud(0), *cluster);
   return saveCloud(cluster, req.objectName, req.angle);
 } //cb_saveCloud
 
@@ -30,6 +30,7 @@
 
 #include <eigen_conversions/eigen_msg.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pluginlib/class_list_macros.h>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "orp/core/orp_utils.h"
@@ -39,38 +40,16 @@
 #include <sstream>
 #include <cmath>
 
-int main(int argc, char **argv)
+void HueClassifier::initialize(ros::NodeHandle& node,
+  ros::NodeHandle& node_private)
 {
-  // Start up the name and handle command-line arguments.
-  srand (static_cast <unsigned> (time(0)));
-
-  ros::init(argc, argv, "rgb_classifier");
-
-  ROS_INFO("Starting Hue Classifier");
-  HueClassifier v;
-  v.init();
-
-  // for cluster visualization
-  //cv::namedWindow( "RGBCluster", cv::WINDOW_NORMAL );
-  ros::AsyncSpinner spinner(1);
-  spinner.start();
-
-  ros::waitForShutdown();
-  //cv::destroyAllWindows();
-  return 1;
+  loadTypeList(node);
 }
 
-
-HueClassifier::HueClassifier():
-  Classifier3D()
-{
-  loadTypeList();
-}
-
-void HueClassifier::loadTypeList()
+void HueClassifier::loadTypeList(ros::NodeHandle& node)
 {
   XmlRpc::XmlRpcValue paramMap;
-  while(!node_.getParam("items", paramMap)) {
+  while(!node.getParam("items", paramMap)) {
     ROS_INFO_DELAYED_THROTTLE(5.0,
                       "Waiting for object type list on parameter server...");
     ros::Duration(1.0).sleep();
@@ -122,116 +101,54 @@ void HueClassifier::loadTypeList()
   }
 }
 
-void HueClassifier::cb_classify(const sensor_msgs::PointCloud2& cloud)
+void HueClassifier::classifyCluster(const ClusterView& cluster,
+  std::vector<orp::WorldObject>& objects)
 {
-  ROS_DEBUG_NAMED("Hue Classfiier",
-      "Received point cloud to classify objects by hue");
-
-  orp::ClassificationResult classRes;
-  classRes.method = "hsv";
-
-  orp::Segmentation seg_srv;
-  seg_srv.request.scene = cloud;
-
-  {
-    std::lock_guard<std::mutex> lock(segmentation_mutex_);
-    bool segmentation_succeeded = segmentation_client_.call(seg_srv);
-    if(!segmentation_succeeded)
-    {
-      ROS_ERROR_STREAM_THROTTLE_NAMED(5, "Hue Classifier", "Could not call segmentation service at " << segmentation_service_);
-    }
+  const orp::ClusterSummary& summary = cluster.summary();
+  if(summary.point_count < 3) {
+    return;
   }
-  std::vector<sensor_msgs::PointCloud2> cloudMessages = seg_srv.response.clusters;
-
-  int numClouds = cloudMessages.size();
-  if(!cloudMessages.empty()) {
-    int cloudCounter = 0;
-    for(const auto& cloudMessage : cloudMessages)
-    {
-      if(cloudMessage.width < 3) {
-        continue;
-      }
-      pcl::PointCloud<ORPPoint>::Ptr cloudPtr(
-          new pcl::PointCloud<ORPPoint>);
-      pcl::fromROSMsg(cloudMessage, *cloudPtr);
-
-      std::string color = "unknown";
-      cv::Mat M = cv::Mat(cloudPtr->points.size(), 1, CV_8UC3);
-
-      int i=0;
-      for(const auto& point : cloudPtr->points)
-      {
-        M.at<cv::Vec3b>(0, i) =
-          cv::Vec3b(static_cast<uint8_t>(point.b), static_cast<uint8_t>(point.g), static_cast<uint8_t>(point.r));
-        i++;
-      }
-
-      color = getClassByColor(M);
-      if(color == "") {
-        // no detection!
-        continue;
-      }
 
-      orp::WorldObject thisObject;
-      thisObject.label = color;
+  std::string color = getClassByColor(summary);
+  if(color == "") {
+    // no detection!
+    return;
+  }
 
-      // Now set the object pose: the center of the top of the pointcloud AABB
-      float maxX = -1e300, minX = 1e300;
-      float maxY = -1e300, minY = 1e300;
-      float maxZ = -1e300, minZ = 1e300;
-      for(const auto& pt : cloudPtr->points)
-      {
-        maxX = std::max(maxX, pt.x);
-        minX = std::min(minX, pt.x);
-        maxY = std::max(maxY, pt.y);
-        minY = std::min(minY, pt.y);
-        maxZ = std::max(maxZ, pt.z);
-        minZ = std::min(minZ, pt.z);
-      }
+  orp::WorldObject thisObject;
+  thisObject.label = color;
 
-      thisObject.pose.pose.position.x = minX + (maxX - minX) / 2;
-      // thisObject.pose.pose.position.y = minY + (maxY - minY) / 2;
-      thisObject.pose.pose.position.y = maxY;
-      thisObject.pose.pose.position.z = maxZ;
+  // Now set the object pose: the center of the top of the pointcloud AABB
+  thisObject.pose.pose.position.x =
+    (summary.aabb_min.x + summary.aabb_max.x) / 2;
+  thisObject.pose.pose.position.y = summary.aabb_max.y;
+  thisObject.pose.pose.position.z = summary.aabb_max.z;
 
-      thisObject.pose.pose.orientation.x = 0;
-      thisObject.pose.pose.orientation.y = 0;
-      thisObject.pose.pose.orientation.z = 0;
-      thisObject.pose.pose.orientation.w = 1;
-      thisObject.pose.header.frame_id = cloudMessage.header.frame_id;
+  thisObject.pose.pose.orientation.x = 0;
+  thisObject.pose.pose.orientation.y = 0;
+  thisObject.pose.pose.orientation.z = 0;
+  thisObject.pose.pose.orientation.w = 1;
+  thisObject.pose.header.frame_id = cluster.header().frame_id;
 
-      thisObject.probability = 0.75;
-      classRes.result.push_back(thisObject);
-      cloudCounter++;
-      ROS_DEBUG_STREAM("processed cloud " << cloudCounter<< " of " << numClouds);
-    }
-  }
-  ROS_DEBUG_STREAM("Finished processing " << numClouds << " clouds");
-  if(classification_pub_ != NULL)
-  {
-    ROS_DEBUG_STREAM("publishing");
-    classification_pub_.publish(classRes);
-  }
+  thisObject.probability = 0.75;
+  objects.push_back(thisObject);
 }
 
 
-std::string HueClassifier::getClassByColor(const cv::Mat& input)
+std::string HueClassifier::getClassByColor(
+  const orp::ClusterSummary& summary) const
 {
-  cv::Mat hsv = cv::Mat::zeros(1, 1, CV_8UC3);
-  cv::Scalar avg_bgr = cv::mean(input);
-  hsv.at<cv::Vec3b>(0, 0) = cv::Vec3b(avg_bgr[0], avg_bgr[1], avg_bgr[2]);
-  cv::cvtColor(hsv, hsv, CV_BGR2HSV);
-  ROS_DEBUG_STREAM("raw average HSV: " << hsv.at<cv::Vec3b>(0, 0));
-  cv::Vec3b hsv_raw = hsv.at<cv::Vec3b>(0, 0);
+  ROS_DEBUG_STREAM("average HSV: " << summary.mean_h << ", " <<
+    summary.mean_s << ", " << summary.mean_v);
 
-  // Hue goes into range 0-360
-  int h = static_cast<int>(hsv_raw[0] * 2);
+  // Hue is in range 0-360
+  int h = static_cast<int>(summary.mean_h);
 
   // Saturation goes into range 0-100
-  int s = static_cast<int>(hsv_raw[1] * 0.3921568);
+  int s = static_cast<int>(summary.mean_s * 100);
 
   // Value goes into range 0-100
-  int v = static_cast<int>(hsv_raw[2] * 0.3921568);
+  int v = static_cast<int>(summary.mean_v * 100);
 
   ROS_DEBUG_STREAM("" << h << ", " << s << ", " << v);
 
@@ -327,3 +244,5 @@ std::string HueClassifier::getClassByColor(const cv::Mat& input)
 //     return "purple";
 //   }
 // }
+
+PLUGINLIB_EXPORT_CLASS(HueClassifier, ClassifierPlugin)
@@ -34,18 +34,21 @@
 #include <boost/regex.hpp>
 
 NNClassifier::NNClassifier() :
-  Classifier3D()
+  kIndex(NULL),
+  kData(NULL)
 {
   srand (static_cast <unsigned> (time(0)));
-
-  node_private_.param<std::string>("data_folder", dataFolder, "/");
-  node_private_.param<std::string>("file_extension", fileExtension, "/");
-  node_private_.param<float>("threshold", threshold, 10000.0f);
 }
 
-void NNClassifier::init() {
+void NNClassifier::initialize(ros::NodeHandle& node,
+  ros::NodeHandle& node_private)
+{
+  node_private.param<std::string>("data_folder", dataFolder, "/");
+  node_private.param<std::string>("file_extension", fileExtension, "/");
+  node_private.param<float>("threshold", threshold, 10000.0f);
+
   //parse the params on the parameter server
-  loadTypeList();
+  loadTypeList(node);
   if(!ros::isShuttingDown()) {
 
     loadModelsRecursive(dataFolder, fileExtension, loadedModels);
@@ -79,13 +82,12 @@ void NNClassifier::init() {
     }
     ROS_INFO("Training data loaded.");
   }
-  Classifier::init();
 }
 
-void NNClassifier::loadTypeList() {
+void NNClassifier::loadTypeList(ros::NodeHandle& node) {
   XmlRpc::XmlRpcValue paramMap;
   std::vector<WorldObjectType> objects;
-  while(!node_.getParam("items", paramMap)) {
+  while(!node.getParam("items", paramMap)) {
     ROS_INFO_DELAYED_THROTTLE(5.0,
                       "Waiting for object type list on parameter server...");
     ros::Duration(1.0).sleep();
@@ -97,7 +99,10 @@ void NNClassifier::loadTypeList() {
 }
 
 NNClassifier::~NNClassifier() {
-  delete[] kData->ptr();
+  if(kData) {
+    delete[] kData->ptr();
+    delete kData;
+  }
   delete kIndex;
 }
 
@@ -130,6 +135,7 @@ int NNClassifier::nearestKSearch(
       flann::Matrix<float>(new float[home.rows*k], home.rows, k);
   int foundCount =
       index.knnSearch (home, indices, distances, k, flann::SearchParams (128));
+  delete[] home.ptr();
 
   return foundCount;
 }
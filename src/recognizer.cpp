@@ -74,12 +74,23 @@ Recognizer::Recognizer() :
 
     classification_count(0),
     object_sequence(0),
-    refreshInterval(0.01)
+    refreshInterval(0.01),
+    dataSpinner(1, &dataQueue)
 {
+  dataNode.setCallbackQueue(&dataQueue);
+
   // load any overrides from parameters, otherwise use defaults
   ros::NodeHandle privateNode("~");
   privateNode.getParam("legacy", legacy);
   privateNode.getParam("autostart", autostart);
+  privateNode.getParam("lazy", lazy);
+  double seconds;
+  privateNode.param("lazy_freshness", seconds, 0.5);
+  freshness = ros::Duration(seconds);
+  privateNode.param("lazy_timeout", seconds, 2.0);
+  queryTimeout = ros::Duration(seconds);
+  privateNode.param("lazy_frames", burstSize, 1);
+  privateNode.getParam("lazy_methods", lazyMethods);
   if(!privateNode.getParam("recognition_frame", recognitionFrame)) {
     recognitionFrame = "world";
   }
@@ -111,6 +122,7 @@ Recognizer::Recognizer() :
   {
     objectPub = n.advertise<vision_msgs::Detection3DArray>(objectTopic, 1);
   }
+  startPub = n.advertise<std_msgs::Empty>("start_recognition", 1);
   stopPub = n.advertise<std_msgs::Empty>("stop_recognition", 1, true);
   visionInfoPub = n.advertise<vision_msgs::VisionInfo>("vision_info", 1, true);
 
@@ -140,14 +152,28 @@ Recognizer::Recognizer() :
   ROS_INFO_NAMED("ORP Recognizer", "Loading object types");
   typeManager.loadTypesFromParameterServer();
 
-  if(autostart) {
+  if(lazy) {
+    // listen all the time, but keep the classifiers stopped until a query
+    // needs them
+    ROS_INFO_NAMED("ORP Recognizer", "Recognizing on demand");
+    startRecognition();
+    stopPub.publish(std_msgs::Empty());
+  }
+  else if(autostart) {
     ROS_INFO_NAMED("ORP Recognizer", "Autostarting recognition");
     startRecognition();
   }
+  dataSpinner.start();
+}
+
+Recognizer::~Recognizer()
+{
+  dataSpinner.stop();
 }
 
 void Recognizer::recognize(const ros::TimerEvent& event)
 {
+  std::lock_guard<std::mutex> modelLock(modelMutex);
   // update objects
   if(isRecognitionStarted())
   {
@@ -164,6 +190,7 @@ void Recognizer::recognize(const ros::TimerEvent& event)
 
 void Recognizer::paramsChanged(orp::RecognizerConfig &config, uint32_t level)
 {
+  std::lock_guard<std::mutex> modelLock(modelMutex);
   setRefreshInterval(config.refresh_interval);
   staleTime = ros::Duration(config.stale_time);
   colocationDist = config.colocation_dist;
@@ -189,6 +216,10 @@ bool Recognizer::getObjectPose(orp::GetObjectPose::Request &req,
   orp::GetObjectPose::Response &response)
 {
   response.num_found = 0;
+  if(lazy) {
+    refreshObjects();
+  }
+  std::lock_guard<std::mutex> modelLock(modelMutex);
   WorldObjectPtr found = getMostLikelyObjectOfType(req.name);
 
   if(!found) return true;
@@ -207,6 +238,17 @@ bool Recognizer::getObjectPose(orp::GetObjectPose::Request &req,
 }
 
 void Recognizer::cb_processNewClassification(orp::ClassificationResult objects)
+{
+  mergeClassification(objects);
+  // counted after merging, so that lazy queries waiting for this message
+  // find its objects in the model
+  std::lock_guard<std::mutex> modelLock(modelMutex);
+  lastClassification = ros::Time::now();
+  ++methodFrames[objects.method];
+}
+
+void Recognizer::mergeClassification(
+    const orp::ClassificationResult& objects)
 {
   for(int i=0; i < objects.result.size(); ++i) {
     orp::WorldObject newObject = objects.result[i];
@@ -241,6 +283,7 @@ void Recognizer::cb_processNewClassification(orp::ClassificationResult objects)
         new WorldObject(colocationDist, &typeManager, newObject.label,
                         recognitionFrame, eigPose, newObject.probability));
       p->setCloud(newObject.cloud);
+      p->setClusterReference(newObject.cluster);
 
       // build a list of objects sorted by their distance to the new one
       std::map<float, WorldObjectPtr> distances;
@@ -275,18 +318,27 @@ void Recognizer::cb_processNewClassification(orp::ClassificationResult objects)
     }
   }
   if(objects.result.size() > 0) {
+    // update() reads and clears dirty under the same lock
+    std::lock_guard<std::mutex> modelLock(modelMutex);
     dirty = true; //queue an update
     classification_count += objects.result.size();
   }
 }
 
 bool Recognizer::isRecognitionStarted() {
-  return (recognitionSub != NULL);
+  return recognitionStarted;
 }
 
 void Recognizer::startRecognition() {
-  if(!isRecognitionStarted())
+  std::lock_guard<std::mutex> recognitionLock(recognitionMutex);
   {
+    std::lock_guard<std::mutex> modelLock(modelMutex);
+    if(isRecognitionStarted())
+    {
+      ROS_ERROR_NAMED("ORP Recognizer",
+                      "Attempted to start recognition, but already started");
+      return;
+    }
     for(WorldObjectList::iterator it = model.begin();
         it != model.end(); ++it)
     {
@@ -295,29 +347,38 @@ void Recognizer::startRecognition() {
     visualization_msgs::Marker marker;
     marker.action = visualization_msgs::Marker::DELETEALL;
     markerMsg.markers.push_back(marker);
-    ROS_INFO("Starting Visual Recognition");
-    recognitionSub = n.subscribe(
-      classificationTopic,
-      10,
-      &Recognizer::cb_processNewClassification,
-      this);
-
-    timer = n.createTimer(ros::Duration(refreshInterval),
+    recognitionStarted = true;
+  }
+
+  // The subscriber and timer are set up without the model lock, since their
+  // callbacks take it.
+  ROS_INFO("Starting Visual Recognition");
+  recognitionSub = dataNode.subscribe(
+    classificationTopic,
+    10,
+    &Recognizer::cb_processNewClassification,
+    this);
+
+  // lazy queries update and publish the model themselves
+  if(!lazy) {
+    timer = dataNode.createTimer(ros::Duration(refreshInterval),
         boost::bind(&Recognizer::recognize, this, _1));
     timer.start();
-  } else {
-    ROS_ERROR_NAMED("ORP Recognizer",
-                    "Attempted to start recognition, but already started");
   }
 }
 
 void Recognizer::stopRecognition() {
+  std::lock_guard<std::mutex> recognitionLock(recognitionMutex);
   // This is now more of a pause behavior, because we keep publishing.
-  if(isRecognitionStarted())
   {
-    ROS_INFO("Stopping Visual Recognition");
-    //timer.stop();  // if actually stopping
-    recognitionSub.shutdown();  // if actually stopping
+    std::lock_guard<std::mutex> modelLock(modelMutex);
+    if(!isRecognitionStarted())
+    {
+      ROS_WARN_NAMED("ORP Recognizer",
+          "Attempted to stop recognition, but it hasn't started.");
+      return;
+    }
+    recognitionStarted = false;
     for(WorldObjectList::iterator it = model.begin();
         it != model.end(); ++it)
     {
@@ -329,10 +390,13 @@ void Recognizer::stopRecognition() {
 
     //clear all markers (if actually stopping)
     //model.clear();
-  } else {
-    ROS_WARN_NAMED("ORP Recognizer",
-        "Attempted to stop recognition, but it hasn't started.");
   }
+
+  ROS_INFO("Stopping Visual Recognition");
+  //timer.stop();  // if actually stopping
+  // shutdown() waits for a running classification callback, which takes the
+  // model lock, so it's called without it
+  recognitionSub.shutdown();  // if actually stopping
 }
 
 void Recognizer::update()
@@ -360,6 +424,91 @@ void Recognizer::update()
   }
 }
 
+void Recognizer::refreshObjects()
+{
+  std::lock_guard<std::mutex> queryLock(queryMutex);
+  {
+    std::lock_guard<std::mutex> modelLock(modelMutex);
+    if(!lastClassification.isZero() &&
+       ros::Time::now() - lastClassification <= freshness)
+    {
+      return;
+    }
+  }
+
+  // each classifier reports on its own, so the burst lasts until every one
+  // that's expected has
+  std::map<std::string, int> origFrames;
+  std::vector<std::string> methods = lazyMethods;
+  {
+    std::lock_guard<std::mutex> modelLock(modelMutex);
+    origFrames = methodFrames;
+  }
+  if(methods.empty()) {
+    for(std::map<std::string, int>::const_iterator it = origFrames.begin();
+        it != origFrames.end(); ++it)
+    {
+      methods.push_back(it->first);
+    }
+  }
+
+  const ros::Time deadline = ros::Time::now() + queryTimeout;
+  std::string missing;
+  startPub.publish(std_msgs::Empty());
+  while(!burstComplete(origFrames, methods, missing) && ros::ok() &&
+        ros::Time::now() < deadline)
+  {
+    refreshInterval.sleep();
+  }
+  stopPub.publish(std_msgs::Empty());
+  if(!missing.empty()) {
+    ROS_WARN_STREAM_THROTTLE_NAMED(5.0f, "ORP Recognizer",
+      "Didn't get " << burstSize << " classifications from " << missing <<
+      " within " << queryTimeout.toSec() << "s. Answering from the " <<
+      "objects known so far.");
+  }
+
+  std::lock_guard<std::mutex> modelLock(modelMutex);
+  update();
+  publishROS();
+  killStale();
+}
+
+bool Recognizer::burstComplete(const std::map<std::string, int> &origFrames,
+  const std::vector<std::string> &methods, std::string &missing)
+{
+  std::lock_guard<std::mutex> modelLock(modelMutex);
+  // messages from a method since the query started
+  auto framesSince = [&](const std::string &method) {
+    std::map<std::string, int>::const_iterator now =
+      methodFrames.find(method);
+    std::map<std::string, int>::const_iterator orig =
+      origFrames.find(method);
+    return (now != methodFrames.end() ? now->second : 0) -
+      (orig != origFrames.end() ? orig->second : 0);
+  };
+
+  missing.clear();
+  if(methods.empty()) {
+    for(std::map<std::string, int>::const_iterator it = methodFrames.begin();
+        it != methodFrames.end(); ++it)
+    {
+      if(framesSince(it->first) >= burstSize) {
+        return true;
+      }
+    }
+    missing = "any classifier";
+    return false;
+  }
+
+  for(size_t i = 0; i < methods.size(); ++i) {
+    if(framesSince(methods[i]) < burstSize) {
+      missing += (missing.empty() ? "" : ", ") + methods[i];
+    }
+  }
+  return missing.empty();
+}
+
 void Recognizer::publishROS()
 {
   // re-sort. This could almost certainly be done more efficiently
@@ -457,6 +606,7 @@ void Recognizer::publishROSLegacy()
     newObject.pose.header.seq = object_sequence++;
     newObject.label  = (**it).getType().getName();
     newObject.cloud = (**it).getCloud();
+    newObject.cluster = (**it).getClusterReference();
 
     objectMsg.objects.insert(objectMsg.objects.end(), newObject);
   }
@@ -467,18 +617,26 @@ void Recognizer::publishROSLegacy()
 
 bool Recognizer::cb_getObjects(orp::GetObjects::Request &req,
     orp::GetObjects::Response &response) {
-  bool wasStarted = isRecognitionStarted();
-  ros::Publisher startPub;
-  if(!wasStarted) {
-    startPub = n.advertise<std_msgs::Empty>("orp_start_recognition", 1, true);
-    startPub.publish(std_msgs::Empty());
-  }
-  //block until classification message is published
-  int orig_classification_count = classification_count;
-  while(classification_count == orig_classification_count) {
-    refreshInterval.sleep();
-    ros::spinOnce();
+  bool wasStarted;
+  {
+    std::lock_guard<std::mutex> modelLock(modelMutex);
+    wasStarted = isRecognitionStarted();
+  }
+  if(lazy) {
+    refreshObjects();
   }
+  else {
+    if(!wasStarted) {
+      startPub.publish(std_msgs::Empty());
+    }
+    //block until classification message is published. Classifications are
+    //handled on the data thread, so there's no need to spin here.
+    int orig_classification_count = classification_count;
+    while(classification_count == orig_classification_count && ros::ok()) {
+      refreshInterval.sleep();
+    }
+  }
+  std::unique_lock<std::mutex> modelLock(modelMutex);
   for(WorldObjectList::iterator it = model.begin(); it != model.end(); ++it)
   {
     //create the object message
@@ -492,10 +650,34 @@ bool Recognizer::cb_getObjects(orp::GetObjects::Request &req,
     newObject.pose.header.frame_id = recognitionFrame;
     newObject.label  = (**it).getType().getName();
     newObject.cloud = (**it).getCloud();
+    newObject.cluster = (**it).getClusterReference();
 
     response.objects.objects.push_back(newObject);
   }
-  if(!wasStarted) {
+  modelLock.unlock();
+
+  // the classifiers are asked for the points outside of the lock
+  if(req.include_clouds) {
+    for(size_t i = 0; i < response.objects.objects.size(); ++i) {
+      orp::WorldObject &object = response.objects.objects[i];
+      if(!object.cloud.data.empty() || object.cluster.source.empty()) {
+        continue;
+      }
+      orp::GetCluster getCluster;
+      getCluster.request.frame = object.cluster.frame;
+      getCluster.request.index = object.cluster.index;
+      if(ros::service::call(object.cluster.source, getCluster) &&
+         getCluster.response.found)
+      {
+        object.cloud = getCluster.response.cloud;
+      }
+      else {
+        ROS_WARN_THROTTLE(5, "Couldn't get the points of a %s from %s.",
+          object.label.c_str(), object.cluster.source.c_str());
+      }
+    }
+  }
+  if(!lazy && !wasStarted) {
     stopPub.publish(std_msgs::Empty());
   }
   return true;
@@ -567,9 +749,15 @@ void Recognizer::setRefreshInterval(float interval)
 // ROS shadows for internal functions
 
 void Recognizer::cb_startRecognition(std_msgs::Empty msg) {
-  startRecognition();
+  // in lazy mode these topics are the queries' own, and only gate the
+  // classifiers
+  if(!lazy) {
+    startRecognition();
+  }
 }
 
 void Recognizer::cb_stopRecognition(std_msgs::Empty msg) {
-  stopRecognition();
+  if(!lazy) {
+    stopRecognition();
+  }
 }
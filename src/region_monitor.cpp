@@ -30,6 +30,8 @@
 
 #include "orp/core/region_monitor.h"
 
+#include <tf_conversions/tf_eigen.h>
+
 int main(int argc, char **argv)
 {
   // Start the segmentation node and all ROS publishers
@@ -45,16 +47,14 @@ RegionMonitor::RegionMonitor() :
   node("region_monitor"),
   transformToFrame(""),
   listener(),
-  spinner(4)
+  spinner(4),
+  inputTransform(Eigen::Affine3f::Identity())
 {
   ros::NodeHandle privateNode("~");
   if(!privateNode.getParam("clippingFrame", transformToFrame)) {
     transformToFrame = "world";
   }
 
-  inputCloud = PCPtr(new PC());
-  processCloud = PCPtr(new PC());
-
   boundedScenePublisher =
       privateNode.advertise<sensor_msgs::PointCloud2>("bounded_scene",1);
 
@@ -92,15 +92,16 @@ bool RegionMonitor::cb_monitor(
   orp::MonitorRequest& req, orp::MonitorResponse& res)
 {
   // ROS_INFO("clipping by distance.");
-  PCPtr blah = clipByDistance(inputCloud);
+  bool hasColor;
+  std_msgs::Header header = clipByDistance(processCloud, hasColor);
 
   // ROS_INFO("checking occupation");
-  res.occupied = !(blah->empty());
+  res.occupied = !processCloud.empty();
 
   // ROS_INFO("publishing point cloud");
-  sensor_msgs::PointCloud2 outgoing;
-  pcl::toROSMsg(*blah, outgoing);
-  boundedScenePublisher.publish(outgoing);
+  // Depth-only sensors (like laser scanners) have no color to publish
+  boundedScenePublisher.publish(
+    messagePool.make(processCloud, header, hasColor));
   // ROS_INFO("done");
   return true;
 }
@@ -109,17 +110,33 @@ void RegionMonitor::cb_pointCloud(
   const sensor_msgs::PointCloud::ConstPtr& cloud)
 {
   // ROS_INFO("received input cloud");
-  sensor_msgs::PointCloud2 interimPC2, transformedPC2;
+  sensor_msgs::PointCloud2 interimPC2;
 
   // ROS_INFO("converting to point cloud 2");
   sensor_msgs::convertPointCloudToPointCloud2(*cloud, interimPC2);
-  // ROS_INFO("transforming into other frame");
-  pcl_ros::transformPointCloud(transformToFrame,
-      interimPC2, transformedPC2, listener);
 
-  // ROS_INFO("converting from ros message to PCL point cloud");
-  inputCloud->points.clear();
-  pcl::fromROSMsg(transformedPC2, *inputCloud);
+  // The points are only transformed when they're clipped, in the same pass.
+  // ROS_INFO("looking up transform into other frame");
+  Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+  if(transformToFrame != "" &&
+     interimPC2.header.frame_id != transformToFrame)
+  {
+    tf::StampedTransform stampedTransform;
+    try {
+      listener.lookupTransform(transformToFrame, interimPC2.header.frame_id,
+        interimPC2.header.stamp, stampedTransform);
+    }
+    catch(tf::TransformException &e) {
+      ROS_WARN_STREAM_THROTTLE(10, "[region_monitor] Can't transform cloud: "
+        << e.what());
+      return;
+    }
+    tf::transformTFToEigen(stampedTransform, transform);
+  }
+
+  std::lock_guard<std::mutex> lock(inputMutex);
+  std::swap(inputCloud, interimPC2);
+  inputTransform = transform.cast<float>();
 }
 
 bool compareClusterSize(
@@ -128,40 +145,18 @@ bool compareClusterSize(
   return a.width > b.width;
 }
 
-PCPtr& RegionMonitor::clipByDistance(PCPtr &unclipped) {
-
-  processCloud->resize(0);
-
-  // We must build a condition.
-  // And "And" condition requires all tests to check true.
-  // "Or" conditions also available.
-  // Checks available: GT, GE, LT, LE, EQ.
-  pcl::ConditionAnd<ORPPoint>::Ptr condition(new pcl::ConditionAnd<ORPPoint>);
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("x", pcl::ComparisonOps::GT, minX)));
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("x", pcl::ComparisonOps::LT, maxX)));
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("y", pcl::ComparisonOps::GT, minY)));
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("y", pcl::ComparisonOps::LT, maxY)));
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("z", pcl::ComparisonOps::GT, minZ)));
-  condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("z", pcl::ComparisonOps::LT, maxZ)));
-
-  // Filter object.
-  pcl::ConditionalRemoval<ORPPoint> filter(condition);
-  filter.setInputCloud(unclipped);
-  // If true, points that do not pass the filter will be set to a certain value
-  // (default NaN). If false, they will be just removed, but that could break
-  // the structure of the cloud (organized clouds are clouds taken from
-  // camera-like sensors that return a matrix-like image).
-  filter.setKeepOrganized(false);
-  // If keep organized was set true, points that failed the test will have
-  // their Z value set to this.
-  filter.setUserFilterValue(0.0);
-
-  filter.filter(*processCloud);
-  return processCloud;
-}
\ No newline at end of file
+std_msgs::Header RegionMonitor::clipByDistance(CompactCloud &clipped,
+  bool &hasColor)
+{
+  std::lock_guard<std::mutex> lock(inputMutex);
+  hasColor = CompactClouds::hasColor(inputCloud);
+  CompactClouds::decode(inputCloud, inputTransform,
+    Eigen::Vector3f(minX, minY, minZ), Eigen::Vector3f(maxX, maxY, maxZ),
+    clipped, hasColor);
+
+  std_msgs::Header header = inputCloud.header;
+  if(transformToFrame != "") {
+    header.frame_id = transformToFrame;
+  }
+  return header;
+}
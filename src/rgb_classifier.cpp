@@ -30,6 +30,7 @@
 
 #include <eigen_conversions/eigen_msg.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pluginlib/class_list_macros.h>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "orp/core/orp_utils.h"
@@ -37,104 +38,35 @@
 
 #include <sstream>
 
-int main(int argc, char **argv)
+void RGBClassifier::initialize(ros::NodeHandle& node,
+  ros::NodeHandle& node_private)
 {
-  // Start up the name and handle command-line arguments.
-  srand (static_cast <unsigned> (time(0)));
-
-  ros::init(argc, argv, "rgb_classifier");
-
-  ROS_INFO("Starting RGB Classifier");
-  RGBClassifier v;
-  v.init();
-
-  // for cluster visualization
-  //cv::namedWindow( "RGBCluster", cv::WINDOW_NORMAL );
-  ros::AsyncSpinner spinner(2);
-  spinner.start();
-
-  ros::waitForShutdown();
-  //cv::destroyAllWindows();
-  return 1;
 }
 
-RGBClassifier::RGBClassifier():
-  Classifier3D()
+void RGBClassifier::classifyCluster(const ClusterView& cluster,
+  std::vector<orp::WorldObject>& objects)
 {
-}
+  const orp::ClusterSummary& summary = cluster.summary();
+  if(summary.point_count < 3) {
+    return;
+  }
 
-void RGBClassifier::cb_classify(const sensor_msgs::PointCloud2& cloud)
-{
-  ROS_DEBUG_NAMED("RGB Classfiier",
-      "Received point cloud to classify as R/G/B");
+  std::string color = getColor(summary.mean_r, summary.mean_g,
+    summary.mean_b);
 
-  orp::ClassificationResult classRes;
-  classRes.method = "rgb";
+  orp::WorldObject thisObject;
+  thisObject.label = "obj_" + color;
+  thisObject.pose.header.frame_id = cluster.header().frame_id;
 
-  orp::Segmentation seg_srv;
-  seg_srv.request.scene = cloud;
-  bool segmentation_succeeded = segmentation_client_.call(seg_srv);
-  if(!segmentation_succeeded)
-  {
-    ROS_ERROR_STREAM_THROTTLE_NAMED(5, "RGB Classifier", "Could not call segmentation service at " << segmentation_service_);
-  }
-  std::vector<sensor_msgs::PointCloud2> clouds = seg_srv.response.clusters;
+  thisObject.pose.pose.position = summary.centroid;
 
-  if(!clouds.empty()) {
-    for(auto eachCloud = clouds.begin();
-        eachCloud != clouds.end(); eachCloud++)
-    {
-      if(eachCloud->width < 3) {
-        continue;
-      }
-      pcl::PointCloud<ORPPoint>::Ptr thisCluster(
-          new pcl::PointCloud<ORPPoint>);
-      pcl::fromROSMsg(*eachCloud, *thisCluster);
-
-      std::string color = "unknown";
-      M.release();
-      M = cv::Mat(thisCluster->points.size(), 1, CV_8UC3, cv::Scalar(0,0,0));
-      int i = 0;
-
-      pcl::PointCloud<ORPPoint>::iterator point;
-      float r=0, g=0, b=0;
-
-      for(point = thisCluster->points.begin();
-          point < thisCluster->points.end(); ++point, ++i)
-      {
-        r += point->r;
-        g += point->g;
-        b += point->b;
-      }
-
-      // std::cout << "M has " << eachCloud->width << " elements." << std::endl;
-
-      color = getColor(r, g, b);
-
-      orp::WorldObject thisObject;
-      thisObject.label = "obj_" + color;
-      thisObject.pose.header.frame_id = eachCloud->header.frame_id;
-
-
-      Eigen::Vector4f clusterCentroid;
-      pcl::compute3DCentroid(*thisCluster, clusterCentroid);
-
-      Eigen::Affine3d finalPose;
-      finalPose(0,3) = clusterCentroid(0);
-      finalPose(1,3) = clusterCentroid(1);
-      finalPose(2,3) = clusterCentroid(2);
-      tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
-
-      thisObject.pose.pose.orientation.x = 0;
-      thisObject.pose.pose.orientation.y = 0;
-      thisObject.pose.pose.orientation.z = 0;
-      thisObject.pose.pose.orientation.w = 1;
-
-      thisObject.probability = 0.75;
-      classRes.result.push_back(thisObject);
-    }
-  }
-  classification_pub_.publish(classRes);
+  thisObject.pose.pose.orientation.x = 0;
+  thisObject.pose.pose.orientation.y = 0;
+  thisObject.pose.pose.orientation.z = 0;
+  thisObject.pose.pose.orientation.w = 1;
+
+  thisObject.probability = 0.75;
+  objects.push_back(thisObject);
 }
 
 inline uchar reduceVal(const uchar val)
@@ -162,7 +94,7 @@ void RGBClassifier::processColors(cv::Mat& img)
   }
 }
 
-std::string RGBClassifier::getColor(float r, float g, float b)
+std::string RGBClassifier::getColor(float r, float g, float b) const
 {
   // TODO(Kukanani):
   // This function used to take a cv::Mat and use the cv::sum function to
@@ -231,3 +163,5 @@ std::string RGBClassifier::getColor(float r, float g, float b)
 //         }
 //     }
 // }
+
+PLUGINLIB_EXPORT_CLASS(RGBClassifier, ClassifierPlugin)
@@ -28,12 +28,13 @@
 // OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <limits>
+#include <algorithm>
+
 #include <pcl/ModelCoefficients.h>
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/filters/extract_indices.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/conditional_removal.h>
 #include <pcl/features/normal_3d.h>
 #include <pcl/kdtree/kdtree.h>
 #include <pcl/common/transforms.h>
@@ -41,34 +42,103 @@
 #include <pcl/sample_consensus/model_types.h>
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/segmentation/extract_clusters.h>
-#include <pcl_ros/transforms.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <tf_conversions/tf_eigen.h>
 
 #include "orp/core/segmentation.h"
+#include "orp/core/cloud_message_pool.h"
+#include "orp/core/cluster_summary.h"
+#include "orp/core/morton.h"
 
-int main(int argc, char **argv)
-{
-  // Start the segmentation node and all ROS publishers
-  ros::init(argc, argv, "segmentation");
-  pcl::console::setVerbosityLevel(pcl::console::L_ALWAYS);
-  ROS_INFO("Starting Segmentation");
-  Segmentation s;
-  s.run();
-  return 1;
-} //main
+namespace {
+  /// How many results each client's topic queues, or holds until the
+  /// client connects
+  const size_t kResultQueueSize = 10;
+
+  /// True if there is a deadline and it has passed.
+  bool pastDeadline(const ros::WallTime &deadline) {
+    return !deadline.isZero() && ros::WallTime::now() >= deadline;
+  }
+}
 
-Segmentation::Segmentation() :
-  node("segmentation"),
+template <typename PointT>
+Segmentation<PointT>::Segmentation(const orp::SegmentationConfig &config,
+  size_t workerThreads) :
   transformToFrame(),
-  listener(),
   spinner(4),
-  maxClusters(100)
+  maxClusters(100),
+  voxelLeafSize(0.005f),
+  planeLeafSize(0),
+  tileSize(0),
+  quantizePoints(false),
+  clusterResolution(0),
+  frameDeadline(0),
+  pipelined(false),
+  pipelineClosed(false),
+  workers(workerThreads),
+  cloudPool([](Cloud &cloud) {
+    cloud.clear();
+    cloud.header = pcl::PCLHeader();
+    cloud.is_dense = true;
+  }),
+  compactPool([](CompactCloud &cloud) {
+    cloud.clear();
+  }),
+  quantizedPool([](QuantizedCloud &cloud) {
+    cloud.clear();
+  }),
+  indicesPool([](pcl::PointIndices &indices) {
+    indices.indices.clear();
+  }),
+  coefficientsPool([](pcl::ModelCoefficients &coefficients) {
+    coefficients.values.clear();
+  }),
+  gridPool([](VoxelHash &grid) {
+    grid.clear();
+  }),
+  arenaPool([](FrameArena &arena) {
+    arena.reset();
+  })
 {
+  orp::SegmentationConfig offlineConfig = config;
+  // nothing is published offline, but clustering only runs when the
+  // largest object is
+  offlineConfig.publishBoundedScene = false;
+  offlineConfig.publishVoxelScene = false;
+  offlineConfig.publishAllPlanes = false;
+  offlineConfig.publishAllObjects = false;
+  offlineConfig.publishLargestObject = true;
+  paramsChanged(offlineConfig, 0);
+
+  addStage("decode", &Segmentation::decodeStage);
+  addStage("voxelize", &Segmentation::voxelStage);
+  addStage("planes", &Segmentation::planeStage);
+  addStage("cluster", &Segmentation::clusterStage);
+}
+
+template <typename PointT>
+Segmentation<PointT>::Segmentation() :
+  Segmentation(orp::SegmentationConfig::__getDefault__())
+{
+  ros::NodeHandle node("segmentation");
   ros::NodeHandle privateNode("~");
   if(!privateNode.getParam("clippingFrame", transformToFrame)) {
     transformToFrame = "odom";
   }
 
+  double slop;
+  privateNode.param<double>("sync_slop", slop, 0.05);
+  syncSlop = ros::Duration(slop);
+  privateNode.getParam("camera_topics", cameraTopics);
+  privateNode.param<bool>("quantize_points", quantizePoints, false);
+  privateNode.param<float>("cluster_resolution", clusterResolution, 0.0f);
+  listener.reset(new tf::TransformListener());
+
+  int pipelineDepth;
+  privateNode.param<bool>("pipelined", pipelined, false);
+  privateNode.param<int>("pipeline_depth", pipelineDepth, 2);
+  pipelineDepth = std::max(1, pipelineDepth);
+
   boundedScenePublisher =
     privateNode.advertise<sensor_msgs::PointCloud2>("bounded_scene", 5);
   voxelPublisher =
@@ -79,23 +149,96 @@ Segmentation::Segmentation() :
     privateNode.advertise<sensor_msgs::PointCloud2>("largest_object", 5);
   allObjectsPublisher =
     privateNode.advertise<sensor_msgs::PointCloud2>("all_objects", 5);
+  pipelineStatsPublisher =
+    privateNode.advertise<orp::PipelineStats>("pipeline_stats", 5);
 
-  segmentationServer =
-    node.advertiseService("segmentation", &Segmentation::cb_segment, this);
+  if(!cameraTopics.empty()) {
+    fusedScenePublisher =
+      privateNode.advertise<sensor_msgs::PointCloud2>("fused_scene", 1);
+    fusionStatsPublisher =
+      privateNode.advertise<orp::FrameStats>("fusion_stats", 1);
+    pendingClouds.resize(cameraTopics.size());
+    for(size_t i = 0; i < cameraTopics.size(); ++i) {
+      ROS_INFO_STREAM("Fusing camera topic " << cameraTopics[i]);
+    }
+    // the cameras are subscribed to once a classifier listens for sets
+    ros::SubscriberStatusCallback subscribersChanged =
+      boost::bind(&Segmentation::cb_fusionSubscribers, this, _1);
+    fusedFramePublisher = privateNode.advertise<std_msgs::Header>(
+      "fused_frames", 1, subscribersChanged, subscribersChanged);
+  }
 
-  // dynamic reconfigure
+  // dynamic reconfigure (set up before any pipeline thread reads the
+  // parameters)
   reconfigureCallbackType =
     boost::bind(&Segmentation::paramsChanged, this, _1, _2);
-  reconfigureServer.setCallback(reconfigureCallbackType);
+  reconfigureServer.reset(
+    new dynamic_reconfigure::Server<orp::SegmentationConfig>());
+  reconfigureServer->setCallback(reconfigureCallbackType);
+
+  if(pipelined) {
+    ROS_INFO("Running segmentation stages as a pipeline");
+    for(size_t i = 0; i < stages.size(); ++i) {
+      stages[i]->input.reset(new SpscRing<Frame*>(pipelineDepth));
+    }
+    for(size_t i = 0; i < stages.size(); ++i) {
+      stages[i]->thread = std::thread(&Segmentation::stageLoop, this, i);
+    }
+  }
+
+  segmentationServer =
+    node.advertiseService("segmentation", &Segmentation::cb_segment, this);
+
+  ros::SubscribeOptions requestOptions =
+    ros::SubscribeOptions::create<orp::SegmentationRequest>("requests", 10,
+      boost::bind(&Segmentation::cb_segmentRequest, this, _1),
+      ros::VoidPtr(), node.getCallbackQueue());
+  requestOptions.allow_concurrent_callbacks = true;
+  requestSubscriber = node.subscribe(requestOptions);
 }
 
-void Segmentation::run() {
+template <typename PointT>
+Segmentation<PointT>::~Segmentation() {
+  {
+    std::lock_guard<std::mutex> lock(pipelineEntryMutex);
+    pipelineClosed = true;
+  }
+  // Stop the stages in order, so that each one finishes the frames the
+  // previous one handed it.
+  for(size_t i = 0; i < stages.size(); ++i) {
+    {
+      std::lock_guard<std::mutex> lock(stages[i]->inputMutex);
+      stages[i]->stopping = true;
+    }
+    stages[i]->inputChanged.notify_all();
+    if(stages[i]->thread.joinable()) {
+      stages[i]->thread.join();
+    }
+  }
+}
+
+template <typename PointT>
+void Segmentation<PointT>::addStage(const std::string &name,
+  bool (Segmentation::*run)(Frame&))
+{
+  std::unique_ptr<PipelineStage> stage(new PipelineStage());
+  stage->name = name;
+  stage->run = run;
+  stage->stopping = false;
+  stage->waiters = 0;
+  stage->seconds = 0;
+  stages.push_back(std::move(stage));
+}
+
+template <typename PointT>
+void Segmentation<PointT>::run() {
   ROS_INFO("Segmentation running...");
   spinner.start();
   ros::waitForShutdown();
 }
 
-void Segmentation::paramsChanged(
+template <typename PointT>
+void Segmentation<PointT>::paramsChanged(
   orp::SegmentationConfig &config, uint32_t level)
 {
   //spatial bounds
@@ -115,12 +258,16 @@ void Segmentation::paramsChanged(
 
   //filtering
   voxelLeafSize = config.voxel_leaf_size;
+  planeLeafSize = config.plane_leaf_size;
 
   //clustering
   clusterTolerance = config.cluster_tolerance;
   minClusterSize = config.min_cluster_size;
   maxClusterSize = config.max_cluster_size;
 
+  tileSize = config.tile_size;
+  frameDeadline = config.frame_deadline;
+
   _publishAllObjects = config.publishAllObjects;
   _publishAllPlanes = config.publishAllPlanes;
   _publishBoundedScene = config.publishBoundedScene;
@@ -128,197 +275,800 @@ void Segmentation::paramsChanged(
   _publishVoxelScene = config.publishVoxelScene;
 }
 
+template <typename PointT>
+void Segmentation<PointT>::cb_camera(
+  const sensor_msgs::PointCloud2ConstPtr &cloud, size_t camera)
+{
+  ros::Time newest = cloud->header.stamp;
+  std::vector<sensor_msgs::PointCloud2ConstPtr> synchronized;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pendingClouds[camera] = cloud;
+
+    // Approximate time synchronization: drop any waiting cloud that is too
+    // old to be matched with the newest one, and fuse as soon as every camera
+    // has a cloud left.
+    for(size_t i = 0; i < pendingClouds.size(); ++i) {
+      if(pendingClouds[i] && pendingClouds[i]->header.stamp > newest) {
+        newest = pendingClouds[i]->header.stamp;
+      }
+    }
+    bool complete = true;
+    for(size_t i = 0; i < pendingClouds.size(); ++i) {
+      if(pendingClouds[i] &&
+         newest - pendingClouds[i]->header.stamp > syncSlop)
+      {
+        pendingClouds[i].reset();
+      }
+      complete = complete && pendingClouds[i];
+    }
+    if(!complete) {
+      return;
+    }
+    synchronized.swap(pendingClouds);
+    pendingClouds.resize(synchronized.size());
+  }
+  // if no request has fused the last set yet, this replaces it
+  fusionSlot.put(synchronized);
+
+  std_msgs::HeaderPtr header(new std_msgs::Header);
+  header->stamp = newest;
+  header->frame_id = transformToFrame;
+  fusedFramePublisher.publish(header);
+}
+
+template <typename PointT>
+void Segmentation<PointT>::cb_fusionSubscribers(
+  const ros::SingleSubscriberPublisher &)
+{
+  ros::NodeHandle node("segmentation");
+  std::vector<ros::Subscriber> unused;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    if(fusedFramePublisher.getNumSubscribers() == 0) {
+      if(!cameraSubscribers.empty()) {
+        ROS_INFO("Nothing uses the fused scene; unsubscribing from cameras");
+      }
+      unused.swap(cameraSubscribers);
+      pendingClouds.assign(cameraTopics.size(),
+        sensor_msgs::PointCloud2ConstPtr());
+      fusionSlot.close();
+      fusedSet.clear();
+    }
+    else if(cameraSubscribers.empty()) {
+      fusionSlot.reopen();
+      for(size_t i = 0; i < cameraTopics.size(); ++i) {
+        cameraSubscribers.push_back(
+          node.subscribe<sensor_msgs::PointCloud2>(cameraTopics[i], 1,
+            boost::bind(&Segmentation::cb_camera, this, _1, i)));
+      }
+    }
+  }
+  // Shutting a subscriber down waits for its running callbacks, and
+  // cb_camera takes pendingMutex, so this happens outside the lock.
+  for(size_t i = 0; i < unused.size(); ++i) {
+    unused[i].shutdown();
+  }
+}
+
+template <typename PointT>
+bool Segmentation<PointT>::fuseLatest(Frame &frame)
+{
+  std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+  bool newSet;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    newSet = fusionSlot.tryTake(fusedSet);
+    clouds = fusedSet;
+  }
+  if(clouds.empty()) {
+    ROS_WARN_THROTTLE(10, "A fused scene was requested, but there is no "
+      "synchronized set of camera clouds yet (printed every 10s)");
+    frame.result = false;
+    return false;
+  }
+
+  Eigen::Vector3f minBound(minX, minY, minZ);
+  Eigen::Vector3f maxBound(maxX, maxY, maxZ);
+  ros::Time oldest = clouds[0]->header.stamp;
+  ros::Time newest = oldest;
+  for(size_t i = 1; i < clouds.size(); ++i) {
+    oldest = std::min(oldest, clouds[i]->header.stamp);
+    newest = std::max(newest, clouds[i]->header.stamp);
+  }
+  if(newSet) {
+    fusionStatsPublisher.publish(fusionSlot.markProcessed(oldest));
+  }
+
+  // Every camera's points are voxelized straight into one grid, which is
+  // the voxelized cloud the later stages work on.
+  boost::shared_ptr<VoxelHash> grid = gridPool.acquire();
+  grid->setLeafSize(voxelLeafSize);
+  grid->setTrackColor(PointTraits<PointT>::kHasColor);
+  for(size_t i = 0; i < clouds.size(); ++i) {
+    const sensor_msgs::PointCloud2 &cloud = *clouds[i];
+
+    Eigen::Affine3f transform;
+    if(!lookupClippingTransform(cloud.header.frame_id, cloud.header.stamp,
+      ros::Duration(0.1), transform))
+    {
+      ROS_WARN_STREAM_THROTTLE(10, "Can't transform camera cloud from " <<
+        cloud.header.frame_id << " to " << transformToFrame <<
+        ", so it won't be fused (printed every 10s)");
+      continue;
+    }
+    frame.preVoxel += grid->insert(cloud, transform, minBound, maxBound);
+  }
+  frame.cloud = cloudPool.acquire();
+  grid->getCloud(*frame.cloud, &frame.keys);
+
+  if(fusedScenePublisher.getNumSubscribers() > 0) {
+    CloudMessagePool::Ptr fusedMessage =
+      messagePool.make(*frame.cloud, transformToFrame);
+    fusedMessage->header.stamp = newest;
+    fusedScenePublisher.publish(fusedMessage);
+  }
+  return true;
+}
+
+/// Larger clusters first. Clusters of the same size are in the order of
+/// their first points, i.e. in Morton order, since each cluster's indices
+/// are sorted; so the order doesn't depend on how the clusters were found.
 bool compareClusterSize(
-  const sensor_msgs::PointCloud2& a,
-  const sensor_msgs::PointCloud2& b)
+  const pcl::PointIndices& a,
+  const pcl::PointIndices& b)
 {
-  return a.width > b.width;
+  if(a.indices.size() != b.indices.size()) {
+    return a.indices.size() > b.indices.size();
+  }
+  return a.indices.front() < b.indices.front();
 }
 
-bool Segmentation::cb_segment(orp::Segmentation::Request &req,
+template <typename PointT>
+bool Segmentation<PointT>::cb_segment(orp::Segmentation::Request &req,
     orp::Segmentation::Response &response) {
   ROS_DEBUG("received segmentation request");
-  if(req.scene.height * req.scene.width < 3) {
+  return segment(req.scene, response, req.attention, req.fused);
+}
+
+template <typename PointT>
+void Segmentation<PointT>::cb_segmentRequest(
+  const orp::SegmentationRequestConstPtr &request)
+{
+  ROS_DEBUG("received asynchronous segmentation request %u from %s",
+    request->id, request->client.c_str());
+  orp::Segmentation::Response response;
+  orp::SegmentationResultPtr result(new orp::SegmentationResult);
+  result->client = request->client;
+  result->id = request->id;
+  result->success = segment(request->scene, response, request->attention,
+    request->fused);
+  result->clusters.swap(response.clusters);
+  result->compressed_clusters.swap(response.compressed_clusters);
+  result->summaries.swap(response.summaries);
+  result->degraded = response.degraded;
+  result->degraded_stage.swap(response.degraded_stage);
+
+  publishResult(result);
+}
+
+template <typename PointT>
+void Segmentation<PointT>::publishResult(
+  const orp::SegmentationResultConstPtr &result)
+{
+  const std::string &client = result->client;
+  std::lock_guard<std::mutex> lock(resultChannelsMutex);
+  typename std::map<std::string, ResultChannel>::iterator it =
+    resultChannels.find(client);
+  if(it == resultChannels.end()) {
+    ros::NodeHandle node("segmentation");
+    std::string topic = "results" +
+      (!client.empty() && client[0] == '/' ? client : "/" + client);
+    ros::Publisher publisher;
+    try {
+      // The connect callback runs on a spinner thread, and takes the lock,
+      // so it can't see the channel before it's added below.
+      publisher = node.advertise<orp::SegmentationResult>(topic,
+        kResultQueueSize, boost::bind(&Segmentation::cb_resultSubscriber,
+          this, _1, client));
+    }
+    catch(const ros::InvalidNameException &e) {
+      ROS_ERROR_STREAM_THROTTLE(10, "Can't answer segmentation client " <<
+        client << ": " << e.what());
+      return;
+    }
+    it = resultChannels.insert(
+      std::make_pair(client, ResultChannel())).first;
+    it->second.publisher = publisher;
+  }
+
+  ResultChannel &channel = it->second;
+  if(channel.publisher.getNumSubscribers() > 0) {
+    channel.publisher.publish(result);
+    return;
+  }
+  channel.waiting.push_back(result);
+  if(channel.waiting.size() > kResultQueueSize) {
+    channel.waiting.pop_front();
+  }
+}
+
+template <typename PointT>
+void Segmentation<PointT>::cb_resultSubscriber(
+  const ros::SingleSubscriberPublisher &subscriber, const std::string &client)
+{
+  std::deque<orp::SegmentationResultConstPtr> waiting;
+  {
+    std::lock_guard<std::mutex> lock(resultChannelsMutex);
+    typename std::map<std::string, ResultChannel>::iterator it =
+      resultChannels.find(client);
+    if(it == resultChannels.end()) {
+      return;
+    }
+    waiting.swap(it->second.waiting);
+  }
+  for(size_t i = 0; i < waiting.size(); ++i) {
+    subscriber.publish(waiting[i]);
+  }
+}
+
+template <typename PointT>
+bool Segmentation<PointT>::segment(const sensor_msgs::PointCloud2 &scene,
+  orp::Segmentation::Response &response,
+  const std::vector<orp::AttentionRegion> &attention, bool fused)
+{
+  if(!fused && scene.height * scene.width < 3) {
     ROS_DEBUG("Not segmenting cloud, it's too small.");
     return false;
   }
 
-  PC tmpCloud;
-  // processCloud = PCPtr(new PC());
-  // inputCloud->points.clear();
-  originalCloudFrame = req.scene.header.frame_id;
+  Frame frame;
+  frame.scene = &scene;
+  frame.response = &response;
+  frame.attention = &attention;
+  frame.fused = fused;
+  frame.preVoxel = 0;
+  if(frameDeadline > 0) {
+    frame.deadline = ros::WallTime::now() + ros::WallDuration(frameDeadline);
+  }
+  response.degraded = false;
+  response.degraded_stage.clear();
+  frame.active = true;
+  frame.result = true;
+  // the arena goes back to the pool (and is reset) when frame goes away
+  frame.arena = arenaPool.acquire();
 
-  sensor_msgs::PointCloud2 transformedMessage;
-  sensor_msgs::PointCloud2 rawMessage;
+  if(!pipelined) {
+    for(size_t i = 0; i < stages.size() && frame.active; ++i) {
+      runStage(*stages[i], frame);
+    }
+    publishPipelineStats();
+    return frame.result;
+  }
 
-  if(transformToFrame == "") {
-    pcl::fromROSMsg(req.scene, tmpCloud);
-    rawMessage.header.frame_id = req.scene.header.frame_id;
+  std::future<void> done = frame.done.get_future();
+  {
+    // Requests arrive on several spinner threads, but the first ring
+    // only takes one producer at a time.
+    std::lock_guard<std::mutex> lock(pipelineEntryMutex);
+    if(pipelineClosed) {
+      return false;
+    }
+    pushFrame(*stages[0], &frame);
+  }
+  done.wait();
+  return frame.result;
+}
+
+template <typename PointT>
+void Segmentation<PointT>::runStage(PipelineStage &stage, Frame &frame)
+{
+  ros::WallTime start = ros::WallTime::now();
+  try {
+    frame.active = (this->*stage.run)(frame);
   }
-  else if(listener.waitForTransform(
-    req.scene.header.frame_id, transformToFrame, req.scene.header.stamp,
-    ros::Duration(0.5)))
+  catch(const std::exception &e) {
+    // don't let one bad frame take down a pipeline thread
+    ROS_ERROR_STREAM("Segmentation stage " << stage.name << " failed: "
+      << e.what());
+    frame.active = false;
+    frame.result = false;
+  }
+  stage.seconds = (ros::WallTime::now() - start).toSec();
+}
+
+template <typename PointT>
+void Segmentation<PointT>::pushFrame(PipelineStage &stage, Frame *frame)
+{
+  if(!stage.input->push(frame)) {
+    std::unique_lock<std::mutex> lock(stage.inputMutex);
+    ++stage.waiters;
+    // pairs with the fence in wakeWaiters: either the retry below sees the
+    // other thread's pop, or that thread sees this waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    stage.inputChanged.wait(lock, [&]{ return stage.input->push(frame); });
+    --stage.waiters;
+  }
+  wakeWaiters(stage);
+}
+
+template <typename PointT>
+bool Segmentation<PointT>::popFrame(PipelineStage &stage, Frame *&frame)
+{
+  if(!stage.input->pop(frame)) {
+    std::unique_lock<std::mutex> lock(stage.inputMutex);
+    ++stage.waiters;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // The stages are stopped in order, so once this one is told to stop
+    // nothing else will be added to its input.
+    bool popped = false;
+    stage.inputChanged.wait(lock, [&]{
+      popped = stage.input->pop(frame);
+      return popped || stage.stopping;
+    });
+    --stage.waiters;
+    if(!popped) {
+      return false;
+    }
+  }
+  wakeWaiters(stage);
+  return true;
+}
+
+template <typename PointT>
+void Segmentation<PointT>::wakeWaiters(PipelineStage &stage)
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(stage.waiters.load(std::memory_order_relaxed) > 0) {
+    // A waiter holds the lock from counting itself until it is asleep, so
+    // taking it here makes sure the notification isn't missed.
+    {
+      std::lock_guard<std::mutex> lock(stage.inputMutex);
+    }
+    stage.inputChanged.notify_all();
+  }
+}
+
+template <typename PointT>
+void Segmentation<PointT>::stageLoop(size_t index)
+{
+  PipelineStage &stage = *stages[index];
+  Frame *frame;
+  while(popFrame(stage, frame)) {
+    if(frame->active) {
+      runStage(stage, *frame);
+    }
+    if(index + 1 < stages.size()) {
+      pushFrame(*stages[index + 1], frame);
+    }
+    else {
+      publishPipelineStats();
+      frame->done.set_value();
+    }
+  }
+}
+
+template <typename PointT>
+void Segmentation<PointT>::publishPipelineStats()
+{
+  if(!pipelineStatsPublisher) {
+    // offline
+    return;
+  }
+  orp::PipelineStats stats;
+  stats.header.stamp = ros::Time::now();
+  for(size_t i = 0; i < stages.size(); ++i) {
+    stats.stages.push_back(stages[i]->name);
+    stats.queue_depths.push_back(
+      stages[i]->input ? stages[i]->input->size() : 0);
+    stats.seconds.push_back(stages[i]->seconds);
+  }
+  stats.scratch_growth = ScratchGrowth::total();
+  pipelineStatsPublisher.publish(stats);
+}
+
+template <typename PointT>
+bool Segmentation<PointT>::lookupClippingTransform(const std::string &frame,
+  const ros::Time &stamp, const ros::Duration &timeout,
+  Eigen::Affine3f &transform)
+{
+  transform = Eigen::Affine3f::Identity();
+  if(transformToFrame == "" || frame == transformToFrame) {
+    return true;
+  }
+  if(!listener ||
+    !listener->waitForTransform(transformToFrame, frame, stamp, timeout))
   {
-    pcl_ros::transformPointCloud(transformToFrame, req.scene,
-      transformedMessage, listener);
-    pcl::fromROSMsg(transformedMessage, tmpCloud);
+    return false;
   }
-  else {
+  tf::StampedTransform stampedTransform;
+  listener->lookupTransform(transformToFrame, frame, stamp, stampedTransform);
+  Eigen::Affine3d transformd;
+  tf::transformTFToEigen(stampedTransform, transformd);
+  transform = transformd.cast<float>();
+  return true;
+}
+
+template <typename PointT>
+bool Segmentation<PointT>::decodeStage(Frame &frame)
+{
+  if(frame.fused) {
+    return fuseLatest(frame);
+  }
+  const sensor_msgs::PointCloud2 &scene = *frame.scene;
+
+  size_t sceneSize = scene.width * scene.height;
+  if(sceneSize <= minClusterSize) {
+    ROS_INFO_STREAM(
+      "point cloud is too small to segment: Min: " <<
+      minClusterSize << ", actual: " << sceneSize);
+    frame.result = false;
+    return false;
+  }
+
+  Eigen::Affine3f transform;
+  if(!lookupClippingTransform(scene.header.frame_id, scene.header.stamp,
+    ros::Duration(0.5), transform))
+  {
     ROS_WARN_STREAM_THROTTLE(60,
       "listen for transformation from " <<
-      req.scene.header.frame_id.c_str() <<
+      scene.header.frame_id.c_str() <<
       " to " << transformToFrame.c_str() <<
       " timed out. Proceeding...");
-    pcl::fromROSMsg(req.scene, tmpCloud);
-    rawMessage.header.frame_id = req.scene.header.frame_id;
   }
-  PCPtr inputCloud = PCPtr(new PC(tmpCloud));
 
-  if(inputCloud->points.size() <= minClusterSize) {
-    ROS_INFO_STREAM(
-      "point cloud is too small to segment: Min: " <<
-      minClusterSize << ", actual: " << inputCloud->points.size());
+  // Transform and clip in one pass straight out of the message. Points
+  // outside the box are dropped rather than kept (zeroed) to preserve the
+  // organized structure; nothing downstream uses it, and the voxel grid
+  // would otherwise average a spurious point in at the origin.
+  frame.points = compactPool.acquire();
+  Eigen::Vector3f minBound(minX, minY, minZ);
+  Eigen::Vector3f maxBound(maxX, maxY, maxZ);
+  if(!CompactClouds::decode(scene, transform, minBound, maxBound,
+    *frame.points, PointTraits<PointT>::kHasColor))
+  {
+    ROS_ERROR("Can't segment a cloud without x/y/z fields.");
+    frame.result = false;
     return false;
   }
+  frame.preVoxel = frame.points->size();
 
-  //clip
-  int preVoxel = inputCloud->points.size();
-  *inputCloud =
-    *(clipByDistance(inputCloud, minX, maxX, minY, maxY, minZ, maxZ));
   if(_publishBoundedScene) {
-    pcl::toROSMsg(*inputCloud, transformedMessage);
-    transformedMessage.header.frame_id = transformToFrame;
-    boundedScenePublisher.publish(transformedMessage);
+    std_msgs::Header header = scene.header;
+    header.frame_id = transformToFrame;
+    boundedScenePublisher.publish(messagePool.make(*frame.points, header,
+      PointTraits<PointT>::kHasColor));
   }
 
-  *inputCloud = *(voxelGridify(inputCloud, voxelLeafSize));
-
-  if(!inputCloud->points.empty() && inputCloud->points.size() < preVoxel) {
-    // Publish voxelized
-    if(_publishVoxelScene) {
-      sensor_msgs::PointCloud2 voxelized_cloud;
-      pcl::toROSMsg(*inputCloud, voxelized_cloud);
-      voxelized_cloud.header.frame_id = transformToFrame;
-      voxelPublisher.publish(voxelized_cloud);
-    }
+  // only worth it while the frame waits in the voxel stage's ring
+  if(quantizePoints && pipelined) {
+    frame.quantized = quantizedPool.acquire();
+    PointQuantizer(minBound, maxBound).quantize(*frame.points,
+      *frame.quantized);
+    frame.points.reset();
+  }
+  return true;
+}
 
-    //remove planes
-    inputCloud =
-      removePrimaryPlanes(inputCloud,maxPlaneSegmentationIterations,
-        segmentationDistanceThreshold, percentageToAnalyze, transformToFrame);
+template <typename PointT>
+bool Segmentation<PointT>::voxelStage(Frame &frame)
+{
+  if(frame.quantized) {
+    frame.points = compactPool.acquire();
+    PointQuantizer(Eigen::Vector3f(minX, minY, minZ),
+      Eigen::Vector3f(maxX, maxY, maxZ)).dequantize(*frame.quantized,
+        *frame.points);
+    frame.quantized.reset();
+  }
 
-    if(_publishAllObjects) {
-      pcl::toROSMsg(*inputCloud, transformedMessage);
-      transformedMessage.header.frame_id = transformToFrame;
-      allObjectsPublisher.publish(transformedMessage);
+  // From here on, the cloud is kept in Morton order so that neighbor
+  // searches touch nearby memory. This is also where the points are
+  // converted to PointT, which PCL's plane fitting and clustering need.
+  // A fused scene was already voxelized by fuseLatest.
+  if(!frame.fused) {
+    if(tileSize > 0) {
+      frame.cloud =
+        voxelGridifyTiled(*frame.points, voxelLeafSize, tileSize, frame.keys);
     }
-
-    if(_publishLargestObject) {
-      response.clusters = cluster(inputCloud, clusterTolerance, minClusterSize,
-        maxClusterSize);
-      if(!response.clusters.empty()) {
-        largestObjectPublisher.publish(response.clusters[0]);
-      }
+    else {
+      frame.cloud = voxelGridify(*frame.points, voxelLeafSize, frame.keys);
     }
-  } else {
-    if(inputCloud->points.empty()) {
+    frame.points.reset();
+  }
+
+  // The voxel grid can't add points. It might not remove any, though, if
+  // the input is already voxelized.
+  if(frame.cloud->points.empty() ||
+     frame.cloud->points.size() > frame.preVoxel)
+  {
+    if(frame.cloud->points.empty()) {
       ROS_WARN_STREAM("After filtering, the cloud "
         << "contained no points. No segmentation will occur.");
     }
     else {
       ROS_ERROR_STREAM(
         "After filtering, the cloud contained "
-        << inputCloud->points.size() << " points. This is more than BEFORE "
+        << frame.cloud->points.size() << " points. This is more than BEFORE "
         << "the voxel filter was applied, so something is wrong. No "
         << "segmentation will occur.");
     }
+    return false;
+  }
+
+  // Publish voxelized
+  if(_publishVoxelScene) {
+    voxelPublisher.publish(messagePool.make(*frame.cloud, transformToFrame));
   }
   return true;
 }
 
+template <typename PointT>
+bool Segmentation<PointT>::planeStage(Frame &frame)
+{
+  //remove planes
+  bool cutShort = false;
+  if(planeLeafSize > voxelLeafSize) {
+    frame.cloud = removePrimaryPlanesCoarse(frame.cloud, planeLeafSize,
+      maxPlaneSegmentationIterations, segmentationDistanceThreshold,
+      percentageToAnalyze, transformToFrame, *frame.arena, &frame.keys,
+      frame.deadline, &cutShort);
+  }
+  else {
+    frame.cloud =
+      removePrimaryPlanes(frame.cloud,maxPlaneSegmentationIterations,
+        segmentationDistanceThreshold, percentageToAnalyze,
+        transformToFrame, *frame.arena, &frame.keys, frame.deadline,
+        &cutShort);
+  }
+  if(cutShort) {
+    frame.response->degraded = true;
+    frame.response->degraded_stage = "planes";
+  }
+
+  if(_publishAllObjects) {
+    allObjectsPublisher.publish(
+      messagePool.make(*frame.cloud, transformToFrame));
+  }
+  return true;
+}
 
-PCPtr Segmentation::clipByDistance(PCPtr &unclipped,
-    float minX, float maxX, float minY, float maxY, float minZ, float maxZ) {
+template <typename PointT>
+bool Segmentation<PointT>::clusterStage(Frame &frame)
+{
+  orp::Segmentation::Response &response = *frame.response;
+  if(_publishLargestObject) {
+    if(!response.degraded && pastDeadline(frame.deadline)) {
+      // still bound the clustering, even though planes weren't cut short
+      response.degraded = true;
+      response.degraded_stage = "cluster";
+    }
 
-  PCPtr processCloud = PCPtr(new PC());
-  // processCloud->resize(0);
+    IndexVector clusterIndices;
+    auto findClusters = [&](CloudPtr &cloud,
+      const std::vector<uint64_t> &keys, int minSize, int maxSize)
+    {
+      if(tileSize > 0) {
+        clusterTiled(cloud, clusterTolerance, minSize, maxSize, tileSize,
+          keys, *frame.arena, clusterIndices);
+      }
+      else {
+        cluster(cloud, clusterTolerance, minSize, maxSize, clusterIndices);
+      }
+    };
 
-  // We must build a condition.
-  // And "And" condition requires all tests to check true.
-  // "Or" conditions also available.
-  // Checks available: GT, GE, LT, LE, EQ.
-  pcl::ConditionAnd<ORPPoint>::Ptr clip_condition(
-    new pcl::ConditionAnd<ORPPoint>);
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("x", pcl::ComparisonOps::GT, minX)));
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("x", pcl::ComparisonOps::LT, maxX)));
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("y", pcl::ComparisonOps::GT, minY)));
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("y", pcl::ComparisonOps::LT, maxY)));
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("z", pcl::ComparisonOps::GT, minZ)));
-  clip_condition->addComparison(pcl::FieldComparison<ORPPoint>::ConstPtr(
-    new pcl::FieldComparison<ORPPoint>("z", pcl::ComparisonOps::LT, maxZ)));
-
-  // Filter object.
-  pcl::ConditionalRemoval<ORPPoint> filter;
-  filter.setCondition(clip_condition);
-  filter.setInputCloud(unclipped);
-  // If true, points that do not pass the filter will be set to a certain value
-  // (default NaN). If false, they will be just removed, but that could break
-  // the structure of the cloud (organized clouds are clouds taken from
-  // camera-like sensors that return a matrix-like image).
-  filter.setKeepOrganized(true);
-  // If keep organized was set true, points that failed the test will have
-  // their Z value set to this.
-  filter.setUserFilterValue(0.0);
-
-  filter.filter(*processCloud);
-  return processCloud;
+    // A late frame finds its clusters in a thinned-out cloud, with the size
+    // limits scaled to match, so that the clustering work shrinks with it.
+    // The clusters are then filled back in from the whole cloud, so the
+    // response is still at full resolution.
+    size_t stride = response.degraded ? degradedStride() : 1;
+    if(stride > 1) {
+      CloudPtr sparse = cloudPool.acquire();
+      std::vector<uint64_t> sparseKeys;
+      sparse->points.reserve(frame.cloud->points.size() / stride + 1);
+      sparseKeys.reserve(sparse->points.capacity());
+      for(size_t i = 0; i < frame.cloud->points.size(); i += stride) {
+        sparse->points.push_back(frame.cloud->points[i]);
+        sparseKeys.push_back(frame.keys[i]);
+      }
+      sparse->width = sparse->points.size();
+      sparse->height = 1;
+      sparse->is_dense = frame.cloud->is_dense;
+      sparse->header = frame.cloud->header;
+      int minSize = std::max<int>(1, minClusterSize / stride);
+      findClusters(sparse, sparseKeys, minSize,
+        std::max<int>(minSize, maxClusterSize / stride));
+      gatherClusters(frame.cloud, frame.keys, stride, *frame.arena,
+        clusterIndices);
+    }
+    else {
+      findClusters(frame.cloud, frame.keys, minClusterSize, maxClusterSize);
+    }
+    buildClusters(frame.cloud, clusterIndices, response, *frame.attention);
+    if(!largestObjectPublisher) {
+      // running offline
+      return true;
+    }
+    if(!response.clusters.empty()) {
+      largestObjectPublisher.publish(response.clusters[0]);
+    }
+    else if(!response.compressed_clusters.empty() &&
+      largestObjectPublisher.getNumSubscribers() > 0)
+    {
+      CloudMessagePool::Ptr largest = messagePool.acquire();
+      ClusterCodec::decode(response.compressed_clusters[0], *largest);
+      largestObjectPublisher.publish(largest);
+    }
+  }
+  return true;
+}
+
+template <typename PointT>
+size_t Segmentation<PointT>::degradedStride() const
+{
+  // Taking every stride-th point of a surface spreads the points out by
+  // about sqrt(stride) voxels.
+  float spacing = 0.5f * clusterTolerance / std::max(voxelLeafSize, 1e-6f);
+  return std::max<size_t>(1, static_cast<size_t>(spacing * spacing));
 }
 
-PCPtr Segmentation::voxelGridify(PCPtr &loose, float gridSize) {
+template <typename PointT>
+typename Segmentation<PointT>::CloudPtr
+Segmentation<PointT>::voxelGridify(const CompactCloud &loose,
+  float gridSize, std::vector<uint64_t> &keys)
+{
   //ROS_INFO("Voxel grid filtering...");
 
-  PCPtr processCloud = PCPtr(new PC());
-  // processCloud->resize(0);
-  // Create the filtering object: downsample the dataset
-  pcl::VoxelGrid<ORPPoint> vg;
-  vg.setInputCloud(loose);
-  vg.setLeafSize(gridSize, gridSize, gridSize);
-  vg.filter(*processCloud);
+  CloudPtr processCloud = cloudPool.acquire();
+  boost::shared_ptr<VoxelHash> grid = gridPool.acquire();
+  grid->setLeafSize(gridSize);
+  grid->setTrackColor(PointTraits<PointT>::kHasColor);
+  grid->insert(loose);
+  grid->getCloud(*processCloud, &keys);
+
+  return processCloud;
+}
+
+namespace {
+  /// A point index tagged with the key of its tile (see tileKey)
+  typedef std::pair<uint64_t, int> TiledPoint;
+
+  /// Pack the x/y index of a square tile into one sortable key
+  inline uint64_t tileKey(int tx, int ty) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(tx)) << 32) |
+      static_cast<uint32_t>(ty);
+  }
+
+  /// The x index of the tile with the given key
+  inline int tileX(uint64_t key) {
+    return static_cast<int32_t>(static_cast<uint32_t>(key >> 32));
+  }
 
+  /// The y index of the tile with the given key
+  inline int tileY(uint64_t key) {
+    return static_cast<int32_t>(static_cast<uint32_t>(key));
+  }
+
+  /**
+   * Group points by tile by sorting them on their tile keys, so that each
+   * tile's points are one run of the array. Within a run the point indices
+   * stay in increasing order.
+   * @param points sorted in place
+   * @param starts filled with the start of each tile's run, followed by
+   *               points.size()
+   */
+  void partitionTiles(std::vector<TiledPoint> &points,
+    std::vector<size_t> &starts)
+  {
+    std::sort(points.begin(), points.end());
+    starts.clear();
+    for(size_t i = 0; i < points.size(); ++i) {
+      if(i == 0 || points[i].first != points[i - 1].first) {
+        starts.push_back(i);
+      }
+    }
+    starts.push_back(points.size());
+  }
+
+  template <typename PointT>
+  inline bool isFinitePoint(const PointT &pt) {
+    return pcl_isfinite(pt.x) && pcl_isfinite(pt.y) && pcl_isfinite(pt.z);
+  }
+
+  /// Find the root of a cluster in a union-find forest
+  template <typename Vector>
+  int findRoot(Vector &parents, int i) {
+    while(parents[i] != i) {
+      parents[i] = parents[parents[i]];
+      i = parents[i];
+    }
+    return i;
+  }
+}
+
+template <typename PointT>
+typename Segmentation<PointT>::CloudPtr
+Segmentation<PointT>::voxelGridifyTiled(const CompactCloud &loose,
+  float gridSize, float tileSize, std::vector<uint64_t> &keys)
+{
+  // Tile edges must lie on voxel edges so that no voxel is split between
+  // tiles. Tiles are assigned using the same voxel coordinates VoxelHash
+  // computes, so the two can't disagree because of rounding.
+  int voxelsPerTile =
+    std::max(1, static_cast<int>(std::floor(tileSize / gridSize + 0.5f)));
+  float inverseGridSize = 1.0f / gridSize;
+
+  std::vector<TiledPoint> tiled(loose.size());
+  for(size_t i = 0; i < loose.size(); ++i) {
+    const CompactPoint &pt = loose[i];
+    int tx = static_cast<int>(std::floor(
+      std::floor(pt.x * inverseGridSize) / voxelsPerTile));
+    int ty = static_cast<int>(std::floor(
+      std::floor(pt.y * inverseGridSize) / voxelsPerTile));
+    tiled[i] = TiledPoint(tileKey(tx, ty), i);
+  }
+  std::vector<size_t> starts;
+  partitionTiles(tiled, starts);
+  size_t tileCount = starts.size() - 1;
+
+  // the clouds hold Eigen members, so they're kept by pointer
+  std::vector<CloudPtr> tileClouds(tileCount);
+  std::vector<std::vector<uint64_t> > tileKeys(tileCount);
+  workers.parallelFor(tileCount, [&](size_t t) {
+    boost::shared_ptr<VoxelHash> grid = gridPool.acquire();
+    grid->setLeafSize(gridSize);
+    grid->setTrackColor(PointTraits<PointT>::kHasColor);
+    for(size_t i = starts[t]; i < starts[t + 1]; ++i) {
+      grid->insert(loose[tiled[i].second]);
+    }
+    tileClouds[t] = cloudPool.acquire();
+    grid->getCloud(*tileClouds[t], &tileKeys[t]);
+  });
+
+  // Each tile is already sorted, but tiles don't line up with Morton ranges,
+  // so the concatenated cloud has to be sorted again.
+  CloudPtr processCloud = cloudPool.acquire();
+  keys.clear();
+  for(size_t t = 0; t < tileClouds.size(); ++t) {
+    *processCloud += *tileClouds[t];
+    keys.insert(keys.end(), tileKeys[t].begin(), tileKeys[t].end());
+  }
+  Morton::sortCloud(*processCloud, keys);
   return processCloud;
 }
 
-PCPtr Segmentation::removePrimaryPlanes(PCPtr &input, int maxIterations,
-  float thresholdDistance, float percentageGood, std::string parentFrame)
+template <typename PointT>
+typename Segmentation<PointT>::CloudPtr
+Segmentation<PointT>::removePrimaryPlanes(CloudPtr &input,
+  int maxIterations, float thresholdDistance, float percentageGood,
+  std::string parentFrame, FrameArena &arena, std::vector<uint64_t> *keys,
+  const ros::WallTime &deadline, bool *cutShort)
 {
-  PCPtr planes(new PC());
-  PCPtr planeCloud(new PC());
+  CloudPtr planes = cloudPool.acquire();
+  CloudPtr planeCloud = cloudPool.acquire();
 
-  PCPtr processCloud = PCPtr(new PC());
+  CloudPtr processCloud = cloudPool.acquire();
   // processCloud->resize(0);
   // Create the segmentation object for the planar model and set all the
   // parameters
-  pcl::SACSegmentation<ORPPoint> seg;
+  pcl::SACSegmentation<PointT> seg;
   seg.setOptimizeCoefficients (true);
   seg.setModelType (pcl::SACMODEL_PLANE);
   seg.setMethodType (pcl::SAC_RANSAC);
   seg.setMaxIterations (maxIterations);
   seg.setDistanceThreshold (thresholdDistance);
 
-  pcl::PointIndices::Ptr planeIndices(new pcl::PointIndices);
-  pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-  pcl::PCDWriter writer;
+  pcl::PointIndices::Ptr planeIndices = indicesPool.acquire();
+  pcl::ModelCoefficients::Ptr coefficients = coefficientsPool.acquire();
 
   //how many points to get leave
   int targetSize = percentageGood * input->points.size();
   //ROS_INFO("target size: %d", targetSize);
 
   while(input->points.size() > targetSize) {
+    if(pastDeadline(deadline)) {
+      if(cutShort) *cutShort = true;
+      break;
+    }
     seg.setInputCloud(input);
     seg.segment (*planeIndices, *coefficients);
 
@@ -328,7 +1078,7 @@ PCPtr Segmentation::removePrimaryPlanes(PCPtr &input, int maxIterations,
       break;
     }
     // Segment the largest planar component from the remaining cloud
-    pcl::ExtractIndices<ORPPoint> extract;
+    pcl::ExtractIndices<PointT> extract;
     extract.setInputCloud(input);
     extract.setIndices(planeIndices);
 
@@ -340,34 +1090,156 @@ PCPtr Segmentation::removePrimaryPlanes(PCPtr &input, int maxIterations,
     //now actually take it out
     extract.setNegative(true);
     extract.filter(*processCloud);
+
+    // ExtractIndices keeps the remaining points in order, so the keys just
+    // need the same points dropped.
+    if(keys) {
+      std::vector<bool, ArenaAllocator<bool> > isPlane(keys->size(), false,
+        ArenaAllocator<bool>(arena));
+      for(size_t i = 0; i < planeIndices->indices.size(); ++i) {
+        isPlane[planeIndices->indices[i]] = true;
+      }
+      size_t kept = 0;
+      for(size_t i = 0; i < keys->size(); ++i) {
+        if(!isPlane[i]) {
+          (*keys)[kept++] = (*keys)[i];
+        }
+      }
+      keys->resize(kept);
+    }
     input = processCloud;
     //ROS_INFO("removed a plane.");
   }
 
   // Publish dominant planes
   if(_publishAllPlanes) {
-    sensor_msgs::PointCloud2 planes_pc2;
-    pcl::toROSMsg(*planes, planes_pc2);
-    planes_pc2.header.frame_id = parentFrame;
-    allPlanesPublisher.publish(planes_pc2);
+    allPlanesPublisher.publish(messagePool.make(*planes, parentFrame));
   }
 
   return input;
 }
 
-std::vector<sensor_msgs::PointCloud2> Segmentation::cluster(
-  PCPtr &input, float clusterTolerance,
-  int minClusterSize, int maxClusterSize)
+template <typename PointT>
+typename Segmentation<PointT>::CloudPtr
+Segmentation<PointT>::removePrimaryPlanesCoarse(CloudPtr &input,
+  float coarseLeafSize, int maxIterations, float thresholdDistance,
+  float percentageGood, std::string parentFrame, FrameArena &arena,
+  std::vector<uint64_t> *keys, const ros::WallTime &deadline, bool *cutShort)
 {
-  // clusters.clear();
-  std::vector<sensor_msgs::PointCloud2> clusters;
+  CloudPtr coarse = cloudPool.acquire();
+  {
+    boost::shared_ptr<VoxelHash> grid = gridPool.acquire();
+    grid->setLeafSize(coarseLeafSize);
+    grid->setTrackColor(PointTraits<PointT>::kHasColor);
+    grid->insert(*input);
+    grid->getCloud(*coarse);
+  }
 
+  pcl::SACSegmentation<PointT> seg;
+  seg.setOptimizeCoefficients (true);
+  seg.setModelType (pcl::SACMODEL_PLANE);
+  seg.setMethodType (pcl::SAC_RANSAC);
+  seg.setMaxIterations (maxIterations);
+  seg.setDistanceThreshold (thresholdDistance);
+
+  pcl::PointIndices::Ptr planeIndices = indicesPool.acquire();
+  pcl::ModelCoefficients::Ptr coefficients = coefficientsPool.acquire();
+  pcl::ExtractIndices<PointT> extract;
+  extract.setNegative(true);
+
+  // Find the planes on the coarse level, one row of (unit normal, offset)
+  // per plane.
+  std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> >
+    planeModels;
+  int targetSize = percentageGood * coarse->points.size();
+  while(coarse->points.size() > targetSize) {
+    if(pastDeadline(deadline)) {
+      if(cutShort) *cutShort = true;
+      break;
+    }
+    seg.setInputCloud(coarse);
+    seg.segment (*planeIndices, *coefficients);
+
+    if(planeIndices->indices.size () == 0) {
+      ROS_ERROR_THROTTLE(10,
+        "Could not find any good planes in the point cloud (printed every 10s)...");
+      break;
+    }
+    Eigen::Vector4f model(coefficients->values[0], coefficients->values[1],
+      coefficients->values[2], coefficients->values[3]);
+    planeModels.push_back(model / model.head<3>().norm());
+
+    CloudPtr remaining = cloudPool.acquire();
+    extract.setInputCloud(coarse);
+    extract.setIndices(planeIndices);
+    extract.filter(*remaining);
+    coarse = remaining;
+  }
+
+  if(planeModels.empty()) {
+    return input;
+  }
+
+  // Apply every plane to the fine level at once. The xyz of each point is
+  // viewed in place as a 3xN matrix, so the point-to-plane distances are one
+  // matrix product (written to frame scratch memory).
+  Eigen::Matrix<float, Eigen::Dynamic, 4> planeMatrix(planeModels.size(), 4);
+  for(size_t i = 0; i < planeModels.size(); ++i) {
+    planeMatrix.row(i) = planeModels[i].transpose();
+  }
+  size_t numPoints = input->points.size();
+  Eigen::Map<Eigen::MatrixXf> distances(
+    arena.allocate<float>(planeModels.size() * numPoints),
+    planeModels.size(), numPoints);
+  distances.noalias() = planeMatrix.leftCols<3>() * input->getMatrixXfMap(3,
+    sizeof(PointT) / sizeof(float), 0);
+  distances.colwise() += planeMatrix.col(3);
+
+  CloudPtr processCloud = cloudPool.acquire();
+  CloudPtr planes = cloudPool.acquire();
+  processCloud->points.reserve(numPoints);
+  size_t kept = 0;
+  for(size_t i = 0; i < numPoints; ++i) {
+    if(distances.col(i).cwiseAbs().minCoeff() <= thresholdDistance) {
+      if(_publishAllPlanes) {
+        planes->points.push_back(input->points[i]);
+      }
+      continue;
+    }
+    processCloud->points.push_back(input->points[i]);
+    if(keys) {
+      (*keys)[kept] = (*keys)[i];
+    }
+    ++kept;
+  }
+  if(keys) {
+    keys->resize(kept);
+  }
+  processCloud->width = processCloud->points.size();
+  processCloud->height = 1;
+  processCloud->is_dense = input->is_dense;
+  processCloud->header = input->header;
+
+  if(_publishAllPlanes) {
+    planes->width = planes->points.size();
+    planes->height = 1;
+    allPlanesPublisher.publish(messagePool.make(*planes, parentFrame));
+  }
+
+  return processCloud;
+}
+
+template <typename PointT>
+void Segmentation<PointT>::cluster(CloudPtr &input,
+  float clusterTolerance, int minClusterSize, int maxClusterSize,
+  IndexVector &clusterIndices)
+{
   // Creating the KdTree object for the search method of the extraction
-  pcl::search::KdTree<ORPPoint>::Ptr tree (new pcl::search::KdTree<ORPPoint>);
+  typename pcl::search::KdTree<PointT>::Ptr tree(
+    new pcl::search::KdTree<PointT>);
   tree->setInputCloud (input);
 
-  IndexVector cluster_indices;
-  pcl::EuclideanClusterExtraction<ORPPoint> ec;
+  pcl::EuclideanClusterExtraction<PointT> ec;
   ec.setInputCloud(input);
 
   ec.setClusterTolerance(clusterTolerance);
@@ -375,36 +1247,309 @@ std::vector<sensor_msgs::PointCloud2> Segmentation::cluster(
   ec.setMaxClusterSize(maxClusterSize);
   ec.setSearchMethod(tree);
 
-  ec.extract (cluster_indices);
+  ec.extract (clusterIndices);
+}
 
-  if(cluster_indices.empty()) return clusters;
+template <typename PointT>
+void Segmentation<PointT>::clusterTiled(CloudPtr &input,
+  float clusterTolerance, int minClusterSize, int maxClusterSize,
+  float tileSize, const std::vector<uint64_t> &keys, FrameArena &arena,
+  IndexVector &clusterIndices)
+{
+  // With tiles at least as wide as the tolerance, two points in the same
+  // cluster but different tiles are always in neighboring tiles, and both
+  // are within the tolerance of their own tile's edge.
+  tileSize = std::max(tileSize, clusterTolerance);
+  float inverseTileSize = 1.0f / tileSize;
 
-  // go through the set of indices. Each set of indices is one cloud
-  for(IndexVector::const_iterator it = cluster_indices.begin();
-      it != cluster_indices.end(); ++it)
-  {
-    //extract all the points based on the set of indices
-    PCPtr processCloud = PCPtr(new PC());
-    for(std::vector<int>::const_iterator pit = it->indices.begin();
-        pit != it->indices.end (); ++pit)
-    {
-      processCloud->points.push_back (input->points[*pit]);
+  std::vector<TiledPoint> tiled;
+  tiled.reserve(input->points.size());
+  for(size_t i = 0; i < input->points.size(); ++i) {
+    const PointT &pt = input->points[i];
+    if(!isFinitePoint(pt)) {
+      continue;
     }
-    processCloud->width = processCloud->points.size();
-    processCloud->height = 1;
-    processCloud->is_dense = true;
+    tiled.push_back(TiledPoint(
+      tileKey(static_cast<int>(std::floor(pt.x * inverseTileSize)),
+              static_cast<int>(std::floor(pt.y * inverseTileSize))), i));
+  }
+  std::vector<size_t> starts;
+  partitionTiles(tiled, starts);
 
-    //publish the cluster
-    sensor_msgs::PointCloud2 tempROSMsg;
+  // PCL takes the indices of each tile as a separate vector
+  std::vector<uint64_t> tileKeys(starts.size() - 1);
+  std::vector<pcl::IndicesPtr> tiles(starts.size() - 1);
+  for(size_t t = 0; t < tiles.size(); ++t) {
+    tileKeys[t] = tiled[starts[t]].first;
+    tiles[t].reset(new std::vector<int>(starts[t + 1] - starts[t]));
+    for(size_t i = starts[t]; i < starts[t + 1]; ++i) {
+      (*tiles[t])[i - starts[t]] = tiled[i].second;
+    }
+  }
+
+  // Cluster each tile on its own. Size limits can only be applied once
+  // clusters that cross tile borders have been merged, so nothing is
+  // filtered out here.
+  std::vector<IndexVector> tileClusters(tiles.size());
+  workers.parallelFor(tiles.size(), [&](size_t t) {
+    typename pcl::search::KdTree<PointT>::Ptr tree(
+      new pcl::search::KdTree<PointT>);
+    tree->setInputCloud(input, tiles[t]);
+
+    pcl::EuclideanClusterExtraction<PointT> ec;
+    ec.setInputCloud(input);
+    ec.setIndices(tiles[t]);
+    ec.setClusterTolerance(clusterTolerance);
+    ec.setMinClusterSize(1);
+    ec.setMaxClusterSize(std::numeric_limits<int>::max());
+    ec.setSearchMethod(tree);
+    ec.extract(tileClusters[t]);
+  });
 
-    pcl::toROSMsg(*processCloud, tempROSMsg);
-    tempROSMsg.header.frame_id = transformToFrame;
-    clusters.push_back(tempROSMsg);
+  // label each point with its (per-tile) cluster
+  std::vector<int, ArenaAllocator<int> > labels(input->points.size(), -1,
+    ArenaAllocator<int>(arena));
+  std::vector<int, ArenaAllocator<int> > parents((ArenaAllocator<int>(arena)));
+  for(size_t t = 0; t < tileClusters.size(); ++t) {
+    for(size_t c = 0; c < tileClusters[t].size(); ++c) {
+      const std::vector<int> &indices = tileClusters[t][c].indices;
+      for(size_t i = 0; i < indices.size(); ++i) {
+        labels[indices[i]] = parents.size();
+      }
+      parents.push_back(parents.size());
+    }
   }
 
-  if(clusters.size() > 0) {
-    std::sort(clusters.begin(), clusters.end(), compareClusterSize);
+  // Stitch together clusters that touch across tile borders. Only points
+  // near tile edges can reach into another tile; the margin is a little
+  // wider than the tolerance so that rounding can only add extra points to
+  // check. Each point is a voxel centroid, so its neighbors are within a
+  // cube of voxels around it, which is a few runs of the sorted keys.
+  float margin = clusterTolerance * 1.01f;
+  float toleranceSq = clusterTolerance * clusterTolerance;
+  uint32_t radius = static_cast<uint32_t>(clusterTolerance /
+    std::max(voxelLeafSize, 1e-6f)) + 1;
+  for(size_t t = 0; t < tiles.size(); ++t) {
+    float tileMinX = tileX(tileKeys[t]) * tileSize;
+    float tileMinY = tileY(tileKeys[t]) * tileSize;
+    const std::vector<int> &indices = *tiles[t];
+    for(size_t i = 0; i < indices.size(); ++i) {
+      const PointT &pt = input->points[indices[i]];
+      if(pt.x - tileMinX > margin && tileMinX + tileSize - pt.x > margin &&
+         pt.y - tileMinY > margin && tileMinY + tileSize - pt.y > margin)
+      {
+        continue;
+      }
+      int root = findRoot(parents, labels[indices[i]]);
+      uint64_t minKey, maxKey;
+      Morton::cubeAround(keys[indices[i]], radius, minKey, maxKey);
+      Morton::forEachInBox(keys, minKey, maxKey, [&](size_t j) {
+        const PointT &other = input->points[j];
+        if(labels[j] < 0 || (other.getVector3fMap() -
+          pt.getVector3fMap()).squaredNorm() > toleranceSq)
+        {
+          return;
+        }
+        int otherRoot = findRoot(parents, labels[j]);
+        if(otherRoot != root) {
+          parents[otherRoot] = root;
+        }
+      });
+    }
+  }
+
+  // gather the merged clusters, each at the slot of its root
+  std::vector<int, ArenaAllocator<int> > slots(parents.size(), -1,
+    ArenaAllocator<int>(arena));
+  IndexVector merged;
+  for(size_t t = 0; t < tileClusters.size(); ++t) {
+    for(size_t c = 0; c < tileClusters[t].size(); ++c) {
+      const std::vector<int> &indices = tileClusters[t][c].indices;
+      int &slot = slots[findRoot(parents, labels[indices[0]])];
+      if(slot < 0) {
+        slot = merged.size();
+        merged.push_back(pcl::PointIndices());
+      }
+      std::vector<int> &mergedIndices = merged[slot].indices;
+      mergedIndices.insert(mergedIndices.end(), indices.begin(),
+        indices.end());
+    }
   }
 
-  return clusters;
+  // apply the size limits
+  clusterIndices.clear();
+  for(size_t m = 0; m < merged.size(); ++m) {
+    int size = merged[m].indices.size();
+    if(size >= minClusterSize && size <= maxClusterSize) {
+      // sorted indices keep the cluster in Morton order, like cluster() does
+      std::sort(merged[m].indices.begin(), merged[m].indices.end());
+      clusterIndices.push_back(pcl::PointIndices());
+      clusterIndices.back().indices.swap(merged[m].indices);
+    }
+  }
 }
+
+template <typename PointT>
+void Segmentation<PointT>::gatherClusters(const CloudPtr &input,
+  const std::vector<uint64_t> &keys, size_t stride, FrameArena &arena,
+  IndexVector &clusterIndices)
+{
+  size_t numPoints = input->points.size();
+  std::vector<int, ArenaAllocator<int> > labels(numPoints, -1,
+    ArenaAllocator<int>(arena));
+  for(size_t c = 0; c < clusterIndices.size(); ++c) {
+    const std::vector<int> &indices = clusterIndices[c].indices;
+    for(size_t i = 0; i < indices.size(); ++i) {
+      labels[indices[i] * stride] = c;
+    }
+  }
+
+  // Only the labels of the sampled points are read while the others are
+  // written, so the cloud can be split between the workers.
+  const size_t kChunk = 4096;
+  float toleranceSq = clusterTolerance * clusterTolerance;
+  uint32_t radius = static_cast<uint32_t>(clusterTolerance /
+    std::max(voxelLeafSize, 1e-6f)) + 1;
+  workers.parallelFor((numPoints + kChunk - 1) / kChunk, [&](size_t chunk) {
+    size_t end = std::min(numPoints, (chunk + 1) * kChunk);
+    for(size_t i = chunk * kChunk; i < end; ++i) {
+      if(i % stride == 0) {
+        continue;
+      }
+      const PointT &pt = input->points[i];
+      int best = -1;
+      float bestSq = toleranceSq;
+      auto consider = [&](size_t j) {
+        if(j % stride != 0 || labels[j] < 0) {
+          return;
+        }
+        float distanceSq = (input->points[j].getVector3fMap() -
+          pt.getVector3fMap()).squaredNorm();
+        if(distanceSq <= bestSq) {
+          best = labels[j];
+          bestSq = distanceSq;
+        }
+      };
+      // On a surface, the closest sampled points are usually the ones
+      // next to it in Morton order.
+      size_t before = i - i % stride;
+      consider(before);
+      if(before + stride < numPoints) {
+        consider(before + stride);
+      }
+      if(best < 0) {
+        uint64_t minKey, maxKey;
+        Morton::cubeAround(keys[i], radius, minKey, maxKey);
+        Morton::forEachInBox(keys, minKey, maxKey, consider);
+      }
+      labels[i] = best;
+    }
+  });
+
+  // the points stay in Morton order within each cluster
+  for(size_t c = 0; c < clusterIndices.size(); ++c) {
+    clusterIndices[c].indices.clear();
+  }
+  for(size_t i = 0; i < numPoints; ++i) {
+    if(labels[i] >= 0) {
+      clusterIndices[labels[i]].indices.push_back(i);
+    }
+  }
+}
+
+template <typename PointT>
+void Segmentation<PointT>::buildClusters(CloudPtr &input,
+  IndexVector &cluster_indices,
+  orp::Segmentation::Response &response,
+  const std::vector<orp::AttentionRegion> &attention)
+{
+  std::vector<sensor_msgs::PointCloud2> &clusters = response.clusters;
+  std::vector<orp::CompressedCluster> &compressed =
+    response.compressed_clusters;
+  std::vector<orp::ClusterSummary> &summaries = response.summaries;
+  clusters.clear();
+  compressed.clear();
+  summaries.clear();
+
+  if(cluster_indices.empty()) return;
+
+  // largest clusters first
+  std::sort(cluster_indices.begin(), cluster_indices.end(),
+    compareClusterSize);
+
+  // the regions are moved into the clusters' frame. The ones that can't be
+  // are dropped, and if none are left every cluster is kept.
+  std::vector<orp::AttentionRegion> regions;
+  regions.reserve(attention.size());
+  for(size_t i = 0; i < attention.size(); ++i) {
+    const std::string &frame = attention[i].header.frame_id;
+    Eigen::Affine3f transform;
+    if(frame.empty() || frame == transformToFrame) {
+      regions.push_back(attention[i]);
+    }
+    else if(lookupClippingTransform(frame, ros::Time(0), ros::Duration(0),
+      transform))
+    {
+      regions.push_back(
+        AttentionRegions::transformed(attention[i], transformToFrame,
+          transform));
+    }
+    else {
+      ROS_WARN_THROTTLE(5, "Ignoring attention region %s: no transform from "
+        "%s to %s.", attention[i].id.c_str(), frame.c_str(),
+        transformToFrame.c_str());
+    }
+  }
+
+  // the summaries give the bounds that the attention regions are checked
+  // against, and are cheap next to the cluster messages
+  if(!regions.empty()) {
+    size_t kept = 0;
+    for(size_t i = 0; i < cluster_indices.size(); ++i) {
+      orp::ClusterSummary summary =
+        ClusterSummaries::summarize(*input, cluster_indices[i].indices);
+      if(AttentionRegions::overlaps(regions, summary.aabb_min,
+        summary.aabb_max))
+      {
+        cluster_indices[kept++].indices.swap(cluster_indices[i].indices);
+        summaries.push_back(summary);
+      }
+    }
+    cluster_indices.resize(kept);
+  }
+
+  if(response.degraded && maxClusters >= 0 &&
+    cluster_indices.size() > static_cast<size_t>(maxClusters))
+  {
+    cluster_indices.resize(maxClusters);
+    if(summaries.size() > cluster_indices.size()) {
+      summaries.resize(cluster_indices.size());
+    }
+  }
+
+  // go through the set of indices. Each set of indices is one cloud. The
+  // points are written straight into the message, which is sized once.
+  if(clusterResolution > 0) {
+    compressed.resize(cluster_indices.size());
+  }
+  else {
+    clusters.resize(cluster_indices.size());
+  }
+  summaries.reserve(cluster_indices.size());
+  for(size_t i = 0; i < cluster_indices.size(); ++i) {
+    const std::vector<int> &indices = cluster_indices[i].indices;
+    if(summaries.size() <= i) {
+      summaries.push_back(ClusterSummaries::summarize(*input, indices));
+    }
+    if(clusterResolution > 0) {
+      ClusterCodec::encode(*input, indices, clusterResolution,
+        transformToFrame, compressed[i]);
+    }
+    else {
+      CloudMessagePool::write(*input, indices, transformToFrame, clusters[i]);
+    }
+  }
+}
+
+#define ORP_INSTANTIATE_SEGMENTATION(T) template class Segmentation<T>;
+ORP_INSTANTIATE_POINT_TYPES(ORP_INSTANTIATE_SEGMENTATION)
@@ -0,0 +1,68 @@
+// Copyright (c) 2015, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+
+#include <pcl/console/print.h>
+#include <pcl/point_types.h>
+#include <ros/ros.h>
+
+#include "orp/core/segmentation.h"
+
+namespace {
+  /// Run the segmentation node with the given point type.
+  template <typename PointT>
+  void runSegmentation() {
+    Segmentation<PointT> s;
+    s.run();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Start the segmentation node and all ROS publishers
+  ros::init(argc, argv, "segmentation");
+  pcl::console::setVerbosityLevel(pcl::console::L_ALWAYS);
+
+  std::string pointType;
+  ros::NodeHandle("~").param<std::string>("point_type", pointType, "xyzrgb");
+  ROS_INFO_STREAM("Starting Segmentation with " << pointType << " points");
+  if(pointType == "xyz") {
+    runSegmentation<pcl::PointXYZ>();
+  }
+  else {
+    if(pointType != "xyzrgb") {
+      ROS_WARN_STREAM("Unknown point_type " << pointType <<
+        ", using xyzrgb");
+    }
+    runSegmentation<pcl::PointXYZRGB>();
+  }
+  return 1;
+} //main
@@ -0,0 +1,388 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/app/segmentation_tuner.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <pcl/console/print.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <ros/ros.h>
+
+#include "orp/core/orp_utils.h"
+#include "orp/core/segmentation.h"
+#include "orp/core/worker_pool.h"
+
+namespace {
+  template <typename T>
+  bool parseList(const std::string &value, std::vector<T> &out) {
+    std::vector<T> parsed;
+    std::stringstream ss(value);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+      std::istringstream itemStream(item);
+      T v;
+      if(!(itemStream >> v)) {
+        return false;
+      }
+      parsed.push_back(v);
+    }
+    if(parsed.empty()) {
+      return false;
+    }
+    out.swap(parsed);
+    return true;
+  }
+
+  template <typename T>
+  bool parseValue(const std::string &value, T &out) {
+    std::vector<T> parsed;
+    if(!parseList(value, parsed) || parsed.size() != 1) {
+      return false;
+    }
+    out = parsed[0];
+    return true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3) {
+    std::cerr << "Usage: segmentation_tuner <pcd directory> <output yaml> "
+              << "[name:=value ...]" << std::endl << std::endl
+              << "Tuned (comma-separated candidates): voxel_leaf_size, "
+              << "cluster_tolerance," << std::endl
+              << "  max_plane_segmentation_iterations, "
+              << "percentage_to_analyze" << std::endl
+              << "Fixed: spatial_{min,max}_{x,y,z}, "
+              << "segmentation_distance_threshold, plane_leaf_size,"
+              << std::endl
+              << "  min_cluster_size, max_cluster_size, tile_size, threads, "
+              << "min_score" << std::endl;
+    return 1;
+  }
+  // ROS isn't initialized, but the throttled log macros need the time
+  ros::Time::init();
+  pcl::console::setVerbosityLevel(pcl::console::L_ALWAYS);
+
+  SegmentationTuner tuner;
+  for(int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t split = arg.find(":=");
+    if(split == std::string::npos ||
+      !tuner.setOption(arg.substr(0, split), arg.substr(split + 2)))
+    {
+      std::cerr << "Bad option " << arg << std::endl;
+      return 1;
+    }
+  }
+  if(!tuner.loadFrames(argv[1])) {
+    std::cerr << "No PCD frames found in " << argv[1] << std::endl;
+    return 1;
+  }
+  tuner.run();
+  if(!tuner.writeYaml(argv[2])) {
+    std::cerr << "Couldn't write " << argv[2] << std::endl;
+    return 1;
+  }
+  return 0;
+} //main
+
+SegmentationTuner::SegmentationTuner() :
+  base(orp::SegmentationConfig::__getDefault__()),
+  threads(0),
+  minScore(0.95)
+{
+  voxelLeafSizes = {0.003, 0.005, 0.008, 0.012};
+  clusterTolerances = {0.01, 0.02, 0.03, 0.05};
+  planeIterations = {20, 50, 100, 200};
+  percentagesToAnalyze = {0.1, 0.2, 0.3, 0.5};
+}
+
+bool SegmentationTuner::setOption(const std::string &key,
+  const std::string &value)
+{
+  if(key == "voxel_leaf_size") return parseList(value, voxelLeafSizes);
+  if(key == "cluster_tolerance") return parseList(value, clusterTolerances);
+  if(key == "max_plane_segmentation_iterations") {
+    return parseList(value, planeIterations);
+  }
+  if(key == "percentage_to_analyze") {
+    return parseList(value, percentagesToAnalyze);
+  }
+  if(key == "spatial_min_x") return parseValue(value, base.spatial_min_x);
+  if(key == "spatial_max_x") return parseValue(value, base.spatial_max_x);
+  if(key == "spatial_min_y") return parseValue(value, base.spatial_min_y);
+  if(key == "spatial_max_y") return parseValue(value, base.spatial_max_y);
+  if(key == "spatial_min_z") return parseValue(value, base.spatial_min_z);
+  if(key == "spatial_max_z") return parseValue(value, base.spatial_max_z);
+  if(key == "segmentation_distance_threshold") {
+    return parseValue(value, base.segmentation_distance_threshold);
+  }
+  if(key == "plane_leaf_size") return parseValue(value, base.plane_leaf_size);
+  if(key == "min_cluster_size") {
+    return parseValue(value, base.min_cluster_size);
+  }
+  if(key == "max_cluster_size") {
+    return parseValue(value, base.max_cluster_size);
+  }
+  if(key == "tile_size") return parseValue(value, base.tile_size);
+  if(key == "threads") return parseValue(value, threads);
+  if(key == "min_score") return parseValue(value, minScore);
+  return false;
+}
+
+bool SegmentationTuner::loadFrames(const std::string &directory)
+{
+  namespace fs = boost::filesystem;
+  frameDirectory = directory;
+  if(!fs::is_directory(directory)) {
+    return false;
+  }
+
+  std::vector<std::string> names;
+  for(fs::directory_iterator it(directory); it != fs::directory_iterator();
+    ++it)
+  {
+    if(fs::is_regular_file(it->status()) &&
+      it->path().extension() == ".pcd")
+    {
+      names.push_back(it->path().filename().string());
+    }
+  }
+  std::sort(names.begin(), names.end());
+
+  std::map<std::string, int> counts;
+  fs::path countPath = fs::path(directory) / "cluster_counts.txt";
+  std::ifstream countFile(countPath.c_str());
+  std::string name;
+  int count;
+  while(countFile >> name >> count) {
+    counts[name] = count;
+  }
+
+  for(size_t i = 0; i < names.size(); ++i) {
+    pcl::PCLPointCloud2 cloud;
+    std::string path = (fs::path(directory) / names[i]).string();
+    if(pcl::io::loadPCDFile(path, cloud) == -1) {
+      std::cerr << "Skipping unreadable frame " << path << std::endl;
+      continue;
+    }
+    frameNames.push_back(names[i]);
+    frames.push_back(sensor_msgs::PointCloud2());
+    pcl_conversions::fromPCL(cloud, frames.back());
+    // the frames are taken to be in the clipping frame already
+    frames.back().header.frame_id = "";
+    std::map<std::string, int>::const_iterator label = counts.find(names[i]);
+    labelledCounts.push_back(label == counts.end() ? -1 : label->second);
+  }
+  std::cout << "Loaded " << frames.size() << " frames (" << counts.size()
+            << " labelled)" << std::endl;
+  return !frames.empty();
+}
+
+double SegmentationTuner::evaluate(const orp::SegmentationConfig &config,
+  std::vector<int> &counts) const
+{
+  // trials already run in parallel, one per thread, so each segmentation
+  // gets a single worker rather than one per core
+  Segmentation<ORPPoint> segmentation(config, 1);
+  counts.assign(frames.size(), 0);
+
+  // warm up the pools, so that the first frame isn't charged for them
+  orp::Segmentation::Response response;
+  segmentation.segment(frames[0], response);
+
+  ros::WallTime start = ros::WallTime::now();
+  for(size_t i = 0; i < frames.size(); ++i) {
+    if(segmentation.segment(frames[i], response)) {
+      counts[i] = response.summaries.size();
+    }
+  }
+  return (ros::WallTime::now() - start).toSec() / frames.size();
+}
+
+void SegmentationTuner::run()
+{
+  trials.clear();
+  Trial combination;
+  combination.config = base;
+  combination.seconds = 0;
+  combination.score = 0;
+  for(size_t v = 0; v < voxelLeafSizes.size(); ++v) {
+    combination.config.voxel_leaf_size = voxelLeafSizes[v];
+    for(size_t c = 0; c < clusterTolerances.size(); ++c) {
+      combination.config.cluster_tolerance = clusterTolerances[c];
+      for(size_t p = 0; p < planeIterations.size(); ++p) {
+        combination.config.max_plane_segmentation_iterations =
+          planeIterations[p];
+        for(size_t a = 0; a < percentagesToAnalyze.size(); ++a) {
+          combination.config.percentage_to_analyze = percentagesToAnalyze[a];
+          trials.push_back(combination);
+        }
+      }
+    }
+  }
+
+  // expected cluster counts for the unlabelled frames
+  std::vector<int> expected = labelledCounts;
+  if(std::count(expected.begin(), expected.end(), -1) > 0) {
+    orp::SegmentationConfig reference = base;
+    reference.voxel_leaf_size =
+      *std::min_element(voxelLeafSizes.begin(), voxelLeafSizes.end());
+    reference.max_plane_segmentation_iterations =
+      *std::max_element(planeIterations.begin(), planeIterations.end());
+    reference.percentage_to_analyze = *std::max_element(
+      percentagesToAnalyze.begin(), percentagesToAnalyze.end());
+    std::vector<int> referenceCounts;
+    evaluate(reference, referenceCounts);
+    for(size_t i = 0; i < expected.size(); ++i) {
+      if(expected[i] < 0) {
+        expected[i] = referenceCounts[i];
+      }
+    }
+  }
+
+  std::cout << "Evaluating " << trials.size() << " parameter combinations"
+            << std::endl;
+  std::function<void(size_t)> runTrial = [this, &expected](size_t t) {
+    Trial &trial = trials[t];
+    std::vector<int> counts;
+    trial.seconds = evaluate(trial.config, counts);
+    // Symmetric, so that extra clusters (over-segmentation) cost as much as
+    // missing ones
+    double score = 0;
+    for(size_t i = 0; i < counts.size(); ++i) {
+      int most = std::max(counts[i], expected[i]);
+      if(most <= 0) {
+        score += 1;
+      }
+      else {
+        score += std::min(counts[i], expected[i]) / static_cast<double>(most);
+      }
+    }
+    trial.score = score / counts.size();
+  };
+
+  size_t numThreads = threads > 0 ? threads :
+    std::max(1u, std::thread::hardware_concurrency());
+  if(numThreads == 1) {
+    for(size_t t = 0; t < trials.size(); ++t) {
+      runTrial(t);
+    }
+  }
+  else {
+    // the calling thread works too
+    WorkerPool pool(numThreads - 1);
+    pool.parallelFor(trials.size(), runTrial);
+  }
+}
+
+std::vector<SegmentationTuner::Trial> SegmentationTuner::paretoFront() const
+{
+  std::vector<Trial> sorted = trials;
+  std::sort(sorted.begin(), sorted.end(),
+    [](const Trial &a, const Trial &b) {
+      return a.seconds < b.seconds ||
+        (a.seconds == b.seconds && a.score > b.score);
+    });
+
+  // fastest first, so a trial is on the front if it beats the score of
+  // everything faster than it
+  std::vector<Trial> front;
+  for(size_t i = 0; i < sorted.size(); ++i) {
+    if(front.empty() || sorted[i].score > front.back().score) {
+      front.push_back(sorted[i]);
+    }
+  }
+  return front;
+}
+
+bool SegmentationTuner::writeYaml(const std::string &path) const
+{
+  std::vector<Trial> front = paretoFront();
+  if(front.empty()) {
+    return false;
+  }
+  const Trial *chosen = &front.back();
+  for(size_t i = 0; i < front.size(); ++i) {
+    if(front[i].score >= minScore) {
+      chosen = &front[i];
+      break;
+    }
+  }
+
+  std::ofstream out(path.c_str());
+  if(!out.is_open()) {
+    return false;
+  }
+  out << "# Written by segmentation_tuner from " << frames.size()
+      << " frames in " << frameDirectory << std::endl
+      << "# The fastest parameters with cluster count score >= " << minScore
+      << " (or the best score, if none reach it)." << std::endl
+      << "# Load with: roslaunch orp orp.launch config_file:=" << path
+      << std::endl
+      << "orp:" << std::endl
+      << "  segmentation:" << std::endl
+      << "    voxel_leaf_size: " << chosen->config.voxel_leaf_size
+      << std::endl
+      << "    cluster_tolerance: " << chosen->config.cluster_tolerance
+      << std::endl
+      << "    max_plane_segmentation_iterations: "
+      << chosen->config.max_plane_segmentation_iterations << std::endl
+      << "    percentage_to_analyze: "
+      << chosen->config.percentage_to_analyze << std::endl
+      << std::endl
+      << "# Every trial that no other beats on both latency and score, "
+      << "fastest first" << std::endl
+      << "segmentation_tuner:" << std::endl
+      << "  pareto_front:" << std::endl;
+  for(size_t i = 0; i < front.size(); ++i) {
+    out << "    - {seconds: " << front[i].seconds
+        << ", score: " << front[i].score
+        << ", voxel_leaf_size: " << front[i].config.voxel_leaf_size
+        << ", cluster_tolerance: " << front[i].config.cluster_tolerance
+        << ", max_plane_segmentation_iterations: "
+        << front[i].config.max_plane_segmentation_iterations
+        << ", percentage_to_analyze: "
+        << front[i].config.percentage_to_analyze << "}" << std::endl;
+  }
+  std::cout << "Wrote " << front.size() << " Pareto-optimal trials to "
+            << path << std::endl;
+  return out.good();
+}
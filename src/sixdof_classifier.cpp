@@ -36,30 +36,7 @@
 #include <pcl/recognition/crh_alignment.h>
 
 #include <boost/filesystem.hpp>
-
-/**
- * Starts up the name and handles command-line arguments.
- * @param  argc num args
- * @param  argv args
- * @return      1 if all is well.
- */
-int main(int argc, char **argv)
-{
-  ros::init(argc, argv, "sixdof_classifier");
-
-  ROS_INFO("Starting SixDOF Classifier");
-  SixDOFClassifier v;
-  v.init();
-
-  ros::spin();
-  return 1;
-} //main
-
-SixDOFClassifier::SixDOFClassifier():
-  NNClassifier()
-{
-  NNClassifier::init();
-}
+#include <pluginlib/class_list_macros.h>
 
 bool SixDOFClassifier::loadHist(
   const boost::filesystem::path &path, FeatureVector &sixdof)
@@ -94,7 +71,7 @@ bool SixDOFClassifier::loadHist(
                    cloud_name.begin()+cloud_name.rfind("."));
   cloudName += ".pcd";
   // load the file
-  if (pcl::io::loadPCDFile<ORPPoint> (cloudName, *(kp.cloud)) == -1)
+  if (pcl::io::loadPCDFile<GeometryPoint> (cloudName, *(kp.cloud)) == -1)
   {
     ROS_ERROR ("Couldn't read file %s", cloudName.c_str());
     return false;
@@ -124,152 +101,154 @@ bool SixDOFClassifier::loadHist(
 
 double testLast = 0; // used for debug testing
 
-void SixDOFClassifier::cb_classify(const sensor_msgs::PointCloud2& cloud) {
-  orp::ClassificationResult classRes;
-  classRes.method = "sixdof";
-
-  orp::Segmentation seg_srv;
-  seg_srv.request.scene = cloud;
-  segmentation_client_.call(seg_srv);
-  std::vector<sensor_msgs::PointCloud2> clouds = seg_srv.response.clusters;
-
-  if(!clouds.empty()) {
-    for(auto eachCloud = clouds.begin(); eachCloud != clouds.end();
-      eachCloud++)
-    {
-      if(eachCloud->width < 3)
-      {
-        continue;
-      }
-      orp::WorldObject thisObject;
-      pcl::PointCloud<ORPPoint>::Ptr thisCluster(
-        new pcl::PointCloud<ORPPoint>);
-      pcl::fromROSMsg(*eachCloud, *thisCluster);
-
-      //Compute sixdof:
-      pcl::CVFHEstimation<ORPPoint, pcl::Normal, pcl::VFHSignature308> cvfh;
-      cvfh.setInputCloud (thisCluster);
-      //Estimate normals:
-      pcl::NormalEstimation<ORPPoint, pcl::Normal> ne;
-      ne.setInputCloud (thisCluster);
-      pcl::search::KdTree<ORPPoint>::Ptr treeNorm(
-        new pcl::search::KdTree<ORPPoint> ());
-      ne.setSearchMethod (treeNorm);
-      pcl::PointCloud<pcl::Normal>::Ptr cloud_normals(
-        new pcl::PointCloud<pcl::Normal>);
-      ne.setRadiusSearch (0.03);
-      ne.compute (*cloud_normals);
-
-      //SixDOF estimation
-      cvfh.setInputNormals(cloud_normals);
-      cvfh.setSearchMethod(treeNorm);
-      pcl::PointCloud<pcl::VFHSignature308>::Ptr cvfhs(
-        new pcl::PointCloud<pcl::VFHSignature308> ());
-      cvfh.compute(*cvfhs);
-
-      //Nearest neighbor algorigthm
-      FeatureVector histogram;
-      histogram.second.resize(308);
-
-      for (size_t i = 0; i < 308; ++i) {
-        // TODO(Kukanani): does the fact that we only look at index 0 here
-        // matter? I think it might.
-        histogram.second[i] = cvfhs->points[0].histogram[i];
-      }
-
-      int numNeighbors = 1;
-      // KNN classification find nearest neighbors based on histogram. Only
-      // concerned with the first one, since our dataset only includes one
-      // data point for each classification/pose pair
-      int numFound = 0;
-
-      numFound = nearestKSearch (*kIndex, histogram, numNeighbors,
-        kIndices, kDistances);
-
-      if(numFound == 0) {
-        ROS_ERROR("KNN search found 0 nearby feature vectors");
-      }
-
-      int limit = std::min<int>(numNeighbors, numFound);
-
-      for(int j=0; j<limit; j++) {
-        ROS_DEBUG("SixDOF: Dist(%s@%.2f): %f",
-          subModels.at(kIndices[0][j]).first.name.c_str(),
-          subModels.at(kIndices[0][j]).first.angle, kDistances[0][j]);
-      }
-
-      Eigen::Vector4f clusterCentroid;
-      pcl::compute3DCentroid(*thisCluster, clusterCentroid);
-
-      pcl::PointCloud<CRH90>::Ptr clusterCRH(new pcl::PointCloud<CRH90>);
-      pcl::CRHEstimation<ORPPoint, pcl::Normal, CRH90> clusterCRHGen;
-      clusterCRHGen.setInputCloud(thisCluster);
-      clusterCRHGen.setInputNormals(cloud_normals);
-      clusterCRHGen.setCentroid(clusterCentroid);
-      clusterCRHGen.compute(*clusterCRH);
-
-      Eigen::Vector4f viewCentroid =
-        subModels.at(kIndices[0][0]).first.centroid;
-
-      pcl::PointCloud<CRH90>::Ptr viewCRH =
-        subModels.at(kIndices[0][0]).first.crh;
-
-      pcl::CRHAlignment<ORPPoint, 90> alignment;
-      alignment.setInputAndTargetView(thisCluster,
-        subModels.at(kIndices[0][0]).first.cloud);
-      // CRHAlignment works with Vector3f, not Vector4f.
-      Eigen::Vector3f viewCentroid3f(viewCentroid[0],
-                                     viewCentroid[1],
-                                     viewCentroid[2]);
-      Eigen::Vector3f clusterCentroid3f(clusterCentroid[0],
-                                        clusterCentroid[1],
-                                        clusterCentroid[2]);
-      alignment.setInputAndTargetCentroids(clusterCentroid3f, viewCentroid3f);
-
-      // Compute the roll angle(s).
-      std::vector<float> angles;
-      alignment.computeRollAngle(*clusterCRH, *viewCRH, angles);
-
-      Eigen::Affine3d finalPose;
-      finalPose(0,3) = clusterCentroid(0)+viewCentroid(0);
-      finalPose(1,3) = clusterCentroid(1)+viewCentroid(1);
-      finalPose(2,3) = clusterCentroid(2)+viewCentroid(2);
-
-      if (angles.size() == 0)
-      {
-        ROS_WARN("[sixdof] No angles correlated.");
-      }
-      else {
-        // CRH rotation
-
-        // get the rotation vector - just the vector to the centroid in object
-        // space
-        Eigen::Vector3d rotVec = Eigen::Vector3d(0.0f, 0.0f, 1.0f);
-        rotVec.normalize();
-
-        double radRotationAmount = 2*M_PI - angles.at(0) * M_PI/180;
-
-        // create a quaternion that represents rotation around an axis
-        Eigen::Quaterniond quat;
-        quat = Eigen::AngleAxisd(radRotationAmount, rotVec);
-        quat.normalize();
-        Eigen::Matrix3d rotMat; rotMat = quat;
-
-        // rotate the object using the quaternion.
-        Eigen::Affine3d crhRot; crhRot =
-          Eigen::Affine3d(Eigen::AngleAxisd(radRotationAmount, rotVec));
-        finalPose.linear() = rotMat;
-      }
-
-      finalPose.linear() *= subModels.at(kIndices[0][0]).first.pose.linear();
-
-      thisObject.label = subModels.at(kIndices[0][0]).first.name;
-      tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
-
-      classRes.result.push_back(thisObject);
-      delete[] kIndices.ptr();
-      delete[] kDistances.ptr();
-    }
+void SixDOFClassifier::classifyCluster(const ClusterView& cluster,
+  std::vector<orp::WorldObject>& objects)
+{
+  if(cluster.summary().point_count < 3 || !kIndex)
+  {
+    // too small to describe, or there are no models to match against
+    return;
   }
-  classification_pub_.publish(classRes);
-} //classify
\ No newline at end of file
+  orp::WorldObject thisObject;
+  // CRHAlignment takes a non-const pointer, but only reads the points
+  pcl::PointCloud<GeometryPoint>::Ptr thisCluster =
+    boost::const_pointer_cast<pcl::PointCloud<GeometryPoint> >(
+      cluster.points());
+
+  //Compute sixdof:
+  pcl::CVFHEstimation<GeometryPoint, pcl::Normal, pcl::VFHSignature308>
+    cvfh;
+  cvfh.setInputCloud (thisCluster);
+  //Estimate normals:
+  pcl::NormalEstimation<GeometryPoint, pcl::Normal> ne;
+  ne.setInputCloud (thisCluster);
+  pcl::search::KdTree<GeometryPoint>::Ptr treeNorm(
+    new pcl::search::KdTree<GeometryPoint> ());
+  ne.setSearchMethod (treeNorm);
+  pcl::PointCloud<pcl::Normal>::Ptr cloud_normals(
+    new pcl::PointCloud<pcl::Normal>);
+  ne.setRadiusSearch (0.03);
+  ne.compute (*cloud_normals);
+
+  //SixDOF estimation
+  cvfh.setInputNormals(cloud_normals);
+  cvfh.setSearchMethod(treeNorm);
+  pcl::PointCloud<pcl::VFHSignature308>::Ptr cvfhs(
+    new pcl::PointCloud<pcl::VFHSignature308> ());
+  cvfh.compute(*cvfhs);
+
+  //Nearest neighbor algorigthm
+  FeatureVector histogram;
+  histogram.second.resize(308);
+
+  for (size_t i = 0; i < 308; ++i) {
+    // TODO(Kukanani): does the fact that we only look at index 0 here
+    // matter? I think it might.
+    histogram.second[i] = cvfhs->points[0].histogram[i];
+  }
+
+  // local, since clusters are classified in parallel
+  flann::Matrix<int> kIndices;
+  flann::Matrix<float> kDistances;
+
+  int numNeighbors = 1;
+  // KNN classification find nearest neighbors based on histogram. Only
+  // concerned with the first one, since our dataset only includes one
+  // data point for each classification/pose pair
+  int numFound = 0;
+
+  numFound = nearestKSearch (*kIndex, histogram, numNeighbors,
+    kIndices, kDistances);
+
+  if(numFound == 0) {
+    ROS_ERROR("KNN search found 0 nearby feature vectors");
+    delete[] kIndices.ptr();
+    delete[] kDistances.ptr();
+    return;
+  }
+
+  int limit = std::min<int>(numNeighbors, numFound);
+
+  for(int j=0; j<limit; j++) {
+    ROS_DEBUG("SixDOF: Dist(%s@%.2f): %f",
+      subModels.at(kIndices[0][j]).first.name.c_str(),
+      subModels.at(kIndices[0][j]).first.angle, kDistances[0][j]);
+  }
+
+  const orp::ClusterSummary& summary = cluster.summary();
+  Eigen::Vector4f clusterCentroid(summary.centroid.x,
+                                  summary.centroid.y,
+                                  summary.centroid.z,
+                                  1.0f);
+
+  pcl::PointCloud<CRH90>::Ptr clusterCRH(new pcl::PointCloud<CRH90>);
+  pcl::CRHEstimation<GeometryPoint, pcl::Normal, CRH90> clusterCRHGen;
+  clusterCRHGen.setInputCloud(thisCluster);
+  clusterCRHGen.setInputNormals(cloud_normals);
+  clusterCRHGen.setCentroid(clusterCentroid);
+  clusterCRHGen.compute(*clusterCRH);
+
+  Eigen::Vector4f viewCentroid =
+    subModels.at(kIndices[0][0]).first.centroid;
+
+  pcl::PointCloud<CRH90>::Ptr viewCRH =
+    subModels.at(kIndices[0][0]).first.crh;
+
+  pcl::CRHAlignment<GeometryPoint, 90> alignment;
+  alignment.setInputAndTargetView(thisCluster,
+    subModels.at(kIndices[0][0]).first.cloud);
+  // CRHAlignment works with Vector3f, not Vector4f.
+  Eigen::Vector3f viewCentroid3f(viewCentroid[0],
+                                 viewCentroid[1],
+                                 viewCentroid[2]);
+  Eigen::Vector3f clusterCentroid3f(clusterCentroid[0],
+                                    clusterCentroid[1],
+                                    clusterCentroid[2]);
+  alignment.setInputAndTargetCentroids(clusterCentroid3f, viewCentroid3f);
+
+  // Compute the roll angle(s).
+  std::vector<float> angles;
+  alignment.computeRollAngle(*clusterCRH, *viewCRH, angles);
+
+  Eigen::Affine3d finalPose;
+  finalPose(0,3) = clusterCentroid(0)+viewCentroid(0);
+  finalPose(1,3) = clusterCentroid(1)+viewCentroid(1);
+  finalPose(2,3) = clusterCentroid(2)+viewCentroid(2);
+
+  if (angles.size() == 0)
+  {
+    ROS_WARN("[sixdof] No angles correlated.");
+  }
+  else {
+    // CRH rotation
+
+    // get the rotation vector - just the vector to the centroid in object
+    // space
+    Eigen::Vector3d rotVec = Eigen::Vector3d(0.0f, 0.0f, 1.0f);
+    rotVec.normalize();
+
+    double radRotationAmount = 2*M_PI - angles.at(0) * M_PI/180;
+
+    // create a quaternion that represents rotation around an axis
+    Eigen::Quaterniond quat;
+    quat = Eigen::AngleAxisd(radRotationAmount, rotVec);
+    quat.normalize();
+    Eigen::Matrix3d rotMat; rotMat = quat;
+
+    // rotate the object using the quaternion.
+    Eigen::Affine3d crhRot; crhRot =
+      Eigen::Affine3d(Eigen::AngleAxisd(radRotationAmount, rotVec));
+    finalPose.linear() = rotMat;
+  }
+
+  finalPose.linear() *= subModels.at(kIndices[0][0]).first.pose.linear();
+
+  thisObject.label = subModels.at(kIndices[0][0]).first.name;
+  tf::poseEigenToMsg(finalPose, thisObject.pose.pose);
+
+  objects.push_back(thisObject);
+  delete[] kIndices.ptr();
+  delete[] kDistances.ptr();
+}
+
+PLUGINLIB_EXPORT_CLASS(SixDOFClassifier, ClassifierPlugin)
@@ -0,0 +1,254 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/voxel_hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ros/ros.h>
+
+#include "orp/core/frame_arena.h"
+#include "orp/core/morton.h"
+#include "orp/core/point_traits.h"
+
+namespace {
+  /// Grid coordinates are offset by this much so that they're all positive.
+  const int64_t kAxisOffset = 1 << (Morton::kAxisBits - 1);
+
+  /// Size of the table when the first voxel is added
+  const size_t kInitialSlots = 1024;
+
+  /// Spread the bits of a key over the whole word, so that keys that differ
+  /// only in their low bits (neighboring voxels) land far apart in the table.
+  inline size_t hashKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+}
+
+const uint64_t VoxelHash::kEmptyKey;
+
+VoxelHash::VoxelHash(float leafSize) :
+  trackColor(true),
+  occupied(0),
+  slotMask(0)
+{
+  setLeafSize(leafSize);
+}
+
+void VoxelHash::setLeafSize(float size)
+{
+  leafSize = size;
+  inverseLeafSize = 1.0f / size;
+  clear();
+}
+
+void VoxelHash::setTrackColor(bool track)
+{
+  trackColor = track;
+  clear();
+}
+
+void VoxelHash::clear()
+{
+  if(occupied == 0) {
+    return;
+  }
+  for(size_t i = 0; i < slots.size(); ++i) {
+    slots[i].key = kEmptyKey;
+  }
+  occupied = 0;
+}
+
+void VoxelHash::grow()
+{
+  std::vector<Slot> old;
+  old.swap(slots);
+
+  Slot empty;
+  empty.key = kEmptyKey;
+  slots.resize(old.empty() ? kInitialSlots : 2 * old.size(), empty);
+  slotMask = slots.size() - 1;
+  ScratchGrowth::count();
+
+  for(size_t i = 0; i < old.size(); ++i) {
+    if(old[i].key == kEmptyKey) {
+      continue;
+    }
+    size_t index = hashKey(old[i].key) & slotMask;
+    while(slots[index].key != kEmptyKey) {
+      index = (index + 1) & slotMask;
+    }
+    slots[index] = old[i];
+  }
+}
+
+VoxelHash::Voxel& VoxelHash::lookup(uint64_t key)
+{
+  // keep the table at most half full so that probes stay short
+  if(2 * (occupied + 1) > slots.size()) {
+    grow();
+  }
+  size_t index = hashKey(key) & slotMask;
+  while(true) {
+    Slot &slot = slots[index];
+    if(slot.key == key) {
+      return slot.voxel;
+    }
+    if(slot.key == kEmptyKey) {
+      slot.key = key;
+      slot.voxel = Voxel();
+      ++occupied;
+      return slot.voxel;
+    }
+    index = (index + 1) & slotMask;
+  }
+}
+
+uint64_t VoxelHash::keyFor(float x, float y, float z) const
+{
+  return Morton::encode(
+    static_cast<uint32_t>(
+      static_cast<int64_t>(std::floor(x * inverseLeafSize)) + kAxisOffset),
+    static_cast<uint32_t>(
+      static_cast<int64_t>(std::floor(y * inverseLeafSize)) + kAxisOffset),
+    static_cast<uint32_t>(
+      static_cast<int64_t>(std::floor(z * inverseLeafSize)) + kAxisOffset));
+}
+
+void VoxelHash::add(float x, float y, float z,
+  uint8_t r, uint8_t g, uint8_t b)
+{
+  Voxel &voxel = lookup(keyFor(x, y, z));
+  voxel.sum += Eigen::Vector3f(x, y, z);
+  if(trackColor) {
+    voxel.r += r;
+    voxel.g += g;
+    voxel.b += b;
+  }
+  voxel.count++;
+}
+
+template <typename PointT>
+void VoxelHash::insert(const pcl::PointCloud<PointT> &cloud)
+{
+  for(typename pcl::PointCloud<PointT>::const_iterator it = cloud.begin();
+      it != cloud.end(); ++it)
+  {
+    if(!pcl_isfinite(it->x) || !pcl_isfinite(it->y) || !pcl_isfinite(it->z))
+    {
+      continue;
+    }
+    uint32_t rgba = PointTraits<PointT>::rgba(*it);
+    add(it->x, it->y, it->z, (rgba >> 16) & 0xff, (rgba >> 8) & 0xff,
+      rgba & 0xff);
+  }
+}
+
+void VoxelHash::insert(const CompactPoint &point)
+{
+  if(!pcl_isfinite(point.x) || !pcl_isfinite(point.y) ||
+     !pcl_isfinite(point.z))
+  {
+    return;
+  }
+  add(point.x, point.y, point.z, point.r(), point.g(), point.b());
+}
+
+void VoxelHash::insert(const CompactCloud &cloud)
+{
+  for(CompactCloud::const_iterator it = cloud.begin(); it != cloud.end();
+      ++it)
+  {
+    insert(*it);
+  }
+}
+
+size_t VoxelHash::insert(const sensor_msgs::PointCloud2 &cloud,
+  const Eigen::Affine3f &transform,
+  const Eigen::Vector3f &minBound, const Eigen::Vector3f &maxBound)
+{
+  size_t inserted = 0;
+  bool decoded = CompactClouds::forEachPoint(cloud, transform, minBound,
+    maxBound, trackColor, [&](const CompactPoint &point) {
+      add(point.x, point.y, point.z, point.r(), point.g(), point.b());
+      inserted++;
+    });
+  if(!decoded) {
+    ROS_ERROR_THROTTLE(10, "Can't voxelize a cloud without x/y/z fields.");
+  }
+  return inserted;
+}
+
+template <typename PointT>
+void VoxelHash::getCloud(pcl::PointCloud<PointT> &out,
+  std::vector<uint64_t> *keys) const
+{
+  order.clear();
+  for(size_t i = 0; i < slots.size(); ++i) {
+    if(slots[i].key != kEmptyKey) {
+      order.push_back(std::make_pair(slots[i].key, i));
+    }
+  }
+  std::sort(order.begin(), order.end());
+
+  out.points.clear();
+  out.points.reserve(order.size());
+  if(keys) {
+    keys->clear();
+    keys->reserve(order.size());
+  }
+  for(size_t i = 0; i < order.size(); ++i) {
+    const Voxel &voxel = slots[order[i].second].voxel;
+    float inverseCount = 1.0f / voxel.count;
+    PointT point;
+    point.getVector3fMap() = voxel.sum * inverseCount;
+    if(trackColor) {
+      PointTraits<PointT>::setColor(point, voxel.r / voxel.count,
+        voxel.g / voxel.count, voxel.b / voxel.count);
+    }
+    out.points.push_back(point);
+    if(keys) {
+      keys->push_back(order[i].first);
+    }
+  }
+  out.width = out.points.size();
+  out.height = 1;
+  out.is_dense = true;
+}
+
+#define ORP_INSTANTIATE_VOXEL_HASH(T) \
+  template void VoxelHash::insert<T>(const pcl::PointCloud<T>&); \
+  template void VoxelHash::getCloud<T>(pcl::PointCloud<T>&, \
+    std::vector<uint64_t>*) const;
+ORP_INSTANTIATE_POINT_TYPES(ORP_INSTANTIATE_VOXEL_HASH)
@@ -0,0 +1,130 @@
+// Copyright (c) 2017, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "orp/core/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+WorkerPool::WorkerPool(size_t numThreads) :
+  stopping(false)
+{
+  if(numThreads == 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for(size_t i = 0; i < numThreads; ++i) {
+    threads.push_back(std::thread(&WorkerPool::work, this));
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    stopping = true;
+  }
+  tasksAvailable.notify_all();
+  for(size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+}
+
+void WorkerPool::post(const std::function<void()> &task)
+{
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    tasks.push_back(task);
+  }
+  tasksAvailable.notify_one();
+}
+
+void WorkerPool::work()
+{
+  while(true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(tasksMutex);
+      tasksAvailable.wait(lock, [this]{ return stopping || !tasks.empty(); });
+      if(tasks.empty()) {
+        return;
+      }
+      task = tasks.front();
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+void WorkerPool::parallelFor(size_t n,
+  const std::function<void(size_t)> &fn)
+{
+  if(n == 0) {
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::mutex doneMutex;
+  std::condition_variable allDone;
+  size_t runnersLeft = std::min(n, threads.size() + 1);
+  std::exception_ptr error;
+
+  // Each runner keeps taking indices until there are none left, so uneven
+  // work items balance out across the threads.
+  std::function<void()> runner = [&]() {
+    std::exception_ptr runnerError;
+    try {
+      for(size_t i = next++; i < n; i = next++) {
+        fn(i);
+      }
+    } catch(...) {
+      runnerError = std::current_exception();
+      next = n;
+    }
+    std::lock_guard<std::mutex> lock(doneMutex);
+    if(runnerError && !error) {
+      error = runnerError;
+    }
+    if(--runnersLeft == 0) {
+      allDone.notify_all();
+    }
+  };
+
+  for(size_t i = 1; i < std::min(n, threads.size() + 1); ++i) {
+    post(runner);
+  }
+  runner();
+
+  std::unique_lock<std::mutex> lock(doneMutex);
+  allDone.wait(lock, [&]{ return runnersLeft == 0; });
+  if(error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -49,6 +49,7 @@ WorldObject WorldObject::createFromMessage(
   WorldObject obj(message.colocationDist, manager_, message.label,
     message.pose.header.frame_id, eigenPose, message.probability);
   obj.setCloud(message.cloud);
+  obj.setClusterReference(message.cluster);
   return obj;
 }
 
@@ -118,6 +119,7 @@ bool WorldObject::merge(WorldObjectPtr other)
     probability = other->getProbability();
     setLastUpdated(ros::Time::now());
     setCloud(other->getCloud());
+    setClusterReference(other->getClusterReference());
 
     // request yourself to be destroyed in the future
     // merge successful
@@ -0,0 +1,189 @@
+// Copyright (c) 2015, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <pcl/point_types.h>
+
+#include "orp/core/cluster_codec.h"
+
+namespace {
+  /// A small block of points, each with its own color.
+  pcl::PointCloud<pcl::PointXYZRGB> coloredBlock()
+  {
+    pcl::PointCloud<pcl::PointXYZRGB> cloud;
+    for(int i = 0; i < 8; ++i) {
+      for(int j = 0; j < 6; ++j) {
+        for(int k = 0; k < 4; ++k) {
+          pcl::PointXYZRGB point(i * 20, j * 30, k * 40);
+          point.x = 0.5f + i * 0.004f;
+          point.y = -0.2f + j * 0.004f;
+          point.z = 1.0f + k * 0.004f;
+          cloud.push_back(point);
+        }
+      }
+    }
+    return cloud;
+  }
+
+  std::vector<int> allIndices(size_t count)
+  {
+    std::vector<int> indices(count);
+    for(size_t i = 0; i < count; ++i) {
+      indices[i] = i;
+    }
+    return indices;
+  }
+}
+
+TEST(ClusterCodec, RoundTripKeepsPointsAndColors)
+{
+  pcl::PointCloud<pcl::PointXYZRGB> cloud = coloredBlock();
+  const float resolution = 0.001f;
+  orp::CompressedCluster compressed;
+  ClusterCodec::encode(cloud, allIndices(cloud.size()), resolution, "odom",
+    compressed);
+  EXPECT_EQ(cloud.size(), compressed.point_count);
+  EXPECT_TRUE(compressed.has_color);
+  EXPECT_EQ("odom", compressed.header.frame_id);
+
+  CompactCloud decoded;
+  ASSERT_TRUE(ClusterCodec::decode(compressed, decoded));
+  ASSERT_EQ(cloud.size(), decoded.size());
+
+  // The order isn't kept, but every color is unique, so each decoded point
+  // can be matched to the point it came from.
+  std::vector<bool> matched(cloud.size(), false);
+  for(size_t d = 0; d < decoded.size(); ++d) {
+    size_t i = 0;
+    while(i < cloud.size() &&
+      (cloud[i].rgba & 0xffffff) != (decoded[d].rgba & 0xffffff))
+    {
+      ++i;
+    }
+    ASSERT_LT(i, cloud.size()) << "decoded point " << d;
+    EXPECT_FALSE(matched[i]);
+    matched[i] = true;
+    EXPECT_NEAR(cloud[i].x, decoded[d].x, 0.5f * resolution + 1e-5f);
+    EXPECT_NEAR(cloud[i].y, decoded[d].y, 0.5f * resolution + 1e-5f);
+    EXPECT_NEAR(cloud[i].z, decoded[d].z, 0.5f * resolution + 1e-5f);
+  }
+}
+
+TEST(ClusterCodec, RoundTripWithoutColor)
+{
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(pcl::PointXYZ(0.1f, 0.2f, 0.3f));
+  cloud.push_back(pcl::PointXYZ(0.1f, 0.25f, 0.3f));
+  cloud.push_back(pcl::PointXYZ(0.4f, 0.2f, 0.35f));
+  // only these points are encoded
+  std::vector<int> indices;
+  indices.push_back(2);
+  indices.push_back(0);
+
+  orp::CompressedCluster compressed;
+  ClusterCodec::encode(cloud, indices, 0.002f, "odom", compressed);
+  EXPECT_FALSE(compressed.has_color);
+
+  CompactCloud decoded;
+  ASSERT_TRUE(ClusterCodec::decode(compressed, decoded));
+  ASSERT_EQ(2u, decoded.size());
+  float distanceSum = 0;
+  for(size_t d = 0; d < decoded.size(); ++d) {
+    EXPECT_EQ(0u, decoded[d].rgba);
+    float best = INFINITY;
+    for(size_t i = 0; i < indices.size(); ++i) {
+      const pcl::PointXYZ &point = cloud[indices[i]];
+      best = std::min(best, std::fabs(point.x - decoded[d].x) +
+        std::fabs(point.y - decoded[d].y) + std::fabs(point.z - decoded[d].z));
+    }
+    distanceSum += best;
+  }
+  EXPECT_LT(distanceSum, 2 * 3 * 0.001f + 1e-5f);
+}
+
+TEST(ClusterCodec, RejectsTruncatedData)
+{
+  pcl::PointCloud<pcl::PointXYZRGB> cloud = coloredBlock();
+  orp::CompressedCluster compressed;
+  ClusterCodec::encode(cloud, allIndices(cloud.size()), 0.001f, "odom",
+    compressed);
+
+  for(size_t size = 0; size < compressed.data.size(); ++size) {
+    orp::CompressedCluster truncated = compressed;
+    truncated.data.resize(size);
+    CompactCloud decoded(1);
+    EXPECT_FALSE(ClusterCodec::decode(truncated, decoded)) << size;
+    EXPECT_TRUE(decoded.empty()) << size;
+  }
+
+  orp::CompressedCluster truncated = compressed;
+  truncated.data.resize(truncated.data.size() / 2);
+  sensor_msgs::PointCloud2 message;
+  EXPECT_FALSE(ClusterCodec::decode(truncated, message));
+  EXPECT_EQ(0u, message.width * message.height);
+}
+
+TEST(ClusterCodec, RejectsMalformedData)
+{
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(pcl::PointXYZ(0.1f, 0.2f, 0.3f));
+  cloud.push_back(pcl::PointXYZ(0.3f, 0.2f, 0.1f));
+  orp::CompressedCluster compressed;
+  ClusterCodec::encode(cloud, allIndices(cloud.size()), 0.001f, "odom",
+    compressed);
+  CompactCloud decoded;
+
+  // a count that the data can't hold is refused before anything is
+  // allocated for it
+  orp::CompressedCluster corrupt = compressed;
+  corrupt.point_count = 0xffffffffu;
+  EXPECT_FALSE(ClusterCodec::decode(corrupt, decoded));
+  EXPECT_TRUE(decoded.empty());
+
+  // bytes left over after the last point
+  corrupt = compressed;
+  corrupt.data.push_back(0);
+  EXPECT_FALSE(ClusterCodec::decode(corrupt, decoded));
+
+  // a varint that never ends
+  corrupt = compressed;
+  corrupt.data.assign(corrupt.data.size(), 0xff);
+  EXPECT_FALSE(ClusterCodec::decode(corrupt, decoded));
+
+  // color flagged, but there is none
+  corrupt = compressed;
+  corrupt.has_color = true;
+  EXPECT_FALSE(ClusterCodec::decode(corrupt, decoded));
+}
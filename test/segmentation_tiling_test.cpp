@@ -0,0 +1,158 @@
+// Copyright (c) 2015, Adam Allevato
+// Copyright (c) 2017, The University of Texas at Austin
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <gtest/gtest.h>
+
+#include <pcl/console/print.h>
+#include <pcl/point_types.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <ros/ros.h>
+
+#include "orp/core/segmentation.h"
+
+namespace {
+  /// Fill a box with points on a grid finer than the voxels. The points
+  /// are kept off the voxel edges, so rounding can't move them between
+  /// voxels, and boxes a whole number of voxels apart get the same voxels.
+  void addBox(pcl::PointCloud<pcl::PointXYZ> &cloud, float minX, float minY,
+    float minZ, float sizeX, float sizeY, float sizeZ)
+  {
+    const float spacing = 0.004f;
+    const float offset = 0.0012f;
+    for(int i = 0; i * spacing <= sizeX; ++i) {
+      for(int j = 0; j * spacing <= sizeY; ++j) {
+        for(int k = 0; k * spacing <= sizeZ; ++k) {
+          cloud.push_back(pcl::PointXYZ(minX + offset + i * spacing,
+            minY + offset + j * spacing, minZ + offset + k * spacing));
+        }
+      }
+    }
+  }
+
+  /// A scene whose objects cross tile borders in every way that matters.
+  sensor_msgs::PointCloud2 tiledScene()
+  {
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    // on the corner of four tiles
+    addBox(cloud, -0.03f, -0.03f, 1.0f, 0.06f, 0.06f, 0.06f);
+    // a bar across several tiles, which only merges into one cluster
+    // through several border stitches
+    addBox(cloud, -0.25f, 0.15f, 1.0f, 0.5f, 0.02f, 0.02f);
+    // two equal cubes, one per tile, to check the order of equal sizes
+    addBox(cloud, 0.31f, -0.21f, 1.0f, 0.03f, 0.03f, 0.03f);
+    addBox(cloud, -0.29f, -0.21f, 1.0f, 0.03f, 0.03f, 0.03f);
+    // two pieces just further apart than the tolerance, on either side of a
+    // tile border, which must stay separate
+    addBox(cloud, 0.16f, -0.1f, 1.0f, 0.03f, 0.03f, 0.03f);
+    addBox(cloud, 0.225f, -0.1f, 1.0f, 0.03f, 0.03f, 0.03f);
+
+    sensor_msgs::PointCloud2 scene;
+    pcl::toROSMsg(cloud, scene);
+    scene.header.frame_id = "odom";
+    return scene;
+  }
+
+  orp::SegmentationConfig testConfig(double tileSize)
+  {
+    orp::SegmentationConfig config =
+      orp::SegmentationConfig::__getDefault__();
+    config.spatial_min_x = -1;
+    config.spatial_max_x = 1;
+    config.spatial_min_y = -1;
+    config.spatial_max_y = 1;
+    config.spatial_min_z = 0;
+    config.spatial_max_z = 2;
+    // there are no planes to remove
+    config.percentage_to_analyze = 1.0;
+    config.voxel_leaf_size = 0.005;
+    config.plane_leaf_size = 0;
+    config.cluster_tolerance = 0.03;
+    config.min_cluster_size = 10;
+    config.max_cluster_size = 100000;
+    config.frame_deadline = 0;
+    config.tile_size = tileSize;
+    return config;
+  }
+}
+
+TEST(SegmentationTiling, MatchesUntiledClusters)
+{
+  sensor_msgs::PointCloud2 scene = tiledScene();
+
+  Segmentation<pcl::PointXYZ> whole(testConfig(0), 1);
+  orp::Segmentation::Response expected;
+  ASSERT_TRUE(whole.segment(scene, expected));
+  ASSERT_EQ(6u, expected.clusters.size());
+
+  // several workers, so that the tiles really are done in parallel
+  Segmentation<pcl::PointXYZ> tiled(testConfig(0.1), 4);
+  orp::Segmentation::Response actual;
+  ASSERT_TRUE(tiled.segment(scene, actual));
+
+  ASSERT_EQ(expected.clusters.size(), actual.clusters.size());
+  ASSERT_EQ(expected.summaries.size(), actual.summaries.size());
+  for(size_t i = 0; i < expected.clusters.size(); ++i) {
+    EXPECT_EQ(expected.clusters[i].width, actual.clusters[i].width) <<
+      "cluster " << i;
+    EXPECT_TRUE(expected.clusters[i].data == actual.clusters[i].data) <<
+      "cluster " << i;
+    EXPECT_EQ(expected.summaries[i].point_count,
+      actual.summaries[i].point_count) << "cluster " << i;
+  }
+}
+
+TEST(SegmentationTiling, TilesNarrowerThanTheTolerance)
+{
+  sensor_msgs::PointCloud2 scene = tiledScene();
+
+  Segmentation<pcl::PointXYZ> whole(testConfig(0), 1);
+  orp::Segmentation::Response expected;
+  ASSERT_TRUE(whole.segment(scene, expected));
+
+  // raised to the tolerance internally
+  Segmentation<pcl::PointXYZ> tiled(testConfig(0.01), 2);
+  orp::Segmentation::Response actual;
+  ASSERT_TRUE(tiled.segment(scene, actual));
+
+  ASSERT_EQ(expected.clusters.size(), actual.clusters.size());
+  for(size_t i = 0; i < expected.clusters.size(); ++i) {
+    EXPECT_TRUE(expected.clusters[i].data == actual.clusters[i].data) <<
+      "cluster " << i;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  // ROS isn't initialized, but the throttled log macros need the time
+  ros::Time::init();
+  pcl::console::setVerbosityLevel(pcl::console::L_ALWAYS);
+  return RUN_ALL_TESTS();
+}